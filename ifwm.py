@@ -94,8 +94,7 @@ class TitleWindow(object):
     self.window.fill_rectangle(gc_bg,  0, 0,self.width, self.height)
     self.window.poly_rectangle(self.wm.gc_title_border, [(0, 0, self.width - 1, self.height - 1)])
 
-    text_extents = self.wm.title_font.query_text_extents(self.text)
-    text_width = text_extents.overall_width
+    text_width = self.wm.title_text_width(self.text)
     width_per_char = text_width / len(self.text)
 
     text = self.text
@@ -354,6 +353,17 @@ class WindowManager(object):
     self.title_font_extents = self.title_font.query_text_extents("M")
     self.gc_title_font = root_win.create_gc(font=self.title_font, 
                                             foreground=white.pixel)
+    self.title_text_widths = {}
+
+  def title_text_width(self, text):
+    # query_text_extents is a round trip; titles repaint on every expose.
+    width = self.title_text_widths.get(text)
+    if width is None:
+      if len(self.title_text_widths) > 4096:
+        self.title_text_widths.clear()
+      width = self.title_font.query_text_extents(text).overall_width
+      self.title_text_widths[text] = width
+    return width
 
   def init_keyboard(self):
     # Ensure we're called after init_screens
@@ -479,12 +489,30 @@ class WindowManager(object):
 
   def handle_configure_request(self, ev):
     print "config request: %r" % ev
+    client = self.clients.get(ev.window)
+    if client and client in self.client_container:
+      # Clients in containers are tiled; tell them the geometry they have
+      # instead of letting them resize out of the container (ICCCM 4.1.5).
+      self.send_configure_notify(client)
+      return
+
     data = {}
     for i in ("value_mask", "x", "y", "width", "height"):
       data[i] = getattr(ev, i)
     data["border_width"] = 0
     ev.window.configure(**data)
 
+  def send_configure_notify(self, client):
+    container = self.client_container[client]
+    notify = xevent.ConfigureNotify(window=client.window, event=client.window,
+                                    x=container.x + container.client_x,
+                                    y=container.y + container.client_y,
+                                    width=container.client_width,
+                                    height=container.client_height,
+                                    border_width=0, above_sibling=X.NONE,
+                                    override=False)
+    client.window.send_event(notify, event_mask=X.StructureNotifyMask)
+
   def handle_map_request(self, ev):
     print "Map request: %r" % ev.window
     #if ev.window in self.client_container:
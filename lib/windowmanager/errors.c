@@ -0,0 +1,217 @@
+/*
+ * Asynchronous X error tracking.
+ *
+ * Requests sent through the wm_x_* wrappers are recorded along with their
+ * sequence number, the window they were about and, optionally, a callback to
+ * run if they fail. When an error comes back, the serial it carries says
+ * which of those requests caused it. Xlib doesn't allow making requests from
+ * inside an error handler, so errors are only queued there. wm_main hands
+ * them to wm_error_process() after each batch of events.
+ *
+ * An error with no callback of its own gets the default treatment. A
+ * BadWindow about a client means that client is gone, so we drop it. That
+ * also covers requests nobody tracked, like the inline property fetches.
+ * This is what lets the dispatch layer skip the XSync and server grabs it
+ * used to guard against windows disappearing mid-operation.
+ *
+ * A recorded request is forgotten once Xlib has seen a later sequence number
+ * come back from the server, since any error for it would have arrived
+ * first.
+ */
+
+#include "windowmanager.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Sanity bound in case nothing is read from the server for a long time */
+#define WM_ERROR_MAX_TRACKED 65536U
+
+typedef struct tracked_request {
+  unsigned long serial;
+  Window window;
+  const char *op;
+  wm_error_func on_error;
+  gpointer data;
+} tracked_request_t;
+
+typedef struct queued_error {
+  XErrorEvent error;
+  Bool matched;
+  tracked_request_t request; /* valid if matched */
+} queued_error_t;
+
+struct wm_errors {
+  GQueue tracked; /* tracked_request_t, oldest (lowest serial) first */
+  GQueue queued;  /* queued_error_t, waiting for wm_error_process */
+
+  unsigned long errors;
+  unsigned long matched;
+};
+
+/* Xlib has one error handler per process, so it has to find the wm_t for
+ * the Display the error came in on. With several displays (multi.c), errors
+ * come in on several threads. */
+static GSList *error_wms = NULL;
+static XErrorHandler previous_error_handler = NULL;
+static pthread_mutex_t error_wms_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static wm_t *wm_error_find(Display *dpy) {
+  GSList *item;
+  wm_t *found = NULL;
+
+  pthread_mutex_lock(&error_wms_lock);
+  for (item = error_wms; item != NULL; item = item->next) {
+    wm_t *wm = item->data;
+    if (wm->dpy == dpy) {
+      found = wm;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&error_wms_lock);
+  return found;
+} /* static wm_t *wm_error_find */
+
+/* Forget requests the server has already gotten past. */
+static void wm_error_prune(wm_t *wm) {
+  struct wm_errors *errors = wm->errors;
+  unsigned long processed = LastKnownRequestProcessed(wm->dpy);
+  tracked_request_t *request;
+
+  while ((request = g_queue_peek_head(&errors->tracked)) != NULL
+         && request->serial <= processed) {
+    g_queue_pop_head(&errors->tracked);
+    wm_res_freed(wm, WM_RES_HEAP, request);
+    free(request);
+  }
+} /* static void wm_error_prune */
+
+static int wm_error_handler(Display *dpy, XErrorEvent *ev) {
+  wm_t *wm = wm_error_find(dpy);
+  struct wm_errors *errors;
+  queued_error_t *queued;
+  GList *link;
+
+  if (wm == NULL || wm->errors == NULL) {
+    if (previous_error_handler != NULL)
+      return previous_error_handler(dpy, ev);
+    return 0;
+  }
+
+  errors = wm->errors;
+  errors->errors++;
+  queued = calloc(1, sizeof(queued_error_t));
+  wm_res_created(wm, WM_RES_HEAP, queued);
+  memcpy(&queued->error, ev, sizeof(XErrorEvent));
+  for (link = errors->tracked.head; link != NULL; link = link->next) {
+    tracked_request_t *request = link->data;
+    if (request->serial > ev->serial)
+      break;
+    if (request->serial == ev->serial) {
+      queued->matched = True;
+      queued->request = *request;
+      errors->matched++;
+      break;
+    }
+  }
+  g_queue_push_tail(&errors->queued, queued);
+  return 0;
+} /* static int wm_error_handler */
+
+void wm_error_init(wm_t *wm) {
+  if (wm->errors != NULL || wm->dpy == NULL)
+    return;
+
+  wm->errors = calloc(1, sizeof(struct wm_errors));
+  g_queue_init(&wm->errors->tracked);
+  g_queue_init(&wm->errors->queued);
+
+  pthread_mutex_lock(&error_wms_lock);
+  error_wms = g_slist_prepend(error_wms, wm);
+  if (previous_error_handler == NULL)
+    previous_error_handler = XSetErrorHandler(wm_error_handler);
+  pthread_mutex_unlock(&error_wms_lock);
+} /* void wm_error_init */
+
+/* Note that the next request sent on wm->dpy is 'op' on 'window'. If it
+ * fails, on_error is called from wm_error_process; with no on_error, the
+ * default handling applies. Call this just before making the request. */
+void wm_error_track(wm_t *wm, Window window, const char *op,
+                    wm_error_func on_error, gpointer data) {
+  struct wm_errors *errors = wm->errors;
+  tracked_request_t *request;
+
+  if (errors == NULL || wm->dpy == NULL)
+    return;
+
+  if (g_queue_get_length(&errors->tracked) >= WM_ERROR_MAX_TRACKED)
+    wm_error_prune(wm);
+  if (g_queue_get_length(&errors->tracked) >= WM_ERROR_MAX_TRACKED) {
+    request = g_queue_pop_head(&errors->tracked);
+    wm_res_freed(wm, WM_RES_HEAP, request);
+    free(request);
+  }
+
+  request = malloc(sizeof(tracked_request_t));
+  wm_res_created(wm, WM_RES_HEAP, request);
+  request->serial = NextRequest(wm->dpy);
+  request->window = window;
+  request->op = op;
+  request->on_error = on_error;
+  request->data = data;
+  g_queue_push_tail(&errors->tracked, request);
+} /* void wm_error_track */
+
+static void wm_error_default(wm_t *wm, queued_error_t *queued) {
+  XErrorEvent *ev = &queued->error;
+  const char *op = queued->matched ? queued->request.op : "unknown request";
+  char text[128];
+  client_t *client;
+
+  /* Windows vanishing under us are routine. If it was a client, it's gone. */
+  if (ev->error_code == BadWindow) {
+    client = wm_get_client(wm, ev->resourceid, False);
+    wm_log(wm, LOG_INFO, "%s: window %lu went away during %s%s", __func__,
+           ev->resourceid, op, (client != NULL) ? ", dropping it" : "");
+    if (client != NULL)
+      wm_remove_client(wm, client);
+    return;
+  }
+
+  XGetErrorText(wm->dpy, ev->error_code, text, sizeof(text));
+  if (queued->matched)
+    wm_log(wm, LOG_WARN, "%s: %s on window %ld failed: %s", __func__,
+           op, queued->request.window, text);
+  else
+    wm_log(wm, LOG_ERROR, "x11 error for request %lu (major %d): %s, resource %lu",
+           ev->serial, ev->request_code, text, ev->resourceid);
+} /* static void wm_error_default */
+
+/* Run failure callbacks for errors that came in since the last call. */
+void wm_error_process(wm_t *wm) {
+  struct wm_errors *errors = wm->errors;
+  queued_error_t *queued;
+
+  if (errors == NULL)
+    return;
+
+  while ((queued = g_queue_pop_head(&errors->queued)) != NULL) {
+    if (queued->matched && queued->request.on_error != NULL)
+      queued->request.on_error(wm, &queued->error, queued->request.window,
+                               queued->request.op, queued->request.data);
+    else
+      wm_error_default(wm, queued);
+    wm_res_freed(wm, WM_RES_HEAP, queued);
+    free(queued);
+  }
+  wm_error_prune(wm);
+} /* void wm_error_process */
+
+void wm_error_stats(wm_t *wm, unsigned long *errors, unsigned long *matched,
+                    unsigned int *tracked) {
+  *errors = (wm->errors != NULL) ? wm->errors->errors : 0;
+  *matched = (wm->errors != NULL) ? wm->errors->matched : 0;
+  *tracked = (wm->errors != NULL) ? g_queue_get_length(&wm->errors->tracked) : 0;
+} /* void wm_error_stats */
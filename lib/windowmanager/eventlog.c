@@ -0,0 +1,950 @@
+/*
+ * Binary event recording and replay.
+ *
+ * In record mode, wm_main appends every XEvent it dispatches to a log, along
+ * with the replies to any synchronous requests the handlers make while
+ * processing it. In replay mode there is no display at all: events come from
+ * the log and are fed through x_event_handlers and the listener lists, and
+ * each synchronous request is answered with the reply that was recorded.
+ *
+ * To make that work, the dispatch layer issues its X requests through the
+ * wm_x_* wrappers at the bottom of this file rather than calling Xlib
+ * directly. One-way requests are dropped during replay. With a mock display
+ * (mock.c) every request goes to the mock instead.
+ *
+ * Log format (host byte order, not meant to be portable across machines):
+ *   header:  magic, version, num_screens, then (root, width, height) for
+ *            each screen
+ *   records: kind (1 byte), type (1 byte), payload length (4 bytes),
+ *            microseconds since the previous record (4 bytes), payload
+ *
+ * Event payloads are only as long as the specific event structure for their
+ * type, not the full XEvent union.
+ *
+ * Property fetches (worker.c) are recorded by their results, at the point
+ * the main thread applied them, so a replay sees titles and classes change
+ * at the same place in the event stream as the original session did whether
+ * or not a worker thread was used.
+ */
+
+#include "windowmanager.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define WM_EVENTLOG_MAGIC 0x574d4556U /* 'WMEV' */
+#define WM_EVENTLOG_VERSION 5U
+#define WM_EVENTLOG_MAX_SCREENS 255 /* the connection setup's count is a byte */
+
+#define WM_EVENTLOG_RECORD 1
+#define WM_EVENTLOG_REPLAY 2
+
+/* Record kinds */
+#define LOG_KIND_EVENT 1
+#define LOG_KIND_REPLY 2
+#define LOG_KIND_FETCH 3
+
+/* Reply types */
+#define REPLY_WINDOW_ATTRIBUTES 1
+#define REPLY_INTERN_ATOM 3
+#define REPLY_ATOM_NAME 4
+#define REPLY_QUERY_POINTER 5
+#define REPLY_QUERY_TREE 6
+#define REPLY_MASK_EVENT 7
+
+typedef struct log_record {
+  uint8_t kind;
+  uint8_t type;
+  uint32_t length;
+  uint32_t usec;
+} __attribute__((packed)) log_record_t;
+
+struct wm_eventlog {
+  FILE *fp;
+  int mode;
+  struct timeval last;
+
+  /* Replay lookahead: the next record, already read */
+  Bool have_next;
+  log_record_t next;
+  char *payload;
+  size_t payload_size;
+
+  unsigned long events;
+  unsigned long replies;
+  unsigned long divergences;
+};
+
+typedef struct reply_attributes {
+  int32_t status;
+  int32_t screen;
+  XWindowAttributes attr;
+} reply_attributes_t;
+
+typedef struct log_fetch {
+  uint64_t window;
+  uint32_t what;
+  uint32_t name_len; /* string lengths include the NUL; 0 means NULL */
+  uint32_t res_name_len;
+  uint32_t res_class_len;
+  uint32_t role_len;
+  uint32_t net_wm_state_len; /* in atoms, like icon_len in longs */
+  uint64_t icon_len;
+  uint64_t sync_counter;
+  uint64_t transient_for;
+  XWMHints hints;
+} log_fetch_t;
+
+typedef struct reply_query_pointer {
+  int32_t result;
+  int32_t root_x, root_y;
+  int32_t x, y;
+  uint32_t mask;
+  uint64_t root, child;
+} reply_query_pointer_t;
+
+static size_t wm_eventlog_event_size(int type) {
+  switch (type) {
+    case KeyPress: case KeyRelease: return sizeof(XKeyEvent);
+    case ButtonPress: case ButtonRelease: return sizeof(XButtonEvent);
+    case MotionNotify: return sizeof(XMotionEvent);
+    case EnterNotify: case LeaveNotify: return sizeof(XCrossingEvent);
+    case FocusIn: case FocusOut: return sizeof(XFocusChangeEvent);
+    case KeymapNotify: return sizeof(XKeymapEvent);
+    case Expose: return sizeof(XExposeEvent);
+    case GraphicsExpose: return sizeof(XGraphicsExposeEvent);
+    case NoExpose: return sizeof(XNoExposeEvent);
+    case VisibilityNotify: return sizeof(XVisibilityEvent);
+    case CreateNotify: return sizeof(XCreateWindowEvent);
+    case DestroyNotify: return sizeof(XDestroyWindowEvent);
+    case UnmapNotify: return sizeof(XUnmapEvent);
+    case MapNotify: return sizeof(XMapEvent);
+    case MapRequest: return sizeof(XMapRequestEvent);
+    case ReparentNotify: return sizeof(XReparentEvent);
+    case ConfigureNotify: return sizeof(XConfigureEvent);
+    case ConfigureRequest: return sizeof(XConfigureRequestEvent);
+    case GravityNotify: return sizeof(XGravityEvent);
+    case ResizeRequest: return sizeof(XResizeRequestEvent);
+    case CirculateNotify: return sizeof(XCirculateEvent);
+    case CirculateRequest: return sizeof(XCirculateRequestEvent);
+    case PropertyNotify: return sizeof(XPropertyEvent);
+    case SelectionClear: return sizeof(XSelectionClearEvent);
+    case SelectionRequest: return sizeof(XSelectionRequestEvent);
+    case SelectionNotify: return sizeof(XSelectionEvent);
+    case ColormapNotify: return sizeof(XColormapEvent);
+    case ClientMessage: return sizeof(XClientMessageEvent);
+    case MappingNotify: return sizeof(XMappingEvent);
+    default: return sizeof(XEvent); /* extension events */
+  }
+} /* static size_t wm_eventlog_event_size */
+
+static uint32_t wm_eventlog_elapsed(struct wm_eventlog *log) {
+  struct timeval now;
+  long long usec;
+
+  gettimeofday(&now, NULL);
+  usec = (now.tv_sec - log->last.tv_sec) * 1000000LL
+         + (now.tv_usec - log->last.tv_usec);
+  log->last = now;
+  if (usec < 0)
+    return 0;
+  if (usec > UINT32_MAX)
+    return UINT32_MAX;
+  return (uint32_t)usec;
+} /* static uint32_t wm_eventlog_elapsed */
+
+static void wm_eventlog_write(wm_t *wm, int kind, int type,
+                              const void *payload, size_t length) {
+  struct wm_eventlog *log = wm->eventlog;
+  log_record_t rec;
+
+  rec.kind = kind;
+  rec.type = type;
+  rec.length = length;
+  rec.usec = wm_eventlog_elapsed(log);
+  if (fwrite(&rec, sizeof(rec), 1, log->fp) != 1
+      || (length > 0 && fwrite(payload, length, 1, log->fp) != 1)) {
+    wm_log(wm, LOG_ERROR, "%s: write failed, recording stopped: %s",
+           __func__, strerror(errno));
+    fclose(log->fp);
+    free(log);
+    wm->eventlog = NULL;
+  }
+} /* static void wm_eventlog_write */
+
+/* Read the next record into the lookahead slot. Returns False at EOF. */
+static Bool wm_eventlog_peek(wm_t *wm) {
+  struct wm_eventlog *log = wm->eventlog;
+
+  if (log->have_next)
+    return True;
+
+  if (fread(&log->next, sizeof(log_record_t), 1, log->fp) != 1)
+    return False;
+
+  if (log->next.length > log->payload_size) {
+    log->payload_size = log->next.length;
+    log->payload = realloc(log->payload, log->payload_size);
+  }
+  if (log->next.length > 0
+      && fread(log->payload, log->next.length, 1, log->fp) != 1) {
+    wm_log(wm, LOG_ERROR, "%s: truncated record at end of log", __func__);
+    return False;
+  }
+  log->have_next = True;
+  return True;
+} /* static Bool wm_eventlog_peek */
+
+static Bool wm_eventlog_is_replay(wm_t *wm) {
+  return wm->eventlog != NULL && wm->eventlog->mode == WM_EVENTLOG_REPLAY;
+}
+
+Bool wm_eventlog_replaying(wm_t *wm) {
+  return wm_eventlog_is_replay(wm);
+}
+
+static Bool wm_eventlog_is_record(wm_t *wm) {
+  return wm->eventlog != NULL && wm->eventlog->mode == WM_EVENTLOG_RECORD;
+}
+
+static char *wm_eventlog_string(char **pos, uint32_t length) {
+  char *str = NULL;
+  if (length > 0) {
+    str = malloc(length);
+    memcpy(str, *pos, length);
+    str[length - 1] = '\0';
+    *pos += length;
+  }
+  return str;
+} /* static char *wm_eventlog_string */
+
+/* Apply a recorded fetch result that is next in the log. */
+static void wm_eventlog_apply_fetch(wm_t *wm) {
+  struct wm_eventlog *log = wm->eventlog;
+  wm_fetch_result_t result;
+  log_fetch_t rec;
+  char *pos;
+
+  log->have_next = False;
+  if (log->next.length < sizeof(rec)) {
+    log->divergences++;
+    return;
+  }
+  memcpy(&rec, log->payload, sizeof(rec));
+  pos = log->payload + sizeof(rec);
+  if (sizeof(rec) + rec.name_len + rec.res_name_len + rec.res_class_len
+      + rec.role_len + rec.net_wm_state_len * sizeof(Atom)
+      + rec.icon_len * sizeof(unsigned long) != log->next.length) {
+    log->divergences++;
+    return;
+  }
+
+  memset(&result, 0, sizeof(result));
+  result.window = rec.window;
+  result.what = rec.what;
+  result.name = wm_eventlog_string(&pos, rec.name_len);
+  result.res_name = wm_eventlog_string(&pos, rec.res_name_len);
+  result.res_class = wm_eventlog_string(&pos, rec.res_class_len);
+  result.role = wm_eventlog_string(&pos, rec.role_len);
+  if (rec.net_wm_state_len > 0) {
+    result.net_wm_state_len = rec.net_wm_state_len;
+    result.net_wm_state = malloc(rec.net_wm_state_len * sizeof(Atom));
+    memcpy(result.net_wm_state, pos, rec.net_wm_state_len * sizeof(Atom));
+    pos += rec.net_wm_state_len * sizeof(Atom);
+  }
+  memcpy(&result.hints, &rec.hints, sizeof(XWMHints));
+  result.sync_counter = rec.sync_counter;
+  result.transient_for = rec.transient_for;
+  if (rec.icon_len > 0) {
+    result.icon_len = rec.icon_len;
+    result.icon = malloc(rec.icon_len * sizeof(unsigned long));
+    memcpy(result.icon, pos, rec.icon_len * sizeof(unsigned long));
+  }
+  wm_fetch_apply(wm, &result);
+} /* static void wm_eventlog_apply_fetch */
+
+/* Like wm_eventlog_peek, but first applies any fetch results that were
+ * recorded at this point. */
+static Bool wm_eventlog_peek_applying(wm_t *wm) {
+  while (wm_eventlog_peek(wm)) {
+    if (wm->eventlog->next.kind != LOG_KIND_FETCH)
+      return True;
+    wm_eventlog_apply_fetch(wm);
+  }
+  return False;
+} /* static Bool wm_eventlog_peek_applying */
+
+/* Take the next recorded reply of the given type. If the log has something
+ * else next, the replay has diverged from the recording; the record is left
+ * in place and False is returned. */
+static Bool wm_eventlog_reply(wm_t *wm, int type, void **payload,
+                              size_t *length) {
+  struct wm_eventlog *log = wm->eventlog;
+
+  if (!wm_eventlog_peek_applying(wm) || log->next.kind != LOG_KIND_REPLY
+      || log->next.type != type) {
+    log->divergences++;
+    wm_log(wm, LOG_WARN, "%s: replay diverged, wanted reply %d after %lu events",
+           __func__, type, log->events);
+    return False;
+  }
+
+  log->have_next = False;
+  log->replies++;
+  *payload = log->payload;
+  *length = log->next.length;
+  return True;
+} /* static Bool wm_eventlog_reply */
+
+Bool wm_eventlog_record(wm_t *wm, const char *path) {
+  struct wm_eventlog *log;
+  uint32_t header[3];
+  int i;
+
+  log = calloc(1, sizeof(struct wm_eventlog));
+  log->fp = fopen(path, "wb");
+  if (log->fp == NULL) {
+    wm_log(wm, LOG_ERROR, "%s: failed opening '%s': %s", __func__, path,
+           strerror(errno));
+    free(log);
+    return False;
+  }
+  log->mode = WM_EVENTLOG_RECORD;
+  gettimeofday(&log->last, NULL);
+
+  header[0] = WM_EVENTLOG_MAGIC;
+  header[1] = WM_EVENTLOG_VERSION;
+  header[2] = wm->num_screens;
+  fwrite(header, sizeof(header), 1, log->fp);
+  for (i = 0; i < wm->num_screens; i++) {
+    uint32_t screen[3];
+    screen[0] = RootWindowOfScreen(wm->screens[i]);
+    screen[1] = WidthOfScreen(wm->screens[i]);
+    screen[2] = HeightOfScreen(wm->screens[i]);
+    fwrite(screen, sizeof(screen), 1, log->fp);
+  }
+
+  wm->eventlog = log;
+  wm_log(wm, LOG_INFO, "%s: recording events to '%s'", __func__, path);
+  return True;
+} /* Bool wm_eventlog_record */
+
+/* Create a wm with no display that replays the log at 'path' when wm_main is
+ * called. */
+wm_t *wm_new_replay(const char *path) {
+  struct wm_eventlog *log;
+  uint32_t header[3];
+  wm_t *wm;
+  int i;
+
+  wm = calloc(1, sizeof(wm_t));
+  wm->log_level = LOG_INFO;
+  log = calloc(1, sizeof(struct wm_eventlog));
+  log->mode = WM_EVENTLOG_REPLAY;
+  log->fp = fopen(path, "rb");
+  if (log->fp == NULL) {
+    wm_log(wm, LOG_ERROR, "%s: failed opening '%s': %s", __func__, path,
+           strerror(errno));
+    free(log);
+    free(wm);
+    return NULL;
+  }
+
+  if (fread(header, sizeof(header), 1, log->fp) != 1
+      || header[0] != WM_EVENTLOG_MAGIC || header[1] != WM_EVENTLOG_VERSION
+      || header[2] == 0 || header[2] > WM_EVENTLOG_MAX_SCREENS) {
+    wm_log(wm, LOG_ERROR, "%s: '%s' is not an event log", __func__, path);
+    fclose(log->fp);
+    free(log);
+    free(wm);
+    return NULL;
+  }
+
+  /* Screens only carry what the handlers look at. */
+  wm->num_screens = header[2];
+  wm->screens = calloc(wm->num_screens, sizeof(Screen *));
+  for (i = 0; i < wm->num_screens; i++) {
+    uint32_t screen[3];
+    if (fread(screen, sizeof(screen), 1, log->fp) != 1) {
+      wm_log(wm, LOG_ERROR, "%s: truncated header in '%s'", __func__, path);
+      while (--i >= 0)
+        free(wm->screens[i]);
+      free(wm->screens);
+      fclose(log->fp);
+      free(log);
+      free(wm);
+      return NULL;
+    }
+    wm->screens[i] = calloc(1, sizeof(Screen));
+    wm->screens[i]->root = screen[0];
+    wm->screens[i]->width = screen[1];
+    wm->screens[i]->height = screen[2];
+  }
+
+  wm->dpy = NULL;
+  wm->eventlog = log;
+  wm_init(wm);
+  return wm;
+} /* wm_t *wm_new_replay */
+
+void wm_eventlog_close(wm_t *wm) {
+  if (wm->eventlog == NULL)
+    return;
+  fclose(wm->eventlog->fp);
+  free(wm->eventlog->payload);
+  free(wm->eventlog);
+  wm->eventlog = NULL;
+} /* void wm_eventlog_close */
+
+void wm_eventlog_flush(wm_t *wm) {
+  if (wm_eventlog_is_record(wm))
+    fflush(wm->eventlog->fp);
+} /* void wm_eventlog_flush */
+
+/* Append an event that wm_main is about to dispatch. */
+void wm_eventlog_event(wm_t *wm, XEvent *ev) {
+  if (wm_eventlog_is_record(wm)) {
+    wm->eventlog->events++;
+    wm_eventlog_write(wm, LOG_KIND_EVENT, ev->type, ev,
+                      wm_eventlog_event_size(ev->type));
+  }
+} /* void wm_eventlog_event */
+
+/* Fetch the next event to dispatch during replay. Replies that were never
+ * asked for (because the replay diverged) are skipped. */
+Bool wm_eventlog_next_event(wm_t *wm, XEvent *ev) {
+  struct wm_eventlog *log = wm->eventlog;
+
+  while (wm_eventlog_peek_applying(wm)) {
+    log->have_next = False;
+    if (log->next.kind != LOG_KIND_EVENT) {
+      log->divergences++;
+      continue;
+    }
+
+    memset(ev, 0, sizeof(XEvent));
+    memcpy(ev, log->payload, MIN(log->next.length, sizeof(XEvent)));
+    ev->xany.display = wm->dpy;
+    log->events++;
+    return True;
+  }
+  return False;
+} /* Bool wm_eventlog_next_event */
+
+/* Record a fetch result as the main thread applies it. */
+void wm_eventlog_fetch_result(wm_t *wm, wm_fetch_result_t *result) {
+  log_fetch_t rec;
+  char *payload, *pos;
+  size_t length;
+
+  if (!wm_eventlog_is_record(wm))
+    return;
+
+  memset(&rec, 0, sizeof(rec));
+  rec.window = result->window;
+  rec.what = result->what;
+  rec.name_len = (result->name != NULL) ? strlen(result->name) + 1 : 0;
+  rec.res_name_len = (result->res_name != NULL) ? strlen(result->res_name) + 1 : 0;
+  rec.res_class_len = (result->res_class != NULL) ? strlen(result->res_class) + 1 : 0;
+  rec.role_len = (result->role != NULL) ? strlen(result->role) + 1 : 0;
+  rec.net_wm_state_len = result->net_wm_state_len;
+  rec.icon_len = result->icon_len;
+  rec.sync_counter = result->sync_counter;
+  rec.transient_for = result->transient_for;
+  memcpy(&rec.hints, &result->hints, sizeof(XWMHints));
+
+  length = sizeof(rec) + rec.name_len + rec.res_name_len + rec.res_class_len
+           + rec.role_len + rec.net_wm_state_len * sizeof(Atom)
+           + rec.icon_len * sizeof(unsigned long);
+  payload = malloc(length);
+  memcpy(payload, &rec, sizeof(rec));
+  pos = payload + sizeof(rec);
+  memcpy(pos, result->name, rec.name_len);
+  pos += rec.name_len;
+  memcpy(pos, result->res_name, rec.res_name_len);
+  pos += rec.res_name_len;
+  memcpy(pos, result->res_class, rec.res_class_len);
+  pos += rec.res_class_len;
+  memcpy(pos, result->role, rec.role_len);
+  pos += rec.role_len;
+  memcpy(pos, result->net_wm_state, rec.net_wm_state_len * sizeof(Atom));
+  pos += rec.net_wm_state_len * sizeof(Atom);
+  memcpy(pos, result->icon, rec.icon_len * sizeof(unsigned long));
+
+  wm_eventlog_write(wm, LOG_KIND_FETCH, 0, payload, length);
+  free(payload);
+} /* void wm_eventlog_fetch_result */
+
+/* Replay wm_client_fetch_now: its result is the next record. */
+void wm_eventlog_replay_fetch(wm_t *wm) {
+  struct wm_eventlog *log = wm->eventlog;
+
+  if (!wm_eventlog_is_replay(wm))
+    return;
+  if (!wm_eventlog_peek(wm) || log->next.kind != LOG_KIND_FETCH) {
+    log->divergences++;
+    wm_log(wm, LOG_WARN, "%s: replay diverged, wanted a fetch after %lu events",
+           __func__, log->events);
+    return;
+  }
+  wm_eventlog_apply_fetch(wm);
+} /* void wm_eventlog_replay_fetch */
+
+void wm_eventlog_stats(wm_t *wm, unsigned long *events, unsigned long *replies,
+                       unsigned long *divergences) {
+  struct wm_eventlog *log = wm->eventlog;
+  *events = (log != NULL) ? log->events : 0;
+  *replies = (log != NULL) ? log->replies : 0;
+  *divergences = (log != NULL) ? log->divergences : 0;
+} /* void wm_eventlog_stats */
+
+/*
+ * X requests made by the dispatch layer.
+ */
+
+static int wm_screen_index(wm_t *wm, Screen *screen) {
+  int i;
+  for (i = 0; i < wm->num_screens; i++)
+    if (wm->screens[i] == screen)
+      return i;
+  return -1;
+} /* static int wm_screen_index */
+
+Status wm_x_get_window_attributes_at(wm_t *wm, Window w,
+                                     XWindowAttributes *attr,
+                                     const char *caller) {
+  reply_attributes_t reply;
+  wm_roundtrip_t mark;
+  void *payload;
+  size_t length;
+
+  if (wm->mock != NULL) {
+    reply.status = wm_mock_get_window_attributes(wm, w, attr);
+  } else if (wm_eventlog_is_replay(wm)) {
+    if (!wm_eventlog_reply(wm, REPLY_WINDOW_ATTRIBUTES, &payload, &length)
+        || length != sizeof(reply))
+      return 0;
+    memcpy(&reply, payload, sizeof(reply));
+    memcpy(attr, &reply.attr, sizeof(XWindowAttributes));
+    attr->screen = (reply.screen >= 0) ? wm->screens[reply.screen] : NULL;
+    attr->visual = NULL;
+  } else {
+    wm_error_track(wm, w, "wm_x_get_window_attributes", NULL, NULL);
+    wm_roundtrip_begin(wm, &mark);
+    reply.status = XGetWindowAttributes(wm->dpy, w, attr);
+    wm_roundtrip_end(wm, &mark, caller);
+    if (wm_eventlog_is_record(wm)) {
+      memcpy(&reply.attr, attr, sizeof(XWindowAttributes));
+      reply.screen = reply.status ? wm_screen_index(wm, attr->screen) : -1;
+      wm_eventlog_write(wm, LOG_KIND_REPLY, REPLY_WINDOW_ATTRIBUTES,
+                        &reply, sizeof(reply));
+    }
+  }
+  /* What the server will say once an open transaction (txn.c) commits */
+  if (reply.status)
+    wm_txn_overlay(wm, w, attr);
+  return reply.status;
+} /* Status wm_x_get_window_attributes_at */
+
+Atom wm_x_intern_atom_at(wm_t *wm, const char *name, Bool only_if_exists,
+                         const char *caller) {
+  uint64_t atom;
+  wm_roundtrip_t mark;
+  void *payload;
+  size_t length;
+
+  if (wm->mock != NULL)
+    return wm_mock_intern_atom(wm, name, only_if_exists);
+  if (wm_eventlog_is_replay(wm)) {
+    if (!wm_eventlog_reply(wm, REPLY_INTERN_ATOM, &payload, &length)
+        || length != sizeof(atom))
+      return None;
+    memcpy(&atom, payload, sizeof(atom));
+    return atom;
+  }
+
+  wm_roundtrip_begin(wm, &mark);
+  atom = XInternAtom(wm->dpy, name, only_if_exists);
+  wm_roundtrip_end(wm, &mark, caller);
+  if (wm_eventlog_is_record(wm))
+    wm_eventlog_write(wm, LOG_KIND_REPLY, REPLY_INTERN_ATOM, &atom, sizeof(atom));
+  return atom;
+} /* Atom wm_x_intern_atom_at */
+
+/* As XGetAtomName; the result must be released with XFree. */
+char *wm_x_get_atom_name_at(wm_t *wm, Atom atom, const char *caller) {
+  char *name;
+  wm_roundtrip_t mark;
+  void *payload;
+  size_t length;
+
+  if (wm->mock != NULL)
+    return wm_mock_get_atom_name(wm, atom);
+  if (wm_eventlog_is_replay(wm)) {
+    if (!wm_eventlog_reply(wm, REPLY_ATOM_NAME, &payload, &length)
+        || length == 0)
+      return NULL;
+    name = malloc(length);
+    memcpy(name, payload, length);
+    return name;
+  }
+
+  wm_roundtrip_begin(wm, &mark);
+  name = XGetAtomName(wm->dpy, atom);
+  wm_roundtrip_end(wm, &mark, caller);
+  if (wm_eventlog_is_record(wm)) {
+    wm_eventlog_write(wm, LOG_KIND_REPLY, REPLY_ATOM_NAME, name,
+                      (name != NULL) ? strlen(name) + 1 : 0);
+  }
+  return name;
+} /* char *wm_x_get_atom_name_at */
+
+Bool wm_x_query_pointer_at(wm_t *wm, Window w, Window *root, Window *child,
+                           int *root_x, int *root_y, int *x, int *y,
+                           unsigned int *mask, const char *caller) {
+  reply_query_pointer_t reply;
+  wm_roundtrip_t mark;
+  void *payload;
+  size_t length;
+
+  if (wm->mock != NULL)
+    return wm_mock_query_pointer(wm, w, root, child, root_x, root_y, x, y,
+                                 mask);
+  if (wm_eventlog_is_replay(wm)) {
+    memset(&reply, 0, sizeof(reply));
+    if (wm_eventlog_reply(wm, REPLY_QUERY_POINTER, &payload, &length)
+        && length == sizeof(reply))
+      memcpy(&reply, payload, sizeof(reply));
+    *root = reply.root;
+    *child = reply.child;
+    *root_x = reply.root_x;
+    *root_y = reply.root_y;
+    *x = reply.x;
+    *y = reply.y;
+    *mask = reply.mask;
+    return reply.result;
+  }
+
+  wm_error_track(wm, w, "wm_x_query_pointer", NULL, NULL);
+  wm_roundtrip_begin(wm, &mark);
+  reply.result = XQueryPointer(wm->dpy, w, root, child, root_x, root_y,
+                               x, y, mask);
+  wm_roundtrip_end(wm, &mark, caller);
+  if (wm_eventlog_is_record(wm)) {
+    reply.root = *root;
+    reply.child = *child;
+    reply.root_x = *root_x;
+    reply.root_y = *root_y;
+    reply.x = *x;
+    reply.y = *y;
+    reply.mask = *mask;
+    wm_eventlog_write(wm, LOG_KIND_REPLY, REPLY_QUERY_POINTER,
+                      &reply, sizeof(reply));
+  }
+  return reply.result;
+} /* Bool wm_x_query_pointer_at */
+
+/* As XQueryTree; *children must be released with XFree. */
+Status wm_x_query_tree_at(wm_t *wm, Window w, Window *root, Window *parent,
+                          Window **children, unsigned int *nchildren,
+                          const char *caller) {
+  Status status;
+  wm_roundtrip_t mark;
+  void *payload;
+  size_t length;
+
+  if (wm->mock != NULL)
+    return wm_mock_query_tree(wm, w, root, parent, children, nchildren);
+  if (wm_eventlog_is_replay(wm)) {
+    uint64_t *data;
+    unsigned int i;
+
+    *children = NULL;
+    *nchildren = 0;
+    if (!wm_eventlog_reply(wm, REPLY_QUERY_TREE, &payload, &length)
+        || length < 3 * sizeof(uint64_t))
+      return 0;
+    data = payload;
+    *root = data[0];
+    *parent = data[1];
+    *nchildren = data[2];
+    if (*nchildren > 0) {
+      *children = malloc(*nchildren * sizeof(Window));
+      for (i = 0; i < *nchildren; i++)
+        (*children)[i] = data[3 + i];
+    }
+    return 1;
+  }
+
+  wm_error_track(wm, w, "wm_x_query_tree", NULL, NULL);
+  wm_roundtrip_begin(wm, &mark);
+  status = XQueryTree(wm->dpy, w, root, parent, children, nchildren);
+  wm_roundtrip_end(wm, &mark, caller);
+  if (!status) {
+    *children = NULL;
+    *nchildren = 0;
+  }
+  if (wm_eventlog_is_record(wm)) {
+    if (status) {
+      size_t size = (3 + *nchildren) * sizeof(uint64_t);
+      uint64_t *data = malloc(size);
+      unsigned int i;
+      data[0] = *root;
+      data[1] = *parent;
+      data[2] = *nchildren;
+      for (i = 0; i < *nchildren; i++)
+        data[3 + i] = (*children)[i];
+      wm_eventlog_write(wm, LOG_KIND_REPLY, REPLY_QUERY_TREE, data, size);
+      free(data);
+    } else {
+      wm_eventlog_write(wm, LOG_KIND_REPLY, REPLY_QUERY_TREE, NULL, 0);
+    }
+  }
+  return status;
+} /* Status wm_x_query_tree_at */
+
+/* As XMaskEvent. Events pulled out of the queue this way are recorded as
+ * replies since they are consumed by a handler, not by wm_main. */
+void wm_x_mask_event(wm_t *wm, long event_mask, XEvent *ev) {
+  void *payload;
+  size_t length;
+
+  if (wm->mock != NULL) {
+    wm_mock_mask_event(wm, event_mask, ev);
+    return;
+  }
+  if (wm_eventlog_is_replay(wm)) {
+    memset(ev, 0, sizeof(XEvent));
+    if (wm_eventlog_reply(wm, REPLY_MASK_EVENT, &payload, &length)) {
+      memcpy(ev, payload, MIN(length, sizeof(XEvent)));
+    } else {
+      /* Nothing left to give; end whatever loop is waiting on us. */
+      ev->type = ButtonRelease;
+    }
+    ev->xany.display = wm->dpy;
+    return;
+  }
+
+  XMaskEvent(wm->dpy, event_mask, ev);
+  if (wm_eventlog_is_record(wm)) {
+    wm_eventlog_write(wm, LOG_KIND_REPLY, REPLY_MASK_EVENT, ev,
+                      wm_eventlog_event_size(ev->type));
+  }
+} /* void wm_x_mask_event */
+
+/* One-way requests. These have no reply, so there is nothing to record, and
+ * during replay there is no display to send them to. Requests about a
+ * window are tracked so an error can be matched back to them (errors.c). */
+
+void wm_x_grab_server(wm_t *wm) {
+  if (wm->mock != NULL)
+    wm_mock_request(wm, __func__);
+  if (wm->dpy != NULL)
+    XGrabServer(wm->dpy);
+}
+
+void wm_x_ungrab_server(wm_t *wm) {
+  if (wm->mock != NULL)
+    wm_mock_request(wm, __func__);
+  if (wm->dpy != NULL)
+    XUngrabServer(wm->dpy);
+}
+
+void wm_x_sync_at(wm_t *wm, const char *caller) {
+  wm_roundtrip_t mark;
+
+  if (wm->dpy == NULL)
+    return;
+  wm_roundtrip_begin(wm, &mark);
+  XSync(wm->dpy, False);
+  wm_roundtrip_end(wm, &mark, caller);
+}
+
+void wm_x_select_input(wm_t *wm, Window w, long event_mask) {
+  if (wm->mock != NULL)
+    wm_mock_select_input(wm, w, event_mask);
+  if (wm->dpy == NULL)
+    return;
+  wm_error_track(wm, w, __func__, NULL, NULL);
+  XSelectInput(wm->dpy, w, event_mask);
+}
+
+void wm_x_map_window(wm_t *wm, Window w) {
+  wm_client_map_requested(wm, w, True);
+  if (wm_txn_map(wm, w, True))
+    return;
+  if (wm->mock != NULL)
+    wm_mock_map_window(wm, w);
+  if (wm->dpy == NULL)
+    return;
+  wm_error_track(wm, w, __func__, NULL, NULL);
+  XMapWindow(wm->dpy, w);
+}
+
+void wm_x_unmap_window(wm_t *wm, Window w) {
+  wm_client_map_requested(wm, w, False);
+  if (wm_txn_map(wm, w, False))
+    return;
+  if (wm->mock != NULL)
+    wm_mock_unmap_window(wm, w);
+  if (wm->dpy == NULL)
+    return;
+  wm_error_track(wm, w, __func__, NULL, NULL);
+  XUnmapWindow(wm->dpy, w);
+}
+
+void wm_x_reparent_window(wm_t *wm, Window w, Window parent, int x, int y) {
+  wm_txn_barrier(wm, w);
+  wm_stack_add(wm, w, parent);
+  if (wm->mock != NULL)
+    wm_mock_reparent_window(wm, w, parent, x, y);
+  if (wm->dpy == NULL)
+    return;
+  wm_error_track(wm, w, __func__, NULL, NULL);
+  XReparentWindow(wm->dpy, w, parent, x, y);
+}
+
+void wm_x_move_window(wm_t *wm, Window w, int x, int y) {
+  XWindowChanges changes;
+
+  changes.x = x;
+  changes.y = y;
+  if (wm_txn_configure(wm, w, CWX | CWY, &changes) == 0)
+    return;
+  if (wm->mock != NULL)
+    wm_mock_configure_window(wm, w, CWX | CWY, &changes);
+  if (wm->dpy == NULL)
+    return;
+  wm_error_track(wm, w, __func__, NULL, NULL);
+  XMoveWindow(wm->dpy, w, x, y);
+}
+
+void wm_x_move_resize_window(wm_t *wm, Window w, int x, int y,
+                             unsigned int width, unsigned int height) {
+  XWindowChanges changes;
+
+  changes.x = x;
+  changes.y = y;
+  changes.width = width;
+  changes.height = height;
+  if (wm_txn_configure(wm, w, CWX | CWY | CWWidth | CWHeight, &changes) == 0)
+    return;
+  if (wm->mock != NULL)
+    wm_mock_configure_window(wm, w, CWX | CWY | CWWidth | CWHeight, &changes);
+  if (wm->dpy == NULL)
+    return;
+  wm_error_track(wm, w, __func__, NULL, NULL);
+  XMoveResizeWindow(wm->dpy, w, x, y, width, height);
+}
+
+void wm_x_send_event(wm_t *wm, Window w, long event_mask, XEvent *ev) {
+  if (wm->mock != NULL)
+    wm_mock_request(wm, __func__);
+  if (wm->dpy == NULL)
+    return;
+  wm_error_track(wm, w, __func__, NULL, NULL);
+  XSendEvent(wm->dpy, w, False, event_mask, ev);
+}
+
+void wm_x_configure_window(wm_t *wm, Window w, unsigned int value_mask,
+                           XWindowChanges *changes) {
+  /* Inside a transaction only the stacking part goes now */
+  value_mask = wm_txn_configure(wm, w, value_mask, changes);
+  if (value_mask == 0)
+    return;
+  if (wm->mock != NULL)
+    wm_mock_configure_window(wm, w, value_mask, changes);
+  if (wm->dpy == NULL)
+    return;
+  wm_error_track(wm, w, __func__, NULL, NULL);
+  XConfigureWindow(wm->dpy, w, value_mask, changes);
+}
+
+void wm_x_grab_pointer(wm_t *wm, Window w, unsigned int event_mask) {
+  if (wm->mock != NULL)
+    wm_mock_request(wm, __func__);
+  if (wm->dpy == NULL)
+    return;
+  wm_error_track(wm, w, __func__, NULL, NULL);
+  XGrabPointer(wm->dpy, w, False, event_mask, GrabModeAsync, GrabModeAsync,
+               None, None, CurrentTime);
+}
+
+void wm_x_raise_window(wm_t *wm, Window w) {
+  if (wm->mock != NULL) {
+    XWindowChanges changes;
+    changes.stack_mode = Above;
+    wm_mock_configure_window(wm, w, CWStackMode, &changes);
+  }
+  if (wm->dpy == NULL)
+    return;
+  wm_error_track(wm, w, __func__, NULL, NULL);
+  XRaiseWindow(wm->dpy, w);
+}
+
+/* XRestackWindows sends one ConfigureWindow per window after the first.
+ * Only the first is tracked; errors from the rest still get the default
+ * handling by resource id. */
+void wm_x_restack_windows(wm_t *wm, Window *windows, int nwindows) {
+  if (wm->mock != NULL && nwindows >= 2) {
+    XWindowChanges changes;
+    int i;
+    for (i = 1; i < nwindows; i++) {
+      changes.sibling = windows[i - 1];
+      changes.stack_mode = Below;
+      wm_mock_configure_window(wm, windows[i], CWSibling | CWStackMode,
+                               &changes);
+    }
+  }
+  if (wm->dpy == NULL || nwindows < 2)
+    return;
+  wm_error_track(wm, windows[1], __func__, NULL, NULL);
+  XRestackWindows(wm->dpy, windows, nwindows);
+}
+
+void wm_x_change_property(wm_t *wm, Window w, Atom property, Atom type,
+                          int format, int mode, const unsigned char *data,
+                          int nelements) {
+  if (wm->mock != NULL)
+    wm_mock_change_property(wm, w, property, format, mode, data, nelements);
+  if (wm->dpy == NULL)
+    return;
+  wm_error_track(wm, w, __func__, NULL, NULL);
+  XChangeProperty(wm->dpy, w, property, type, format, mode, data, nelements);
+}
+
+void wm_x_delete_property(wm_t *wm, Window w, Atom property) {
+  if (wm->mock != NULL)
+    wm_mock_delete_property(wm, w, property);
+  if (wm->dpy == NULL)
+    return;
+  wm_error_track(wm, w, __func__, NULL, NULL);
+  XDeleteProperty(wm->dpy, w, property);
+}
+
+void wm_x_ungrab_pointer(wm_t *wm) {
+  if (wm->mock != NULL)
+    wm_mock_request(wm, __func__);
+  if (wm->dpy != NULL)
+    XUngrabPointer(wm->dpy, CurrentTime);
+}
+
+void wm_x_set_input_focus(wm_t *wm, Window w, int revert_to) {
+  if (wm_txn_focus(wm, w, revert_to))
+    return;
+  if (wm->mock != NULL)
+    wm_mock_request(wm, __func__);
+  if (wm->dpy == NULL)
+    return;
+  wm_error_track(wm, w, __func__, NULL, NULL);
+  XSetInputFocus(wm->dpy, w, revert_to, CurrentTime);
+}
+
+void wm_x_flush(wm_t *wm) {
+  if (wm->dpy != NULL)
+    XFlush(wm->dpy);
+}
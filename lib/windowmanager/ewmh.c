@@ -0,0 +1,278 @@
+/*
+ * EWMH root properties: _NET_CLIENT_LIST, _NET_CLIENT_LIST_STACKING and
+ * _NET_ACTIVE_WINDOW.
+ *
+ * Panels and taskbars read these instead of walking the window tree, and
+ * wake up on every PropertyNotify for them, so each write should mean
+ * something changed. The lists are kept here from the client table and the
+ * stacking model (stack.c), and written by wm_ewmh_flush(), which wm_main
+ * calls once per batch of events:
+ *
+ *   - clients managed since the last flush are appended with PropModeAppend;
+ *   - a removal anywhere means one rewrite of the whole list instead;
+ *   - the stacking list is rebuilt only if the stacking model changed, and
+ *     like the others isn't written at all if it comes out the same.
+ *
+ * A client is in the lists from its first MapRequest until it is withdrawn
+ * or destroyed; hiding it (wm_client_unmap) doesn't take it out. Windows
+ * already mapped at startup can't be told apart from our own frames, so
+ * they're only listed if the program adopts them with wm_ewmh_manage().
+ * Replays leave the properties alone, since they have no server to write
+ * them to.
+ */
+
+#include "windowmanager.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <X11/Xatom.h>
+
+typedef struct ewmh_screen {
+  Window root;
+  GQueue clients;     /* Window, oldest first */
+  GArray *appended;   /* Window, managed since the last flush */
+  Bool rewrite;       /* a client went away; appending won't do */
+
+  /* As last written */
+  GArray *published;  /* _NET_CLIENT_LIST */
+  GArray *stacking;   /* _NET_CLIENT_LIST_STACKING, bottom first */
+  Window active;
+  Bool written;       /* False until the first flush */
+} ewmh_screen_t;
+
+struct wm_ewmh {
+  Atom net_client_list;
+  Atom net_client_list_stacking;
+  Atom net_active_window;
+
+  ewmh_screen_t *screens;
+  GHashTable *links; /* Window -> GList link in its screen's 'clients' */
+  Bool dirty; /* a client list changed */
+  Bool stacking_dirty;
+
+  unsigned long writes;
+  unsigned long appends;
+  unsigned long skipped; /* rebuilt but unchanged, so not written */
+};
+
+void wm_ewmh_init(wm_t *wm) {
+  struct wm_ewmh *ewmh;
+  int i;
+
+  ewmh = calloc(1, sizeof(struct wm_ewmh));
+  ewmh->screens = calloc(wm->num_screens, sizeof(ewmh_screen_t));
+  for (i = 0; i < wm->num_screens; i++) {
+    ewmh_screen_t *es = &ewmh->screens[i];
+    es->root = RootWindowOfScreen(wm->screens[i]);
+    g_queue_init(&es->clients);
+    es->appended = g_array_new(False, False, sizeof(Window));
+    es->published = g_array_new(False, False, sizeof(Window));
+    es->stacking = g_array_new(False, False, sizeof(Window));
+    /* Whatever the last window manager left there is stale */
+    es->rewrite = True;
+  }
+  ewmh->links = g_hash_table_new(g_direct_hash, g_direct_equal);
+  ewmh->dirty = True;
+  ewmh->stacking_dirty = True;
+  wm->ewmh = ewmh;
+} /* void wm_ewmh_init */
+
+static ewmh_screen_t *wm_ewmh_screen(wm_t *wm, Screen *screen) {
+  int i;
+
+  for (i = 0; i < wm->num_screens; i++)
+    if (wm->screens[i] == screen)
+      return &wm->ewmh->screens[i];
+  return &wm->ewmh->screens[0];
+} /* static ewmh_screen_t *wm_ewmh_screen */
+
+/* Put 'client' in the lists, if it isn't already. */
+void wm_ewmh_manage(wm_t *wm, client_t *client) {
+  struct wm_ewmh *ewmh = wm->ewmh;
+  ewmh_screen_t *es;
+
+  if (ewmh == NULL || (client->flags & CLIENT_MANAGED))
+    return;
+  client->flags |= CLIENT_MANAGED;
+  es = wm_ewmh_screen(wm, client->screen);
+  g_queue_push_tail(&es->clients, GUINT_TO_POINTER(client->window));
+  g_hash_table_insert(ewmh->links, GUINT_TO_POINTER(client->window),
+                      es->clients.tail);
+  if (!es->rewrite)
+    g_array_append_val(es->appended, client->window);
+  ewmh->dirty = True;
+  ewmh->stacking_dirty = True;
+} /* void wm_ewmh_manage */
+
+/* Take 'client' out of the lists; wm_remove_client calls this. */
+void wm_ewmh_forget(wm_t *wm, client_t *client) {
+  struct wm_ewmh *ewmh = wm->ewmh;
+  ewmh_screen_t *es;
+  GList *link;
+  guint i;
+
+  if (ewmh == NULL || !(client->flags & CLIENT_MANAGED))
+    return;
+  client->flags &= ~CLIENT_MANAGED;
+  es = wm_ewmh_screen(wm, client->screen);
+  link = g_hash_table_lookup(ewmh->links, GUINT_TO_POINTER(client->window));
+  g_hash_table_remove(ewmh->links, GUINT_TO_POINTER(client->window));
+  if (link != NULL)
+    g_queue_delete_link(&es->clients, link);
+
+  /* Gone before it was ever published: just don't append it */
+  for (i = 0; i < es->appended->len; i++) {
+    if (g_array_index(es->appended, Window, i) == client->window) {
+      g_array_remove_index(es->appended, i);
+      break;
+    }
+  }
+  if (i == es->appended->len)
+    es->rewrite = True;
+  ewmh->dirty = True;
+  ewmh->stacking_dirty = True;
+} /* void wm_ewmh_forget */
+
+/* The stacking model changed; stack.c calls this. */
+void wm_ewmh_mark_stacking(wm_t *wm) {
+  if (wm->ewmh != NULL)
+    wm->ewmh->stacking_dirty = True;
+} /* void wm_ewmh_mark_stacking */
+
+/* Managed clients among the children of 'parent', bottom first, looking
+ * inside the windows that aren't (frames, containers). */
+static void wm_ewmh_stacking_walk(wm_t *wm, Window parent, GArray *out) {
+  const GQueue *order = wm_stack_order(wm, parent);
+  GList *link;
+
+  if (order == NULL)
+    return;
+  for (link = order->head; link != NULL; link = link->next) {
+    Window w = GPOINTER_TO_UINT(link->data);
+    client_t *client = wm_get_client(wm, w, False);
+
+    if (client != NULL && (client->flags & CLIENT_MANAGED))
+      g_array_append_val(out, w);
+    else
+      wm_ewmh_stacking_walk(wm, w, out);
+  }
+} /* static void wm_ewmh_stacking_walk */
+
+static Bool wm_ewmh_equal(GArray *a, GArray *b) {
+  return a->len == b->len
+         && memcmp(a->data, b->data, a->len * sizeof(Window)) == 0;
+} /* static Bool wm_ewmh_equal */
+
+static void wm_ewmh_write(wm_t *wm, Window root, Atom property, int mode,
+                          GArray *windows) {
+  wm_x_change_property(wm, root, property, XA_WINDOW, 32, mode,
+                       (unsigned char *)windows->data, windows->len);
+  wm->ewmh->writes++;
+} /* static void wm_ewmh_write */
+
+static void wm_ewmh_flush_clients(wm_t *wm, ewmh_screen_t *es) {
+  struct wm_ewmh *ewmh = wm->ewmh;
+  GArray *current;
+  GList *link;
+
+  if (!es->rewrite) {
+    if (es->appended->len == 0)
+      return;
+    wm_ewmh_write(wm, es->root, ewmh->net_client_list, PropModeAppend,
+                  es->appended);
+    g_array_append_vals(es->published, es->appended->data,
+                        es->appended->len);
+    g_array_set_size(es->appended, 0);
+    ewmh->appends++;
+    return;
+  }
+
+  current = g_array_sized_new(False, False, sizeof(Window),
+                              es->clients.length);
+  for (link = es->clients.head; link != NULL; link = link->next) {
+    Window w = GPOINTER_TO_UINT(link->data);
+    g_array_append_val(current, w);
+  }
+  /* The first write always happens, to replace what's left from before */
+  if (es->written && wm_ewmh_equal(current, es->published)) {
+    ewmh->skipped++;
+    g_array_free(current, True);
+  } else {
+    wm_ewmh_write(wm, es->root, ewmh->net_client_list, PropModeReplace,
+                  current);
+    g_array_free(es->published, True);
+    es->published = current;
+  }
+  g_array_set_size(es->appended, 0);
+  es->rewrite = False;
+} /* static void wm_ewmh_flush_clients */
+
+static void wm_ewmh_flush_stacking(wm_t *wm, ewmh_screen_t *es) {
+  struct wm_ewmh *ewmh = wm->ewmh;
+  GArray *current;
+
+  current = g_array_sized_new(False, False, sizeof(Window),
+                              es->clients.length);
+  wm_ewmh_stacking_walk(wm, es->root, current);
+  if (es->written && wm_ewmh_equal(current, es->stacking)) {
+    ewmh->skipped++;
+    g_array_free(current, True);
+    return;
+  }
+  wm_ewmh_write(wm, es->root, ewmh->net_client_list_stacking,
+                PropModeReplace, current);
+  g_array_free(es->stacking, True);
+  es->stacking = current;
+} /* static void wm_ewmh_flush_stacking */
+
+static void wm_ewmh_flush_active(wm_t *wm, ewmh_screen_t *es) {
+  client_t *client = wm_get_client(wm, wm->focus, False);
+  Window active = None;
+
+  /* Focus on a frame or a root isn't an active client */
+  if (client != NULL && (client->flags & CLIENT_MANAGED)
+      && wm_ewmh_screen(wm, client->screen) == es)
+    active = client->window;
+  if (es->written && active == es->active)
+    return;
+  wm_x_change_property(wm, es->root, wm->ewmh->net_active_window, XA_WINDOW,
+                       32, PropModeReplace, (unsigned char *)&active, 1);
+  wm->ewmh->writes++;
+  es->active = active;
+} /* static void wm_ewmh_flush_active */
+
+/* Write whatever changed since the last call. */
+void wm_ewmh_flush(wm_t *wm) {
+  struct wm_ewmh *ewmh = wm->ewmh;
+  int i;
+
+  if (ewmh == NULL || wm_eventlog_replaying(wm))
+    return;
+  if (ewmh->net_client_list == None) {
+    ewmh->net_client_list = wm_x_intern_atom(wm, "_NET_CLIENT_LIST", False);
+    ewmh->net_client_list_stacking =
+      wm_x_intern_atom(wm, "_NET_CLIENT_LIST_STACKING", False);
+    ewmh->net_active_window = wm_x_intern_atom(wm, "_NET_ACTIVE_WINDOW",
+                                               False);
+  }
+
+  for (i = 0; i < wm->num_screens; i++) {
+    ewmh_screen_t *es = &ewmh->screens[i];
+
+    if (ewmh->dirty)
+      wm_ewmh_flush_clients(wm, es);
+    if (ewmh->stacking_dirty)
+      wm_ewmh_flush_stacking(wm, es);
+    wm_ewmh_flush_active(wm, es);
+    es->written = True;
+  }
+  ewmh->dirty = False;
+  ewmh->stacking_dirty = False;
+} /* void wm_ewmh_flush */
+
+void wm_ewmh_stats(wm_t *wm, unsigned long *writes, unsigned long *appends,
+                   unsigned long *skipped) {
+  *writes = wm->ewmh->writes;
+  *appends = wm->ewmh->appends;
+  *skipped = wm->ewmh->skipped;
+} /* void wm_ewmh_stats */
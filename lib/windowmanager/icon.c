@@ -0,0 +1,544 @@
+/*
+ * Application icons, from _NET_WM_ICON.
+ *
+ * The property is a list of ARGB images (width, height, then width * height
+ * pixels, one per long), often several of them up to 256x256. Nothing asks
+ * for it until someone calls wm_icon_get() for a client; from then on it's
+ * refetched when the client changes it, and WM_EVENT_WINDOW_ICON says when a
+ * new one has arrived.
+ *
+ * The expensive part happens on the fetching side (the worker thread, if
+ * there is one): wm_icon_prepare() picks the image that fits
+ * WM_ICON_MAX_SIZE best, premultiplies its alpha and scales it down, so what
+ * reaches the main thread is at most WM_ICON_MAX_SIZE square. There it is
+ * hashed and interned, so the windows of one application share one copy.
+ * Smaller sizes are scaled from that copy on first use and kept with it.
+ *
+ * Premultiplying and the box filter have SSE2 and AVX2 versions, picked at
+ * run time, with plain C for everything else. WM_ICON_SIMD=scalar, sse2 or
+ * avx2 in the environment forces one, for comparing them.
+ */
+
+#include "windowmanager.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <X11/Xutil.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ICON_X86 1
+#include <immintrin.h>
+#endif
+
+/* Images larger than this on a side are ignored as bogus */
+#define ICON_MAX_SOURCE 4096
+
+enum {
+  ICON_SIMD_SCALAR = 0,
+  ICON_SIMD_SSE2 = 1,
+  ICON_SIMD_AVX2 = 2
+};
+
+struct wm_icons {
+  GHashTable *cache; /* &icon->hash -> wm_icon_t, only interned masters */
+
+  unsigned long hits; /* interned an icon we already had */
+  unsigned long misses;
+  unsigned long scaled; /* sizes made from a master */
+};
+
+/*
+ * Kernels. Pixels are 32-bit ARGB in native order, so bytes B, G, R, A on
+ * the machines the vector versions run on.
+ */
+
+/* Exact x / 255, rounded, for x <= 255 * 255 */
+static inline guint32 icon_div255(guint32 x) {
+  x += 128;
+  return (x + (x >> 8)) >> 8;
+} /* static inline guint32 icon_div255 */
+
+static void icon_premultiply_scalar(guint32 *pixels, size_t n) {
+  size_t i;
+
+  for (i = 0; i < n; i++) {
+    guint32 p = pixels[i];
+    guint32 a = p >> 24;
+
+    if (a == 255)
+      continue;
+    pixels[i] = (a << 24) | (icon_div255(((p >> 16) & 0xff) * a) << 16)
+                | (icon_div255(((p >> 8) & 0xff) * a) << 8)
+                | icon_div255((p & 0xff) * a);
+  }
+} /* static void icon_premultiply_scalar */
+
+/* Channel sums of 'n' pixels, B G R A */
+static void icon_sum_scalar(const guint32 *p, size_t n, guint32 sum[4]) {
+  size_t i;
+
+  for (i = 0; i < n; i++) {
+    sum[0] += p[i] & 0xff;
+    sum[1] += (p[i] >> 8) & 0xff;
+    sum[2] += (p[i] >> 16) & 0xff;
+    sum[3] += p[i] >> 24;
+  }
+} /* static void icon_sum_scalar */
+
+#ifdef ICON_X86
+/* Premultiplies two pixels widened to 16 bits per channel. The alpha lane
+ * is multiplied by 255, which leaves it as it was. */
+__attribute__((target("sse2"), always_inline))
+static inline __m128i icon_premultiply2_sse2(__m128i v) {
+  const __m128i keep_rgb = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+  const __m128i alpha_255 = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+  __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0xff), 0xff);
+  __m128i t = _mm_mullo_epi16(v, _mm_or_si128(_mm_and_si128(a, keep_rgb),
+                                              alpha_255));
+
+  t = _mm_add_epi16(t, _mm_set1_epi16(128));
+  return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+} /* static inline __m128i icon_premultiply2_sse2 */
+
+__attribute__((target("sse2"), always_inline))
+static inline void icon_premultiply4_sse2(guint32 *pixels) {
+  const __m128i zero = _mm_setzero_si128();
+  __m128i v = _mm_loadu_si128((const __m128i *)pixels);
+  __m128i lo = icon_premultiply2_sse2(_mm_unpacklo_epi8(v, zero));
+  __m128i hi = icon_premultiply2_sse2(_mm_unpackhi_epi8(v, zero));
+
+  _mm_storeu_si128((__m128i *)pixels, _mm_packus_epi16(lo, hi));
+} /* static inline void icon_premultiply4_sse2 */
+
+__attribute__((target("sse2")))
+static void icon_premultiply_sse2(guint32 *pixels, size_t n) {
+  size_t i;
+
+  for (i = 0; i + 4 <= n; i += 4)
+    icon_premultiply4_sse2(pixels + i);
+  icon_premultiply_scalar(pixels + i, n - i);
+} /* static void icon_premultiply_sse2 */
+
+/* icon_premultiply2_sse2, for two pixels in each 128-bit lane */
+__attribute__((target("avx2")))
+static inline __m256i icon_premultiply4_avx2(__m256i v) {
+  const __m256i keep_rgb = _mm256_set_epi16(0, -1, -1, -1, 0, -1, -1, -1,
+                                            0, -1, -1, -1, 0, -1, -1, -1);
+  const __m256i alpha_255 = _mm256_set_epi16(255, 0, 0, 0, 255, 0, 0, 0,
+                                             255, 0, 0, 0, 255, 0, 0, 0);
+  __m256i a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(v, 0xff), 0xff);
+  __m256i t = _mm256_mullo_epi16(v, _mm256_or_si256(_mm256_and_si256(a,
+                                                                     keep_rgb),
+                                                    alpha_255));
+
+  t = _mm256_add_epi16(t, _mm256_set1_epi16(128));
+  return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+} /* static inline __m256i icon_premultiply4_avx2 */
+
+__attribute__((target("avx2")))
+static void icon_premultiply_avx2(guint32 *pixels, size_t n) {
+  const __m256i zero = _mm256_setzero_si256();
+  size_t i;
+
+  /* Unpacking and packing both work within 128-bit lanes, so the pixels
+   * come back out in the order they went in. */
+  for (i = 0; i + 8 <= n; i += 8) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(pixels + i));
+    __m256i lo = icon_premultiply4_avx2(_mm256_unpacklo_epi8(v, zero));
+    __m256i hi = icon_premultiply4_avx2(_mm256_unpackhi_epi8(v, zero));
+    _mm256_storeu_si256((__m256i *)(pixels + i), _mm256_packus_epi16(lo, hi));
+  }
+  /* GCC doesn't add this itself for target("avx2") functions, and leaving
+   * the upper halves dirty makes every SSE instruction after this one pay
+   * for a state transition on some CPUs. */
+  _mm256_zeroupper();
+  if (i + 4 <= n) {
+    icon_premultiply4_sse2(pixels + i);
+    i += 4;
+  }
+  icon_premultiply_scalar(pixels + i, n - i);
+} /* static void icon_premultiply_avx2 */
+
+/* Adds the channels of the pixels in 'v' to 'acc', as four 32-bit sums */
+__attribute__((target("sse2"), always_inline))
+static inline __m128i icon_sum4_sse2(__m128i acc, __m128i v) {
+  const __m128i zero = _mm_setzero_si128();
+  /* pixels 0+2 and 1+3; at most 510, so 16 bits do */
+  __m128i s = _mm_add_epi16(_mm_unpacklo_epi8(v, zero),
+                            _mm_unpackhi_epi8(v, zero));
+
+  acc = _mm_add_epi32(acc, _mm_unpacklo_epi16(s, zero));
+  return _mm_add_epi32(acc, _mm_unpackhi_epi16(s, zero));
+} /* static inline __m128i icon_sum4_sse2 */
+
+__attribute__((target("sse2")))
+static void icon_sum_sse2(const guint32 *p, size_t n, guint32 sum[4]) {
+  __m128i acc = _mm_loadu_si128((const __m128i *)sum);
+  size_t i;
+
+  for (i = 0; i + 4 <= n; i += 4)
+    acc = icon_sum4_sse2(acc, _mm_loadu_si128((const __m128i *)(p + i)));
+  _mm_storeu_si128((__m128i *)sum, acc);
+  icon_sum_scalar(p + i, n - i, sum);
+} /* static void icon_sum_sse2 */
+
+__attribute__((target("avx2")))
+static void icon_sum_avx2(const guint32 *p, size_t n, guint32 sum[4]) {
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i acc = _mm256_setzero_si256();
+  __m128i total;
+  size_t i;
+
+  for (i = 0; i + 8 <= n; i += 8) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+    __m256i s = _mm256_add_epi16(_mm256_unpacklo_epi8(v, zero),
+                                 _mm256_unpackhi_epi8(v, zero));
+    acc = _mm256_add_epi32(acc, _mm256_unpacklo_epi16(s, zero));
+    acc = _mm256_add_epi32(acc, _mm256_unpackhi_epi16(s, zero));
+  }
+  total = _mm_add_epi32(_mm256_castsi256_si128(acc),
+                        _mm256_extracti128_si256(acc, 1));
+  _mm256_zeroupper(); /* see icon_premultiply_avx2 */
+  total = _mm_add_epi32(total, _mm_loadu_si128((const __m128i *)sum));
+  for (; i + 4 <= n; i += 4)
+    total = icon_sum4_sse2(total, _mm_loadu_si128((const __m128i *)(p + i)));
+  _mm_storeu_si128((__m128i *)sum, total);
+  icon_sum_scalar(p + i, n - i, sum);
+} /* static void icon_sum_avx2 */
+#endif /* ICON_X86 */
+
+static int icon_simd_detect(void) {
+  const char *force = getenv("WM_ICON_SIMD");
+  int best = ICON_SIMD_SCALAR;
+
+#ifdef ICON_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse2"))
+    best = ICON_SIMD_SSE2;
+  if (__builtin_cpu_supports("avx2"))
+    best = ICON_SIMD_AVX2;
+#endif
+  if (force == NULL)
+    return best;
+  if (strcmp(force, "scalar") == 0)
+    return ICON_SIMD_SCALAR;
+  if (strcmp(force, "sse2") == 0 && best >= ICON_SIMD_SSE2)
+    return ICON_SIMD_SSE2;
+  return best;
+} /* static int icon_simd_detect */
+
+/* Called from both threads; they'd both come up with the same answer. */
+static int icon_simd(void) {
+  static int level = -1;
+  int l = __atomic_load_n(&level, __ATOMIC_RELAXED);
+
+  if (l < 0) {
+    l = icon_simd_detect();
+    __atomic_store_n(&level, l, __ATOMIC_RELAXED);
+  }
+  return l;
+} /* static int icon_simd */
+
+static void icon_premultiply(guint32 *pixels, size_t n) {
+  switch (icon_simd()) {
+#ifdef ICON_X86
+    case ICON_SIMD_AVX2: icon_premultiply_avx2(pixels, n); return;
+    case ICON_SIMD_SSE2: icon_premultiply_sse2(pixels, n); return;
+#endif
+    default: icon_premultiply_scalar(pixels, n);
+  }
+} /* static void icon_premultiply */
+
+/* Scale premultiplied 'src' down to 'dst', each destination pixel the mean
+ * of the source pixels it covers. */
+static void icon_downscale(const guint32 *src, unsigned int src_width,
+                           unsigned int src_height, guint32 *dst,
+                           unsigned int dst_width, unsigned int dst_height) {
+  void (*sum_row)(const guint32 *, size_t, guint32 *) = icon_sum_scalar;
+  unsigned int x, y, row;
+
+#ifdef ICON_X86
+  if (icon_simd() == ICON_SIMD_AVX2)
+    sum_row = icon_sum_avx2;
+  else if (icon_simd() == ICON_SIMD_SSE2)
+    sum_row = icon_sum_sse2;
+#endif
+
+  for (y = 0; y < dst_height; y++) {
+    unsigned int y0 = (unsigned long)y * src_height / dst_height;
+    unsigned int y1 = ((unsigned long)(y + 1) * src_height + dst_height - 1)
+                      / dst_height;
+
+    for (x = 0; x < dst_width; x++) {
+      unsigned int x0 = (unsigned long)x * src_width / dst_width;
+      unsigned int x1 = ((unsigned long)(x + 1) * src_width + dst_width - 1)
+                        / dst_width;
+      guint32 count = (x1 - x0) * (y1 - y0);
+      guint32 sum[4] = { 0, 0, 0, 0 };
+
+      for (row = y0; row < y1; row++)
+        sum_row(src + (size_t)row * src_width + x0, x1 - x0, sum);
+      dst[(size_t)y * dst_width + x] =
+        ((sum[3] + count / 2) / count) << 24
+        | ((sum[2] + count / 2) / count) << 16
+        | ((sum[1] + count / 2) / count) << 8
+        | ((sum[0] + count / 2) / count);
+    }
+  }
+} /* static void icon_downscale */
+
+/* The size 'width' x 'height' becomes when fit into 'size' square */
+static void icon_fit(unsigned int width, unsigned int height,
+                     unsigned int size, unsigned int *fit_width,
+                     unsigned int *fit_height) {
+  *fit_width = width;
+  *fit_height = height;
+  if (width <= size && height <= size)
+    return;
+  if (width >= height) {
+    *fit_width = size;
+    *fit_height = MAX(1, (unsigned long)height * size / width);
+  } else {
+    *fit_height = size;
+    *fit_width = MAX(1, (unsigned long)width * size / height);
+  }
+} /* static void icon_fit */
+
+/*
+ * The fetching side
+ */
+
+/* Turn raw _NET_WM_ICON 'data' into a single premultiplied image at most
+ * WM_ICON_MAX_SIZE on a side, in the same layout (width, height, pixels).
+ * Returns False if there's no usable image. Touches nothing shared, so the
+ * worker can call it. */
+Bool wm_icon_prepare(const unsigned long *data, unsigned long len,
+                     unsigned long **out, unsigned long *out_len) {
+  const unsigned long *best = NULL;
+  unsigned long best_width = 0, best_height = 0;
+  unsigned long pos = 0;
+  Bool big, best_big = False;
+  unsigned int width, height;
+  guint32 *pixels, *scaled;
+  size_t i, n;
+
+  /* The smallest that's at least WM_ICON_MAX_SIZE, else the largest */
+  while (pos + 2 <= len) {
+    unsigned long w = data[pos], h = data[pos + 1];
+
+    if (w == 0 || h == 0 || w > ICON_MAX_SOURCE || h > ICON_MAX_SOURCE
+        || w * h > len - pos - 2)
+      break;
+    big = MAX(w, h) >= WM_ICON_MAX_SIZE;
+    if (best == NULL || (big && !best_big)
+        || (big && w * h < best_width * best_height)
+        || (!big && !best_big && w * h > best_width * best_height)) {
+      best = data + pos + 2;
+      best_width = w;
+      best_height = h;
+      best_big = big;
+    }
+    pos += 2 + w * h;
+  }
+  if (best == NULL)
+    return False;
+
+  n = best_width * best_height;
+  pixels = malloc(n * sizeof(guint32));
+  for (i = 0; i < n; i++)
+    pixels[i] = (guint32)best[i];
+  icon_premultiply(pixels, n);
+
+  icon_fit(best_width, best_height, WM_ICON_MAX_SIZE, &width, &height);
+  if (width != best_width || height != best_height) {
+    scaled = malloc((size_t)width * height * sizeof(guint32));
+    icon_downscale(pixels, best_width, best_height, scaled, width, height);
+    free(pixels);
+    pixels = scaled;
+    n = (size_t)width * height;
+  }
+
+  *out_len = 2 + n;
+  *out = malloc(*out_len * sizeof(unsigned long));
+  (*out)[0] = width;
+  (*out)[1] = height;
+  for (i = 0; i < n; i++)
+    (*out)[2 + i] = pixels[i];
+  free(pixels);
+  return True;
+} /* Bool wm_icon_prepare */
+
+/*
+ * The main thread's side
+ */
+
+void wm_icon_init(wm_t *wm) {
+  wm->icons = calloc(1, sizeof(struct wm_icons));
+  wm->icons->cache = g_hash_table_new(g_int64_hash, g_int64_equal);
+} /* void wm_icon_init */
+
+/* FNV-1a over the size and pixels */
+static guint64 icon_hash(unsigned int width, unsigned int height,
+                         const guint32 *pixels) {
+  guint64 hash = 0xcbf29ce484222325ULL;
+  const unsigned char *bytes = (const unsigned char *)pixels;
+  size_t i, n = (size_t)width * height * sizeof(guint32);
+
+  hash = (hash ^ width) * 0x100000001b3ULL;
+  hash = (hash ^ height) * 0x100000001b3ULL;
+  for (i = 0; i < n; i++)
+    hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+  return hash;
+} /* static guint64 icon_hash */
+
+static wm_icon_t *icon_new(wm_t *wm, unsigned int width, unsigned int height) {
+  wm_icon_t *icon = calloc(1, sizeof(wm_icon_t));
+
+  wm_res_created(wm, WM_RES_ICON, icon);
+
+  icon->width = width;
+  icon->height = height;
+  icon->pixels = malloc((size_t)width * height * sizeof(guint32));
+  return icon;
+} /* static wm_icon_t *icon_new */
+
+static void icon_free(wm_t *wm, wm_icon_t *icon) {
+  GSList *l;
+
+  for (l = icon->scaled; l != NULL; l = l->next)
+    icon_free(wm, l->data);
+  wm_res_freed(wm, WM_RES_ICON, icon);
+  g_slist_free(icon->scaled);
+  free(icon->pixels);
+  free(icon);
+} /* static void icon_free */
+
+/* A shared icon for what wm_icon_prepare made, with a reference for the
+ * caller. NULL if 'data' isn't an image. */
+wm_icon_t *wm_icon_intern(wm_t *wm, const unsigned long *data,
+                          unsigned long len) {
+  struct wm_icons *icons = wm->icons;
+  wm_icon_t *icon, *cached;
+  size_t i, n;
+
+  if (icons == NULL || data == NULL || len < 2 || data[0] == 0 || data[1] == 0
+      || data[0] > WM_ICON_MAX_SIZE || data[1] > WM_ICON_MAX_SIZE
+      || data[0] * data[1] > len - 2)
+    return NULL;
+
+  icon = icon_new(wm, data[0], data[1]);
+  n = (size_t)icon->width * icon->height;
+  for (i = 0; i < n; i++)
+    icon->pixels[i] = (guint32)data[2 + i];
+  icon->hash = icon_hash(icon->width, icon->height, icon->pixels);
+
+  cached = g_hash_table_lookup(icons->cache, &icon->hash);
+  if (cached != NULL && cached->width == icon->width
+      && cached->height == icon->height
+      && memcmp(cached->pixels, icon->pixels, n * sizeof(guint32)) == 0) {
+    icons->hits++;
+    icon_free(wm, icon);
+    cached->refs++;
+    return cached;
+  }
+
+  /* On a collision the newcomer just goes unshared */
+  icons->misses++;
+  icon->refs = 1;
+  if (cached == NULL) {
+    icon->interned = True;
+    g_hash_table_insert(icons->cache, &icon->hash, icon);
+  }
+  return icon;
+} /* wm_icon_t *wm_icon_intern */
+
+void wm_icon_unref(wm_t *wm, wm_icon_t *icon) {
+  if (icon == NULL || --icon->refs > 0)
+    return;
+  if (icon->interned)
+    g_hash_table_remove(wm->icons->cache, &icon->hash);
+  icon_free(wm, icon);
+} /* void wm_icon_unref */
+
+/* The icon of 'client', fit into 'size' square (0 for as large as there
+ * is). The first call for a client asks for its icon and returns NULL;
+ * WM_EVENT_WINDOW_ICON follows when it arrives. The result belongs to the
+ * client and stays valid until the next WM_EVENT_WINDOW_ICON for it, or
+ * until it is removed. */
+const wm_icon_t *wm_icon_get(wm_t *wm, client_t *client, unsigned int size) {
+  wm_icon_t *master = client->icon;
+  wm_icon_t *icon;
+  unsigned int width, height;
+  GSList *l;
+
+  if (!client->icon_wanted) {
+    client->icon_wanted = True;
+    wm_client_fetch(wm, client, WM_FETCH_ICON);
+  }
+  if (master == NULL)
+    return NULL;
+
+  if (size == 0)
+    return master;
+  icon_fit(master->width, master->height, size, &width, &height);
+  if (width == master->width && height == master->height)
+    return master;
+  for (l = master->scaled; l != NULL; l = l->next) {
+    icon = l->data;
+    if (icon->width == width && icon->height == height)
+      return icon;
+  }
+
+  wm->icons->scaled++;
+  icon = icon_new(wm, width, height);
+  icon_downscale(master->pixels, master->width, master->height, icon->pixels,
+                 width, height);
+  icon->hash = icon_hash(width, height, icon->pixels);
+  master->scaled = g_slist_prepend(master->scaled, icon);
+  return icon;
+} /* const wm_icon_t *wm_icon_get */
+
+/* Draw 'icon' onto 'dest' at x,y, blended over a background of 'bg'. Only
+ * for TrueColor visuals; elsewhere, nothing is drawn. */
+void wm_icon_draw(wm_t *wm, const wm_icon_t *icon, Drawable dest, GC gc,
+                  Screen *screen, int x, int y, const XColor *bg) {
+  Visual *visual = DefaultVisualOfScreen(screen);
+  XImage *image;
+  unsigned int i, j;
+
+  if (wm->dpy == NULL || icon == NULL || visual->class != TrueColor)
+    return;
+
+  image = XCreateImage(wm->dpy, visual, DefaultDepthOfScreen(screen), ZPixmap,
+                       0, NULL, icon->width, icon->height, 32, 0);
+  if (image == NULL)
+    return;
+  image->data = malloc((size_t)image->bytes_per_line * icon->height);
+
+  for (j = 0; j < icon->height; j++) {
+    for (i = 0; i < icon->width; i++) {
+      guint32 p = icon->pixels[(size_t)j * icon->width + i];
+      guint32 keep = 255 - (p >> 24);
+      /* Premultiplied, so over is src + bg * (1 - alpha) */
+      unsigned long r = ((p >> 16) & 0xff) + icon_div255((bg->red >> 8) * keep);
+      unsigned long g = ((p >> 8) & 0xff) + icon_div255((bg->green >> 8) * keep);
+      unsigned long b = (p & 0xff) + icon_div255((bg->blue >> 8) * keep);
+
+      XPutPixel(image, i, j,
+                ((r * visual->red_mask / 255) & visual->red_mask)
+                | ((g * visual->green_mask / 255) & visual->green_mask)
+                | ((b * visual->blue_mask / 255) & visual->blue_mask));
+    }
+  }
+  XPutImage(wm->dpy, dest, gc, image, 0, 0, x, y, icon->width, icon->height);
+  XDestroyImage(image);
+} /* void wm_icon_draw */
+
+void wm_icon_stats(wm_t *wm, unsigned long *hits, unsigned long *misses,
+                   unsigned long *scaled, unsigned int *shared) {
+  *hits = wm->icons->hits;
+  *misses = wm->icons->misses;
+  *scaled = wm->icons->scaled;
+  *shared = g_hash_table_size(wm->icons->cache);
+} /* void wm_icon_stats */
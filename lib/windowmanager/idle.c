@@ -0,0 +1,164 @@
+/*
+ * Deferred work, run when there's no input to handle.
+ *
+ * Handlers post work that doesn't need to happen before the next key press
+ * (repainting titles of unfocused frames, refreshing stats, filling caches)
+ * with wm_idle_add. wm_main runs it only once the X queue is empty, highest
+ * priority first, and for at most the budget set with wm_idle_set_budget
+ * before looking for input again. Input that arrives in the middle of a
+ * drain stops it early.
+ *
+ * Posting the same function and data again while it is still queued does
+ * nothing, except raise its priority if the new one is higher. So a title
+ * that changes fifty times while the user is typing is repainted once.
+ */
+
+#include "windowmanager.h"
+
+#include <stdlib.h>
+
+#define WM_IDLE_DEFAULT_BUDGET_US 2000
+
+typedef struct idle_item {
+  wm_idle_func func;
+  gpointer data;
+  unsigned int priority;
+  GList *link; /* in idle->queues[priority] */
+} idle_item_t;
+
+struct wm_idle {
+  GQueue queues[WM_IDLE_PRIORITIES]; /* idle_item_t, oldest first */
+  GHashTable *items; /* idle_item_t -> itself, by func and data */
+  gint64 budget; /* usec per drain */
+  unsigned long ran;
+  unsigned long coalesced;
+};
+
+static guint idle_item_hash(gconstpointer key) {
+  const idle_item_t *item = key;
+  return g_direct_hash(item->data) ^ g_direct_hash((gpointer)item->func);
+} /* static guint idle_item_hash */
+
+static gboolean idle_item_equal(gconstpointer a, gconstpointer b) {
+  const idle_item_t *ia = a, *ib = b;
+  return ia->func == ib->func && ia->data == ib->data;
+} /* static gboolean idle_item_equal */
+
+void wm_idle_init(wm_t *wm) {
+  int i;
+
+  wm->idle = calloc(1, sizeof(struct wm_idle));
+  for (i = 0; i < WM_IDLE_PRIORITIES; i++)
+    g_queue_init(&wm->idle->queues[i]);
+  wm->idle->items = g_hash_table_new(idle_item_hash, idle_item_equal);
+  wm->idle->budget = WM_IDLE_DEFAULT_BUDGET_US;
+} /* void wm_idle_init */
+
+/* How long one drain may run for, in microseconds; 0 means until empty. */
+void wm_idle_set_budget(wm_t *wm, gint64 usec) {
+  wm->idle->budget = usec;
+} /* void wm_idle_set_budget */
+
+/* Run func(wm, data) once the event queue is empty. */
+void wm_idle_add(wm_t *wm, unsigned int priority, wm_idle_func func,
+                 gpointer data) {
+  struct wm_idle *idle = wm->idle;
+  idle_item_t key, *item;
+
+  if (priority >= WM_IDLE_PRIORITIES)
+    priority = WM_IDLE_LOW;
+
+  key.func = func;
+  key.data = data;
+  item = g_hash_table_lookup(idle->items, &key);
+  if (item != NULL) {
+    idle->coalesced++;
+    if (priority < item->priority) {
+      g_queue_unlink(&idle->queues[item->priority], item->link);
+      g_queue_push_tail_link(&idle->queues[priority], item->link);
+      item->priority = priority;
+    }
+    return;
+  }
+
+  item = malloc(sizeof(idle_item_t));
+  wm_res_created(wm, WM_RES_HEAP, item);
+  item->func = func;
+  item->data = data;
+  item->priority = priority;
+  g_queue_push_tail(&idle->queues[priority], item);
+  item->link = idle->queues[priority].tail;
+  g_hash_table_insert(idle->items, item, item);
+} /* void wm_idle_add */
+
+/* Drop queued work, e.g. because 'data' is about to be freed. */
+void wm_idle_remove(wm_t *wm, wm_idle_func func, gpointer data) {
+  struct wm_idle *idle = wm->idle;
+  idle_item_t key, *item;
+
+  key.func = func;
+  key.data = data;
+  item = g_hash_table_lookup(idle->items, &key);
+  if (item == NULL)
+    return;
+  g_hash_table_remove(idle->items, item);
+  g_queue_delete_link(&idle->queues[item->priority], item->link);
+  wm_res_freed(wm, WM_RES_HEAP, item);
+  free(item);
+} /* void wm_idle_remove */
+
+Bool wm_idle_pending(wm_t *wm) {
+  return wm->idle != NULL && g_hash_table_size(wm->idle->items) > 0;
+} /* Bool wm_idle_pending */
+
+static idle_item_t *wm_idle_pop(wm_t *wm) {
+  struct wm_idle *idle = wm->idle;
+  idle_item_t *item;
+  int i;
+
+  for (i = 0; i < WM_IDLE_PRIORITIES; i++) {
+    item = g_queue_pop_head(&idle->queues[i]);
+    if (item != NULL) {
+      g_hash_table_remove(idle->items, item);
+      wm_res_freed(wm, WM_RES_HEAP, item);
+      return item;
+    }
+  }
+  return NULL;
+} /* static idle_item_t *wm_idle_pop */
+
+/* Run queued work until it's done, the budget is spent or input arrives.
+ * At least one item runs, so work always makes progress. Work may post
+ * more work; it runs in a later drain. Returns True if work is left. */
+Bool wm_idle_run(wm_t *wm) {
+  struct wm_idle *idle = wm->idle;
+  gint64 start, now;
+  unsigned int todo;
+  idle_item_t *item;
+
+  if (!wm_idle_pending(wm))
+    return False;
+
+  start = g_get_monotonic_time();
+  todo = g_hash_table_size(idle->items);
+  while (todo-- > 0 && (item = wm_idle_pop(wm)) != NULL) {
+    item->func(wm, item->data);
+    free(item);
+    idle->ran++;
+
+    now = g_get_monotonic_time();
+    if (idle->budget > 0 && now - start >= idle->budget)
+      break;
+    /* Input comes first; a non-blocking read tells us if there is any */
+    if (wm->dpy != NULL && XEventsQueued(wm->dpy, QueuedAfterReading) > 0)
+      break;
+  }
+  return wm_idle_pending(wm);
+} /* Bool wm_idle_run */
+
+void wm_idle_stats(wm_t *wm, unsigned long *ran, unsigned long *coalesced,
+                   unsigned int *pending) {
+  *ran = wm->idle->ran;
+  *coalesced = wm->idle->coalesced;
+  *pending = g_hash_table_size(wm->idle->items);
+} /* void wm_idle_stats */
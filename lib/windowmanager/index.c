@@ -0,0 +1,202 @@
+/*
+ * Secondary indexes over the client table.
+ *
+ * wm->clients finds a client by window. To answer "which clients are in
+ * this container" or "which are of class Firefox" without walking all of
+ * them, every client is also kept in one bucket per index: by screen,
+ * container, WM_CLASS class, visibility and WM_TRANSIENT_FOR parent.
+ *
+ * Whatever changes one of those fields calls wm_index_update(), which moves
+ * the client to its new buckets. Each bucket is a list and each client
+ * remembers its links, so that is constant time. A query walks one bucket
+ * and costs as much as the number of clients it returns.
+ */
+
+#include "windowmanager.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct index_bucket {
+  gpointer key; /* a copy, for WM_INDEX_CLASS */
+  GQueue clients;
+} index_bucket_t;
+
+struct wm_indexes {
+  GHashTable *buckets[WM_INDEX_MAX + 1]; /* key -> index_bucket_t */
+};
+
+/* Where a client is in each index */
+struct wm_client_index {
+  index_bucket_t *buckets[WM_INDEX_MAX + 1];
+  GList *links[WM_INDEX_MAX + 1];
+};
+
+void wm_index_init(wm_t *wm) {
+  int i;
+
+  wm->indexes = calloc(1, sizeof(struct wm_indexes));
+  for (i = 0; i <= WM_INDEX_MAX; i++) {
+    if (i == WM_INDEX_CLASS)
+      wm->indexes->buckets[i] = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                                      free, free);
+    else
+      wm->indexes->buckets[i] = g_hash_table_new_full(g_direct_hash,
+                                                      g_direct_equal, NULL,
+                                                      free);
+  }
+} /* void wm_index_init */
+
+/* Not XScreenNumberOfScreen, which needs the display; replays have none */
+static int wm_index_screen_number(wm_t *wm, Screen *screen) {
+  int i;
+
+  for (i = 0; i < wm->num_screens; i++)
+    if (wm->screens[i] == screen)
+      return i;
+  return 0;
+} /* static int wm_index_screen_number */
+
+/* The key 'client' belongs under in 'index'. NULL means the client isn't in
+ * that index at all, which is only the case for clients without a class. */
+static gconstpointer wm_index_key(wm_t *wm, client_t *client,
+                                  unsigned int index) {
+  switch (index) {
+    case WM_INDEX_SCREEN:
+      return GINT_TO_POINTER(wm_index_screen_number(wm, client->screen));
+    case WM_INDEX_CONTAINER:
+      return GUINT_TO_POINTER(client->container);
+    case WM_INDEX_CLASS:
+      return client->res_class;
+    case WM_INDEX_VISIBLE:
+      return GUINT_TO_POINTER((client->flags & CLIENT_VISIBLE) ? True : False);
+    case WM_INDEX_TRANSIENT_FOR:
+      return GUINT_TO_POINTER(client->transient_for);
+  }
+  return NULL;
+} /* static gconstpointer wm_index_key */
+
+static Bool wm_index_key_equal(unsigned int index, gconstpointer a,
+                               gconstpointer b) {
+  if (index == WM_INDEX_CLASS)
+    return (a == NULL || b == NULL) ? a == b : strcmp(a, b) == 0;
+  return a == b;
+} /* static Bool wm_index_key_equal */
+
+static void wm_index_unlink(wm_t *wm, client_t *client, unsigned int index) {
+  struct wm_client_index *ci = client->index;
+  index_bucket_t *bucket = ci->buckets[index];
+
+  if (bucket == NULL)
+    return;
+  g_queue_delete_link(&bucket->clients, ci->links[index]);
+  ci->buckets[index] = NULL;
+  ci->links[index] = NULL;
+  if (g_queue_is_empty(&bucket->clients)) {
+    wm_res_freed(wm, WM_RES_HEAP, bucket);
+    g_hash_table_remove(wm->indexes->buckets[index], bucket->key);
+  }
+} /* static void wm_index_unlink */
+
+static void wm_index_link(wm_t *wm, client_t *client, unsigned int index,
+                          gconstpointer key) {
+  GHashTable *buckets = wm->indexes->buckets[index];
+  struct wm_client_index *ci = client->index;
+  index_bucket_t *bucket;
+
+  if (index == WM_INDEX_CLASS && key == NULL)
+    return;
+
+  bucket = g_hash_table_lookup(buckets, key);
+  if (bucket == NULL) {
+    bucket = malloc(sizeof(index_bucket_t));
+    wm_res_created(wm, WM_RES_HEAP, bucket);
+    bucket->key = (index == WM_INDEX_CLASS) ? strdup(key) : (gpointer)key;
+    g_queue_init(&bucket->clients);
+    g_hash_table_insert(buckets, bucket->key, bucket);
+  }
+  g_queue_push_tail(&bucket->clients, client);
+  ci->buckets[index] = bucket;
+  ci->links[index] = bucket->clients.tail;
+} /* static void wm_index_link */
+
+/* Put a client in the buckets its fields say it belongs in. Called by the
+ * library whenever it changes one; call it after changing client->container
+ * or client->flags yourself. */
+void wm_index_update(wm_t *wm, client_t *client) {
+  unsigned int i;
+
+  if (wm->indexes == NULL)
+    return;
+  if (client->index == NULL) {
+    client->index = calloc(1, sizeof(struct wm_client_index));
+    wm_res_created(wm, WM_RES_HEAP, client->index);
+  }
+
+  for (i = 0; i <= WM_INDEX_MAX; i++) {
+    gconstpointer key = wm_index_key(wm, client, i);
+    index_bucket_t *bucket = client->index->buckets[i];
+
+    if (bucket != NULL && wm_index_key_equal(i, bucket->key, key))
+      continue;
+    wm_index_unlink(wm, client, i);
+    wm_index_link(wm, client, i, key);
+  }
+} /* void wm_index_update */
+
+/* wm_remove_client calls this before freeing the client */
+void wm_index_remove(wm_t *wm, client_t *client) {
+  unsigned int i;
+
+  if (client->index == NULL)
+    return;
+  for (i = 0; i <= WM_INDEX_MAX; i++)
+    wm_index_unlink(wm, client, i);
+  wm_res_freed(wm, WM_RES_HEAP, client->index);
+  free(client->index);
+  client->index = NULL;
+} /* void wm_index_remove */
+
+static void wm_query(wm_t *wm, wm_query_t *query, unsigned int index,
+                     gconstpointer key) {
+  index_bucket_t *bucket = NULL;
+
+  if (wm->indexes != NULL && !(index == WM_INDEX_CLASS && key == NULL))
+    bucket = g_hash_table_lookup(wm->indexes->buckets[index], key);
+  query->next = (bucket != NULL) ? bucket->clients.head : NULL;
+  query->count = (bucket != NULL) ? bucket->clients.length : 0;
+} /* static void wm_query */
+
+/* Clients come out oldest first. The client last returned by
+ * wm_query_next may be removed while iterating; no other may. */
+client_t *wm_query_next(wm_query_t *query) {
+  GList *link = query->next;
+
+  if (link == NULL)
+    return NULL;
+  query->next = link->next;
+  return link->data;
+} /* client_t *wm_query_next */
+
+void wm_query_screen(wm_t *wm, wm_query_t *query, int screen) {
+  wm_query(wm, query, WM_INDEX_SCREEN, GINT_TO_POINTER(screen));
+} /* void wm_query_screen */
+
+/* 'container' None is the clients that are children of a root window */
+void wm_query_container(wm_t *wm, wm_query_t *query, Window container) {
+  wm_query(wm, query, WM_INDEX_CONTAINER, GUINT_TO_POINTER(container));
+} /* void wm_query_container */
+
+void wm_query_class(wm_t *wm, wm_query_t *query, const char *res_class) {
+  wm_query(wm, query, WM_INDEX_CLASS, res_class);
+} /* void wm_query_class */
+
+void wm_query_visible(wm_t *wm, wm_query_t *query, Bool visible) {
+  wm_query(wm, query, WM_INDEX_VISIBLE,
+           GUINT_TO_POINTER(visible ? True : False));
+} /* void wm_query_visible */
+
+/* The dialogs and other windows transient for 'parent' */
+void wm_query_transients(wm_t *wm, wm_query_t *query, Window parent) {
+  wm_query(wm, query, WM_INDEX_TRANSIENT_FOR, GUINT_TO_POINTER(parent));
+} /* void wm_query_transients */
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <xdo.h>
 #include <glib.h>
 #include "windowmanager.h"
@@ -20,24 +21,52 @@ Bool map_when_requested(wm_t *wm, wm_event_t *event, gpointer data) {
 } /* Bool map_when_requested */
 
 Bool property_change(wm_t *wm, wm_event_t *event, gpointer data) {
-  Atom atom_type;
-  long nitems;
-  int size;
-  xdo_getwinprop(wm->xdo, event->client->window, event->xevent->xproperty.atom,
-                 &nitems, &atom_type, &size);
-  printf("Atom type: %ld\n", atom_type);
-  printf("Atom '%s' changed\n", XGetAtomName(wm->dpy, event->xevent->xproperty.atom));
+  printf("Atom %ld changed on window %ld\n", event->xevent->xproperty.atom,
+         event->client->window);
   return True;
 }
 
-int main() {
-  wm = wm_new();
+Bool name_change(wm_t *wm, wm_event_t *event, gpointer data) {
+  printf("Window %ld is now named '%s'\n", event->client->window,
+         event->client->name ? event->client->name : "");
+  return True;
+}
 
+static void add_listeners(wm_t *wm) {
   wm_listener_add(wm, WM_EVENT_WINDOW_ENTER, focus_on_windowenter, NULL);
   wm_listener_add(wm, WM_EVENT_WINDOW_MAP_REQUEST, map_when_requested, NULL);
   wm_listener_add(wm, WM_EVENT_WINDOW_PROPERTY_CHANGE, property_change, NULL);
-  //wm_listener_add(wm, WM_EVENT_WINDOW_NAME, property_change, NULL);
+  wm_listener_add(wm, WM_EVENT_WINDOW_NAME, name_change, NULL);
+} /* static void add_listeners */
+
+/* Runs on each display's own thread */
+static Bool setup_display(wm_t *wm, gpointer data) {
+  wm_worker_start(wm);
+  add_listeners(wm);
+  return True;
+} /* static Bool setup_display */
+
+/* 'main :1 :2 ...' manages each display named from one process */
+int main(int argc, char **argv) {
+  if (argc > 1) {
+    wm_multi_t *multi = wm_multi_new(NULL);
+    int i;
+
+    for (i = 1; i < argc; i++)
+      wm_multi_add(multi, argv[i], setup_display, NULL);
+    wm_multi_run(multi);
+    return 0;
+  }
+
+  wm = wm_new();
+  wm_shm_open(wm, NULL, 1024);
+  wm_worker_start(wm);
+
+  /* WM_EVENTLOG=path records every event for later replay with wmreplay */
+  if (getenv("WM_EVENTLOG") != NULL)
+    wm_eventlog_record(wm, getenv("WM_EVENTLOG"));
 
+  add_listeners(wm);
   wm_main(wm);
 
   return 0;
@@ -0,0 +1,1004 @@
+/*
+ * An in-memory display, for running the library without an X server.
+ *
+ * wm_new_mock() makes a wm_t with no Display. The wm_x_* wrappers
+ * (eventlog.c) hand their requests here instead: the mock keeps the window
+ * tree, geometry, stacking, map state and event selections, answers the
+ * requests that have replies, and queues the events a server would send for
+ * the requests that change something. wm_mock_run() feeds the queue through
+ * wm_dispatch and the per-batch work of wm_main, the same as a live display
+ * would.
+ *
+ * The other side, what clients do, is the wm_mock_client_* functions and
+ * friends: create windows, map and configure them (which is redirected to
+ * the window manager as a real server would), rename them, move the
+ * pointer. Every request the library makes is counted by name, so a change
+ * that adds a request or a round trip shows up in the numbers. wmbench.c
+ * uses this to time dispatch and layout without a display.
+ *
+ * Only the window manager's event selections are modelled, since it is the
+ * only client listening. Anything the wrappers don't cover (Xlib calls made
+ * directly on wm->dpy) never reaches the mock; those paths are skipped when
+ * there's no display, as they are during replay.
+ */
+
+#include "windowmanager.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <X11/Xatom.h>
+
+#define MOCK_ROOT_BASE 0x100
+#define MOCK_WINDOW_BASE 0x200000
+#define MOCK_ATOM_BASE 0x1000 /* above the predefined atoms */
+
+typedef struct mock_window {
+  Window id;
+  struct mock_window *parent; /* NULL for roots */
+  int screen;
+  int x, y;
+  unsigned int width, height, border_width;
+  Bool mapped;
+  Bool override_redirect;
+  long event_mask; /* selected by the window manager */
+
+  GQueue children; /* mock_window_t, bottom to top */
+  GList *link; /* in parent->children */
+
+  char *name;
+  char *res_name;
+  char *res_class;
+  char *role;
+  Window transient_for;
+  unsigned long *icon; /* raw _NET_WM_ICON */
+  unsigned long icon_len;
+  GHashTable *properties; /* set by the window manager; Atom -> GArray of
+                           * long, format 32 only */
+} mock_window_t;
+
+typedef struct mock_request {
+  const char *name;
+  unsigned long count;
+  Bool round_trip;
+} mock_request_t;
+
+struct wm_mock {
+  GHashTable *windows; /* Window -> mock_window_t */
+  Window next_window;
+  GQueue events; /* XEvent, in the order a server would send them */
+  unsigned long serial;
+
+  GHashTable *atoms; /* name -> Atom */
+  GPtrArray *atom_names; /* Atom - MOCK_ATOM_BASE -> name */
+
+  Window pointer_window; /* deepest viewable window under the pointer */
+  int pointer_x, pointer_y; /* root coordinates */
+  int pointer_screen;
+
+  GHashTable *requests; /* name -> mock_request_t */
+  unsigned long round_trips;
+  unsigned long one_way;
+  unsigned long dispatched;
+};
+
+static mock_window_t *mock_window(wm_t *wm, Window w) {
+  return g_hash_table_lookup(wm->mock->windows, GUINT_TO_POINTER(w));
+} /* static mock_window_t *mock_window */
+
+static void mock_count(wm_t *wm, const char *name, Bool round_trip) {
+  struct wm_mock *mock = wm->mock;
+  mock_request_t *request;
+
+  request = g_hash_table_lookup(mock->requests, name);
+  if (request == NULL) {
+    request = calloc(1, sizeof(mock_request_t));
+    request->name = name;
+    request->round_trip = round_trip;
+    g_hash_table_insert(mock->requests, (gpointer)name, request);
+  }
+  request->count++;
+  mock->serial++;
+  if (round_trip)
+    mock->round_trips++;
+  else
+    mock->one_way++;
+} /* static void mock_count */
+
+static mock_window_t *mock_window_new(wm_t *wm, Window id,
+                                      mock_window_t *parent, int screen) {
+  mock_window_t *win = calloc(1, sizeof(mock_window_t));
+
+  win->id = id;
+  win->parent = parent;
+  win->screen = screen;
+  g_queue_init(&win->children);
+  if (parent != NULL) {
+    g_queue_push_tail(&parent->children, win);
+    win->link = parent->children.tail;
+  }
+  g_hash_table_insert(wm->mock->windows, GUINT_TO_POINTER(id), win);
+  return win;
+} /* static mock_window_t *mock_window_new */
+
+/* Make a wm with a mock display of 'num_screens' screens of the given size,
+ * with nothing on them. Add windows with wm_mock_create_window, then call
+ * wm_main once to pick them up, and wm_mock_run after anything else. */
+wm_t *wm_new_mock(int num_screens, unsigned int width, unsigned int height) {
+  struct wm_mock *mock;
+  wm_t *wm;
+  int i;
+
+  wm = calloc(1, sizeof(wm_t));
+  wm->log_level = LOG_INFO;
+  mock = calloc(1, sizeof(struct wm_mock));
+  mock->windows = g_hash_table_new(g_direct_hash, g_direct_equal);
+  mock->next_window = MOCK_WINDOW_BASE;
+  g_queue_init(&mock->events);
+  mock->atoms = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+  mock->atom_names = g_ptr_array_new();
+  mock->requests = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, free);
+  wm->mock = mock;
+
+  /* Screens only carry what the handlers look at, as in a replay */
+  wm->num_screens = num_screens;
+  wm->screens = calloc(num_screens, sizeof(Screen *));
+  for (i = 0; i < num_screens; i++) {
+    mock_window_t *root;
+
+    wm->screens[i] = calloc(1, sizeof(Screen));
+    wm->screens[i]->root = MOCK_ROOT_BASE + i;
+    wm->screens[i]->width = width;
+    wm->screens[i]->height = height;
+    root = mock_window_new(wm, MOCK_ROOT_BASE + i, NULL, i);
+    root->width = width;
+    root->height = height;
+    root->mapped = True;
+    /* What wm_x_init_screens selects */
+    root->event_mask = SubstructureNotifyMask | SubstructureRedirectMask
+                       | EnterWindowMask | LeaveWindowMask;
+  }
+  mock->pointer_window = MOCK_ROOT_BASE;
+
+  wm->dpy = NULL;
+  wm_init(wm);
+  return wm;
+} /* wm_t *wm_new_mock */
+
+/*
+ * Events
+ */
+
+static void mock_queue(wm_t *wm, XEvent *ev) {
+  XEvent *copy = malloc(sizeof(XEvent));
+
+  memcpy(copy, ev, sizeof(XEvent));
+  copy->xany.serial = wm->mock->serial;
+  copy->xany.display = NULL;
+  g_queue_push_tail(&wm->mock->events, copy);
+} /* static void mock_queue */
+
+/* Queue a structure event for 'win' to whoever selected it: the window
+ * itself with StructureNotifyMask, its parent with SubstructureNotifyMask.
+ * 'event' is the field saying which of them it's for; every structure
+ * event has it right after the header. */
+static void mock_structure(wm_t *wm, mock_window_t *win, mock_window_t *parent,
+                           XEvent *ev) {
+  Window *event = (Window *)((char *)ev + offsetof(XAnyEvent, window));
+
+  if (win->event_mask & StructureNotifyMask) {
+    *event = win->id;
+    mock_queue(wm, ev);
+  }
+  if (parent != NULL && (parent->event_mask & SubstructureNotifyMask)) {
+    *event = parent->id;
+    mock_queue(wm, ev);
+  }
+} /* static void mock_structure */
+
+/* Whether a client's request on 'win' goes to the window manager instead */
+static Bool mock_redirected(mock_window_t *win) {
+  return win->parent != NULL && !win->override_redirect
+         && (win->parent->event_mask & SubstructureRedirectMask);
+} /* static Bool mock_redirected */
+
+static Bool mock_viewable(mock_window_t *win) {
+  for (; win != NULL; win = win->parent)
+    if (!win->mapped)
+      return False;
+  return True;
+} /* static Bool mock_viewable */
+
+static void mock_do_map(wm_t *wm, mock_window_t *win) {
+  XEvent ev;
+
+  if (win->mapped)
+    return;
+  win->mapped = True;
+  memset(&ev, 0, sizeof(ev));
+  ev.xmap.type = MapNotify;
+  ev.xmap.window = win->id;
+  ev.xmap.override_redirect = win->override_redirect;
+  mock_structure(wm, win, win->parent, &ev);
+} /* static void mock_do_map */
+
+static void mock_do_unmap(wm_t *wm, mock_window_t *win) {
+  XEvent ev;
+
+  if (!win->mapped)
+    return;
+  win->mapped = False;
+  memset(&ev, 0, sizeof(ev));
+  ev.xunmap.type = UnmapNotify;
+  ev.xunmap.window = win->id;
+  mock_structure(wm, win, win->parent, &ev);
+} /* static void mock_do_unmap */
+
+static void mock_send_configure(wm_t *wm, mock_window_t *win) {
+  XEvent ev;
+  GList *below = (win->link != NULL) ? win->link->prev : NULL;
+
+  memset(&ev, 0, sizeof(ev));
+  ev.xconfigure.type = ConfigureNotify;
+  ev.xconfigure.window = win->id;
+  ev.xconfigure.x = win->x;
+  ev.xconfigure.y = win->y;
+  ev.xconfigure.width = win->width;
+  ev.xconfigure.height = win->height;
+  ev.xconfigure.border_width = win->border_width;
+  ev.xconfigure.above = (below != NULL) ? ((mock_window_t *)below->data)->id
+                                        : None;
+  ev.xconfigure.override_redirect = win->override_redirect;
+  mock_structure(wm, win, win->parent, &ev);
+} /* static void mock_send_configure */
+
+/* Restack 'win' among its siblings per CWStackMode */
+static void mock_restack(mock_window_t *win, mock_window_t *sibling,
+                         int stack_mode) {
+  GQueue *siblings = &win->parent->children;
+
+  if (sibling == win || (sibling != NULL && sibling->parent != win->parent))
+    return;
+  g_queue_delete_link(siblings, win->link);
+  if (stack_mode == Above && sibling != NULL) {
+    g_queue_insert_after(siblings, sibling->link, win);
+    win->link = sibling->link->next;
+  } else if (stack_mode == Below && sibling != NULL) {
+    g_queue_insert_before(siblings, sibling->link, win);
+    win->link = sibling->link->prev;
+  } else if (stack_mode == Below || stack_mode == BottomIf) {
+    g_queue_push_head(siblings, win);
+    win->link = siblings->head;
+  } else {
+    g_queue_push_tail(siblings, win);
+    win->link = siblings->tail;
+  }
+} /* static void mock_restack */
+
+static void mock_do_configure(wm_t *wm, mock_window_t *win,
+                              unsigned int value_mask,
+                              XWindowChanges *changes) {
+  if (value_mask & CWX)
+    win->x = changes->x;
+  if (value_mask & CWY)
+    win->y = changes->y;
+  if ((value_mask & CWWidth) && changes->width > 0)
+    win->width = changes->width;
+  if ((value_mask & CWHeight) && changes->height > 0)
+    win->height = changes->height;
+  if (value_mask & CWBorderWidth)
+    win->border_width = changes->border_width;
+  if ((value_mask & CWStackMode) && win->parent != NULL)
+    mock_restack(win, (value_mask & CWSibling)
+                      ? mock_window(wm, changes->sibling) : NULL,
+                 changes->stack_mode);
+  mock_send_configure(wm, win);
+} /* static void mock_do_configure */
+
+static void mock_property(wm_t *wm, mock_window_t *win, Atom atom, int state) {
+  XEvent ev;
+
+  if (!(win->event_mask & PropertyChangeMask))
+    return;
+  memset(&ev, 0, sizeof(ev));
+  ev.xproperty.type = PropertyNotify;
+  ev.xproperty.window = win->id;
+  ev.xproperty.atom = atom;
+  ev.xproperty.state = state;
+  mock_queue(wm, &ev);
+} /* static void mock_property */
+
+/* Dispatch everything queued, with wm_main's per-batch work after each
+ * batch, until nothing more is queued. Returns the number of events
+ * dispatched. */
+unsigned long wm_mock_run(wm_t *wm) {
+  struct wm_mock *mock = wm->mock;
+  unsigned long dispatched = 0;
+  XEvent *ev;
+
+  do {
+    while ((ev = g_queue_pop_head(&mock->events)) != NULL) {
+      wm_dispatch(wm, ev);
+      free(ev);
+      dispatched++;
+    }
+    wm_timer_run(wm);
+    wm_occlusion_update(wm);
+    wm_stack_flush(wm);
+    wm_ewmh_flush(wm);
+    wm_shm_publish(wm);
+    if (g_queue_is_empty(&mock->events))
+      wm_idle_run(wm);
+  } while (!g_queue_is_empty(&mock->events));
+  mock->dispatched += dispatched;
+  return dispatched;
+} /* unsigned long wm_mock_run */
+
+/* Queue any event, e.g. a key press, as if the server sent it. */
+void wm_mock_queue_event(wm_t *wm, XEvent *ev) {
+  mock_queue(wm, ev);
+} /* void wm_mock_queue_event */
+
+unsigned int wm_mock_pending(wm_t *wm) {
+  return wm->mock->events.length;
+} /* unsigned int wm_mock_pending */
+
+/*
+ * What clients do
+ */
+
+/* Create a window. 'event_mask' is what the window manager selects on it,
+ * for windows the program makes itself, like frames; client windows start
+ * with none. Children of a root are announced with a CreateNotify. */
+Window wm_mock_create_window(wm_t *wm, Window parent, int x, int y,
+                             unsigned int width, unsigned int height,
+                             long event_mask) {
+  mock_window_t *p = mock_window(wm, parent);
+  mock_window_t *win;
+  XEvent ev;
+
+  if (p == NULL)
+    return None;
+  win = mock_window_new(wm, wm->mock->next_window++, p, p->screen);
+  win->x = x;
+  win->y = y;
+  win->width = width;
+  win->height = height;
+  win->event_mask = event_mask;
+
+  if (p->event_mask & SubstructureNotifyMask) {
+    memset(&ev, 0, sizeof(ev));
+    ev.xcreatewindow.type = CreateNotify;
+    ev.xcreatewindow.parent = p->id;
+    ev.xcreatewindow.window = win->id;
+    ev.xcreatewindow.x = x;
+    ev.xcreatewindow.y = y;
+    ev.xcreatewindow.width = width;
+    ev.xcreatewindow.height = height;
+    mock_queue(wm, &ev);
+  }
+  return win->id;
+} /* Window wm_mock_create_window */
+
+void wm_mock_set_override_redirect(wm_t *wm, Window w, Bool override_redirect) {
+  mock_window_t *win = mock_window(wm, w);
+
+  if (win != NULL)
+    win->override_redirect = override_redirect;
+} /* void wm_mock_set_override_redirect */
+
+/* A client maps its window: a MapRequest if the window manager redirects
+ * its parent, otherwise it's simply mapped. */
+void wm_mock_client_map(wm_t *wm, Window w) {
+  mock_window_t *win = mock_window(wm, w);
+  XEvent ev;
+
+  if (win == NULL || win->mapped)
+    return;
+  if (!mock_redirected(win)) {
+    mock_do_map(wm, win);
+    return;
+  }
+  memset(&ev, 0, sizeof(ev));
+  ev.xmaprequest.type = MapRequest;
+  ev.xmaprequest.parent = win->parent->id;
+  ev.xmaprequest.window = win->id;
+  mock_queue(wm, &ev);
+} /* void wm_mock_client_map */
+
+/* A client withdraws its window (ICCCM 4.1.4) */
+void wm_mock_client_unmap(wm_t *wm, Window w) {
+  mock_window_t *win = mock_window(wm, w);
+
+  if (win != NULL)
+    mock_do_unmap(wm, win);
+} /* void wm_mock_client_unmap */
+
+/* A client asks for new geometry */
+void wm_mock_client_configure(wm_t *wm, Window w, int x, int y,
+                              unsigned int width, unsigned int height) {
+  mock_window_t *win = mock_window(wm, w);
+  XWindowChanges changes;
+  XEvent ev;
+
+  if (win == NULL)
+    return;
+  if (!mock_redirected(win)) {
+    changes.x = x;
+    changes.y = y;
+    changes.width = width;
+    changes.height = height;
+    mock_do_configure(wm, win, CWX | CWY | CWWidth | CWHeight, &changes);
+    return;
+  }
+  memset(&ev, 0, sizeof(ev));
+  ev.xconfigurerequest.type = ConfigureRequest;
+  ev.xconfigurerequest.parent = win->parent->id;
+  ev.xconfigurerequest.window = win->id;
+  ev.xconfigurerequest.x = x;
+  ev.xconfigurerequest.y = y;
+  ev.xconfigurerequest.width = width;
+  ev.xconfigurerequest.height = height;
+  ev.xconfigurerequest.value_mask = CWX | CWY | CWWidth | CWHeight;
+  mock_queue(wm, &ev);
+} /* void wm_mock_client_configure */
+
+static void mock_destroy(wm_t *wm, mock_window_t *win) {
+  mock_window_t *parent = win->parent;
+  XEvent ev;
+
+  /* Children first, as the server does */
+  while (!g_queue_is_empty(&win->children))
+    mock_destroy(wm, g_queue_peek_tail(&win->children));
+
+  mock_do_unmap(wm, win);
+  memset(&ev, 0, sizeof(ev));
+  ev.xdestroywindow.type = DestroyNotify;
+  ev.xdestroywindow.window = win->id;
+  mock_structure(wm, win, parent, &ev);
+
+  if (wm->mock->pointer_window == win->id)
+    wm->mock->pointer_window = parent->id;
+  g_queue_delete_link(&parent->children, win->link);
+  g_hash_table_remove(wm->mock->windows, GUINT_TO_POINTER(win->id));
+  free(win->name);
+  free(win->res_name);
+  free(win->res_class);
+  free(win->role);
+  free(win->icon);
+  if (win->properties != NULL)
+    g_hash_table_destroy(win->properties);
+  free(win);
+} /* static void mock_destroy */
+
+/* Destroy a window and everything in it. Roots can't be destroyed. */
+void wm_mock_destroy_window(wm_t *wm, Window w) {
+  mock_window_t *win = mock_window(wm, w);
+
+  if (win != NULL && win->parent != NULL)
+    mock_destroy(wm, win);
+} /* void wm_mock_destroy_window */
+
+/* Set WM_NAME, which the library fetches on PropertyNotify */
+void wm_mock_set_name(wm_t *wm, Window w, const char *name) {
+  mock_window_t *win = mock_window(wm, w);
+
+  if (win == NULL)
+    return;
+  free(win->name);
+  win->name = (name != NULL) ? strdup(name) : NULL;
+  mock_property(wm, win, XA_WM_NAME,
+                (name != NULL) ? PropertyNewValue : PropertyDelete);
+} /* void wm_mock_set_name */
+
+void wm_mock_set_class(wm_t *wm, Window w, const char *res_name,
+                       const char *res_class) {
+  mock_window_t *win = mock_window(wm, w);
+
+  if (win == NULL)
+    return;
+  free(win->res_name);
+  free(win->res_class);
+  win->res_name = (res_name != NULL) ? strdup(res_name) : NULL;
+  win->res_class = (res_class != NULL) ? strdup(res_class) : NULL;
+  mock_property(wm, win, XA_WM_CLASS, PropertyNewValue);
+} /* void wm_mock_set_class */
+
+void wm_mock_set_transient_for(wm_t *wm, Window w, Window parent) {
+  mock_window_t *win = mock_window(wm, w);
+
+  if (win == NULL)
+    return;
+  win->transient_for = parent;
+  mock_property(wm, win, XA_WM_TRANSIENT_FOR, PropertyNewValue);
+} /* void wm_mock_set_transient_for */
+
+static Atom mock_atom(wm_t *wm, const char *name);
+
+void wm_mock_set_role(wm_t *wm, Window w, const char *role) {
+  mock_window_t *win = mock_window(wm, w);
+
+  if (win == NULL)
+    return;
+  free(win->role);
+  win->role = (role != NULL) ? strdup(role) : NULL;
+  mock_property(wm, win, mock_atom(wm, "WM_WINDOW_ROLE"),
+                (role != NULL) ? PropertyNewValue : PropertyDelete);
+} /* void wm_mock_set_role */
+
+/* Set _NET_WM_ICON to 'len' longs of 'data', in the property's layout */
+void wm_mock_set_icon(wm_t *wm, Window w, const unsigned long *data,
+                      unsigned long len) {
+  mock_window_t *win = mock_window(wm, w);
+
+  if (win == NULL)
+    return;
+  free(win->icon);
+  win->icon = NULL;
+  win->icon_len = 0;
+  if (data != NULL && len > 0) {
+    win->icon = malloc(len * sizeof(unsigned long));
+    memcpy(win->icon, data, len * sizeof(unsigned long));
+    win->icon_len = len;
+  }
+  mock_property(wm, win, mock_atom(wm, "_NET_WM_ICON"),
+                (data != NULL) ? PropertyNewValue : PropertyDelete);
+} /* void wm_mock_set_icon */
+
+/* A format 32 property the window manager set on 'w', as a panel would
+ * read it; NULL if there's none. */
+const unsigned long *wm_mock_get_property(wm_t *wm, Window w, Atom property,
+                                          unsigned long *nitems) {
+  mock_window_t *win = mock_window(wm, w);
+  GArray *value = NULL;
+
+  if (win != NULL && win->properties != NULL)
+    value = g_hash_table_lookup(win->properties, GUINT_TO_POINTER(property));
+  *nitems = (value != NULL) ? value->len : 0;
+  return (value != NULL) ? (const unsigned long *)value->data : NULL;
+} /* const unsigned long *wm_mock_get_property */
+
+/* Where 'win' is in root coordinates: the inside of its border */
+static void mock_origin(mock_window_t *win, int *x, int *y) {
+  *x = 0;
+  *y = 0;
+  for (; win != NULL; win = win->parent) {
+    *x += win->x + (int)win->border_width;
+    *y += win->y + (int)win->border_width;
+  }
+} /* static void mock_origin */
+
+/* The topmost viewable child of 'win' under the root position x, y */
+static mock_window_t *mock_child_at(mock_window_t *win, int x, int y) {
+  GList *link;
+
+  for (link = win->children.tail; link != NULL; link = link->prev) {
+    mock_window_t *child = link->data;
+    int cx, cy;
+
+    if (!child->mapped)
+      continue;
+    mock_origin(child, &cx, &cy);
+    cx -= child->border_width;
+    cy -= child->border_width;
+    if (x >= cx && y >= cy
+        && x < cx + (int)(child->width + 2 * child->border_width)
+        && y < cy + (int)(child->height + 2 * child->border_width))
+      return child;
+  }
+  return NULL;
+} /* static mock_window_t *mock_child_at */
+
+static void mock_crossing(wm_t *wm, mock_window_t *win, int type) {
+  struct wm_mock *mock = wm->mock;
+  XEvent ev;
+  int ox, oy;
+
+  if (!(win->event_mask & (type == EnterNotify ? EnterWindowMask
+                                               : LeaveWindowMask)))
+    return;
+  mock_origin(win, &ox, &oy);
+  memset(&ev, 0, sizeof(ev));
+  ev.xcrossing.type = type;
+  ev.xcrossing.window = win->id;
+  ev.xcrossing.root = MOCK_ROOT_BASE + win->screen;
+  ev.xcrossing.x = mock->pointer_x - ox;
+  ev.xcrossing.y = mock->pointer_y - oy;
+  ev.xcrossing.x_root = mock->pointer_x;
+  ev.xcrossing.y_root = mock->pointer_y;
+  ev.xcrossing.mode = NotifyNormal;
+  ev.xcrossing.detail = NotifyAncestor;
+  ev.xcrossing.same_screen = True;
+  mock_queue(wm, &ev);
+} /* static void mock_crossing */
+
+/* Move the pointer to x, y on 'screen'. Crossing into another window sends
+ * a LeaveNotify to the old one and an EnterNotify to the new one. */
+void wm_mock_move_pointer(wm_t *wm, int screen, int x, int y) {
+  struct wm_mock *mock = wm->mock;
+  mock_window_t *win, *child, *old;
+
+  mock->pointer_screen = screen;
+  mock->pointer_x = x;
+  mock->pointer_y = y;
+  win = mock_window(wm, MOCK_ROOT_BASE + screen);
+  while ((child = mock_child_at(win, x, y)) != NULL)
+    win = child;
+  if (win->id == mock->pointer_window)
+    return;
+
+  old = mock_window(wm, mock->pointer_window);
+  mock->pointer_window = win->id;
+  if (old != NULL)
+    mock_crossing(wm, old, LeaveNotify);
+  mock_crossing(wm, win, EnterNotify);
+} /* void wm_mock_move_pointer */
+
+/*
+ * The window manager's requests, from the wm_x_* wrappers
+ */
+
+/* Count a request that has no effect on the mock, like a grab */
+void wm_mock_request(wm_t *wm, const char *name) {
+  mock_count(wm, name, False);
+} /* void wm_mock_request */
+
+Status wm_mock_get_window_attributes(wm_t *wm, Window w,
+                                     XWindowAttributes *attr) {
+  mock_window_t *win = mock_window(wm, w);
+
+  mock_count(wm, __func__, True);
+  if (win == NULL)
+    return 0;
+  memset(attr, 0, sizeof(XWindowAttributes));
+  attr->x = win->x;
+  attr->y = win->y;
+  attr->width = win->width;
+  attr->height = win->height;
+  attr->border_width = win->border_width;
+  attr->depth = 24;
+  attr->root = MOCK_ROOT_BASE + win->screen;
+  attr->class = InputOutput;
+  attr->map_state = !win->mapped ? IsUnmapped
+                    : mock_viewable(win) ? IsViewable : IsUnviewable;
+  attr->override_redirect = win->override_redirect;
+  attr->your_event_mask = win->event_mask;
+  attr->all_event_masks = win->event_mask;
+  attr->screen = wm->screens[win->screen];
+  return 1;
+} /* Status wm_mock_get_window_attributes */
+
+static Atom mock_atom(wm_t *wm, const char *name) {
+  struct wm_mock *mock = wm->mock;
+  gpointer atom;
+
+  atom = g_hash_table_lookup(mock->atoms, name);
+  if (atom != NULL)
+    return GPOINTER_TO_UINT(atom);
+  g_ptr_array_add(mock->atom_names, strdup(name));
+  atom = GUINT_TO_POINTER(MOCK_ATOM_BASE + mock->atom_names->len - 1);
+  g_hash_table_insert(mock->atoms, strdup(name), atom);
+  return GPOINTER_TO_UINT(atom);
+} /* static Atom mock_atom */
+
+/* Xlib answers repeats from its cache, so only the first one is a round
+ * trip. The predefined atoms the library compares against (XA_WM_NAME and
+ * so on) are returned as themselves. */
+Atom wm_mock_intern_atom(wm_t *wm, const char *name, Bool only_if_exists) {
+  static const struct { const char *name; Atom atom; } predefined[] = {
+    { "WM_NAME", XA_WM_NAME }, { "WM_CLASS", XA_WM_CLASS },
+    { "WM_HINTS", XA_WM_HINTS }, { "WM_TRANSIENT_FOR", XA_WM_TRANSIENT_FOR },
+  };
+  unsigned int i;
+
+  for (i = 0; i < G_N_ELEMENTS(predefined); i++)
+    if (strcmp(name, predefined[i].name) == 0)
+      return predefined[i].atom;
+  if (g_hash_table_lookup(wm->mock->atoms, name) != NULL)
+    return mock_atom(wm, name);
+  mock_count(wm, __func__, True);
+  if (only_if_exists)
+    return None;
+  return mock_atom(wm, name);
+} /* Atom wm_mock_intern_atom */
+
+/* Released with XFree, like XGetAtomName's, which is free() here */
+char *wm_mock_get_atom_name(wm_t *wm, Atom atom) {
+  GPtrArray *names = wm->mock->atom_names;
+
+  mock_count(wm, __func__, True);
+  if (atom < MOCK_ATOM_BASE || atom - MOCK_ATOM_BASE >= names->len)
+    return NULL;
+  return strdup(g_ptr_array_index(names, atom - MOCK_ATOM_BASE));
+} /* char *wm_mock_get_atom_name */
+
+Bool wm_mock_query_pointer(wm_t *wm, Window w, Window *root, Window *child,
+                           int *root_x, int *root_y, int *x, int *y,
+                           unsigned int *mask) {
+  struct wm_mock *mock = wm->mock;
+  mock_window_t *win = mock_window(wm, w);
+  mock_window_t *under;
+  int ox = 0, oy = 0;
+
+  mock_count(wm, __func__, True);
+  *root = MOCK_ROOT_BASE + mock->pointer_screen;
+  *root_x = mock->pointer_x;
+  *root_y = mock->pointer_y;
+  *mask = 0;
+  *child = None;
+  if (win == NULL || win->screen != mock->pointer_screen) {
+    *x = 0;
+    *y = 0;
+    return False;
+  }
+  mock_origin(win, &ox, &oy);
+  *x = mock->pointer_x - ox;
+  *y = mock->pointer_y - oy;
+  under = mock_child_at(win, mock->pointer_x, mock->pointer_y);
+  if (under != NULL)
+    *child = under->id;
+  return True;
+} /* Bool wm_mock_query_pointer */
+
+/* *children is released with XFree, which is free() here */
+Status wm_mock_query_tree(wm_t *wm, Window w, Window *root, Window *parent,
+                          Window **children, unsigned int *nchildren) {
+  mock_window_t *win = mock_window(wm, w);
+  GList *link;
+  unsigned int i = 0;
+
+  mock_count(wm, __func__, True);
+  *children = NULL;
+  *nchildren = 0;
+  if (win == NULL)
+    return 0;
+  *root = MOCK_ROOT_BASE + win->screen;
+  *parent = (win->parent != NULL) ? win->parent->id : None;
+  if (win->children.length == 0)
+    return 1;
+  *nchildren = win->children.length;
+  *children = malloc(*nchildren * sizeof(Window));
+  for (link = win->children.head; link != NULL; link = link->next)
+    (*children)[i++] = ((mock_window_t *)link->data)->id;
+  return 1;
+} /* Status wm_mock_query_tree */
+
+static long mock_event_mask(int type) {
+  switch (type) {
+    case MotionNotify: return PointerMotionMask | ButtonMotionMask;
+    case ButtonPress: return ButtonPressMask;
+    case ButtonRelease: return ButtonReleaseMask;
+    case EnterNotify: return EnterWindowMask;
+    case LeaveNotify: return LeaveWindowMask;
+    case Expose: return ExposureMask;
+    case KeyPress: return KeyPressMask;
+    case KeyRelease: return KeyReleaseMask;
+  }
+  return 0;
+} /* static long mock_event_mask */
+
+/* As XMaskEvent, except that with nothing matching queued it returns a
+ * ButtonRelease rather than waiting forever, which ends a drag, as replay
+ * does. */
+void wm_mock_mask_event(wm_t *wm, long event_mask, XEvent *ev) {
+  GQueue *events = &wm->mock->events;
+  GList *link;
+
+  for (link = events->head; link != NULL; link = link->next) {
+    XEvent *queued = link->data;
+    if (mock_event_mask(queued->type) & event_mask) {
+      memcpy(ev, queued, sizeof(XEvent));
+      free(queued);
+      g_queue_delete_link(events, link);
+      return;
+    }
+  }
+  memset(ev, 0, sizeof(XEvent));
+  ev->type = ButtonRelease;
+} /* void wm_mock_mask_event */
+
+void wm_mock_select_input(wm_t *wm, Window w, long event_mask) {
+  mock_window_t *win = mock_window(wm, w);
+
+  mock_count(wm, __func__, False);
+  if (win != NULL)
+    win->event_mask = event_mask;
+} /* void wm_mock_select_input */
+
+/* The window manager's own maps aren't redirected back to it */
+void wm_mock_map_window(wm_t *wm, Window w) {
+  mock_window_t *win = mock_window(wm, w);
+
+  mock_count(wm, __func__, False);
+  if (win != NULL)
+    mock_do_map(wm, win);
+} /* void wm_mock_map_window */
+
+void wm_mock_unmap_window(wm_t *wm, Window w) {
+  mock_window_t *win = mock_window(wm, w);
+
+  mock_count(wm, __func__, False);
+  if (win != NULL)
+    mock_do_unmap(wm, win);
+} /* void wm_mock_unmap_window */
+
+/* Unmap, move to the top of the new parent's stack, map again. */
+void wm_mock_reparent_window(wm_t *wm, Window w, Window parent, int x, int y) {
+  mock_window_t *win = mock_window(wm, w);
+  mock_window_t *p = mock_window(wm, parent);
+  mock_window_t *old;
+  Bool was_mapped;
+  XEvent ev;
+
+  mock_count(wm, __func__, False);
+  if (win == NULL || p == NULL || win->parent == NULL)
+    return;
+  was_mapped = win->mapped;
+  mock_do_unmap(wm, win);
+
+  old = win->parent;
+  g_queue_delete_link(&old->children, win->link);
+  win->parent = p;
+  win->screen = p->screen;
+  win->x = x;
+  win->y = y;
+  g_queue_push_tail(&p->children, win);
+  win->link = p->children.tail;
+
+  memset(&ev, 0, sizeof(ev));
+  ev.xreparent.type = ReparentNotify;
+  ev.xreparent.window = win->id;
+  ev.xreparent.parent = p->id;
+  ev.xreparent.x = x;
+  ev.xreparent.y = y;
+  ev.xreparent.override_redirect = win->override_redirect;
+  mock_structure(wm, win, old, &ev);
+  if (p->event_mask & SubstructureNotifyMask) {
+    ev.xreparent.event = p->id;
+    mock_queue(wm, &ev);
+  }
+
+  if (was_mapped)
+    mock_do_map(wm, win);
+} /* void wm_mock_reparent_window */
+
+void wm_mock_configure_window(wm_t *wm, Window w, unsigned int value_mask,
+                              XWindowChanges *changes) {
+  mock_window_t *win = mock_window(wm, w);
+
+  mock_count(wm, __func__, False);
+  if (win != NULL)
+    mock_do_configure(wm, win, value_mask, changes);
+} /* void wm_mock_configure_window */
+
+static void mock_property_free(gpointer data) {
+  g_array_free(data, True);
+} /* static void mock_property_free */
+
+/* Only format 32 values are kept; the others are just counted. */
+void wm_mock_change_property(wm_t *wm, Window w, Atom property, int format,
+                             int mode, const unsigned char *data,
+                             int nelements) {
+  mock_window_t *win = mock_window(wm, w);
+  GArray *value;
+
+  mock_count(wm, __func__, False);
+  if (win == NULL || format != 32)
+    return;
+  if (win->properties == NULL)
+    win->properties = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                            NULL, mock_property_free);
+  value = g_hash_table_lookup(win->properties, GUINT_TO_POINTER(property));
+  if (value == NULL) {
+    value = g_array_new(False, False, sizeof(unsigned long));
+    g_hash_table_insert(win->properties, GUINT_TO_POINTER(property), value);
+  }
+  if (mode == PropModeReplace)
+    g_array_set_size(value, 0);
+  if (mode == PropModePrepend)
+    g_array_prepend_vals(value, data, nelements);
+  else
+    g_array_append_vals(value, data, nelements);
+  mock_property(wm, win, property, PropertyNewValue);
+} /* void wm_mock_change_property */
+
+void wm_mock_delete_property(wm_t *wm, Window w, Atom property) {
+  mock_window_t *win = mock_window(wm, w);
+
+  mock_count(wm, __func__, False);
+  if (win == NULL || win->properties == NULL)
+    return;
+  if (g_hash_table_remove(win->properties, GUINT_TO_POINTER(property)))
+    mock_property(wm, win, property, PropertyDelete);
+} /* void wm_mock_delete_property */
+
+/* Property values as a fetch (worker.c) would find them. Each property
+ * asked for is a round trip. */
+void wm_mock_fetch(wm_t *wm, Window w, unsigned int what,
+                   wm_fetch_result_t *result) {
+  mock_window_t *win = mock_window(wm, w);
+  unsigned int bit;
+
+  for (bit = what; bit != 0; bit &= bit - 1)
+    mock_count(wm, __func__, True);
+
+  memset(result, 0, sizeof(wm_fetch_result_t));
+  result->window = w;
+  result->what = what;
+  result->sync_counter = None;
+  if (win == NULL)
+    return;
+  if ((what & WM_FETCH_NAME) && win->name != NULL)
+    result->name = strdup(win->name);
+  if ((what & WM_FETCH_CLASS) && win->res_name != NULL)
+    result->res_name = strdup(win->res_name);
+  if ((what & WM_FETCH_CLASS) && win->res_class != NULL)
+    result->res_class = strdup(win->res_class);
+  if ((what & WM_FETCH_ROLE) && win->role != NULL)
+    result->role = strdup(win->role);
+  if (what & WM_FETCH_STATE) {
+    unsigned long nitems;
+    const unsigned long *state;
+
+    state = wm_mock_get_property(wm, w, mock_atom(wm, "_NET_WM_STATE"),
+                                 &nitems);
+    if (nitems > 0) {
+      result->net_wm_state = malloc(nitems * sizeof(Atom));
+      memcpy(result->net_wm_state, state, nitems * sizeof(Atom));
+      result->net_wm_state_len = nitems;
+    }
+  }
+  if (what & WM_FETCH_TRANSIENT)
+    result->transient_for = win->transient_for;
+  if ((what & WM_FETCH_ICON) && win->icon != NULL)
+    wm_icon_prepare(win->icon, win->icon_len, &result->icon,
+                    &result->icon_len);
+} /* void wm_mock_fetch */
+
+/*
+ * Numbers
+ */
+
+void wm_mock_stats(wm_t *wm, unsigned long *round_trips,
+                   unsigned long *one_way, unsigned long *dispatched) {
+  *round_trips = wm->mock->round_trips;
+  *one_way = wm->mock->one_way;
+  *dispatched = wm->mock->dispatched;
+} /* void wm_mock_stats */
+
+void wm_mock_reset_stats(wm_t *wm) {
+  g_hash_table_remove_all(wm->mock->requests);
+  wm->mock->round_trips = 0;
+  wm->mock->one_way = 0;
+  wm->mock->dispatched = 0;
+} /* void wm_mock_reset_stats */
+
+static gint mock_request_compare(gconstpointer a, gconstpointer b) {
+  const mock_request_t *ra = *(mock_request_t **)a;
+  const mock_request_t *rb = *(mock_request_t **)b;
+  return (rb->count > ra->count) - (rb->count < ra->count);
+} /* static gint mock_request_compare */
+
+/* Log the requests made since the last reset, most frequent first. */
+void wm_mock_report(wm_t *wm) {
+  GHashTableIter iter;
+  gpointer value;
+  GPtrArray *requests;
+  unsigned int i;
+
+  requests = g_ptr_array_new();
+  g_hash_table_iter_init(&iter, wm->mock->requests);
+  while (g_hash_table_iter_next(&iter, NULL, &value))
+    g_ptr_array_add(requests, value);
+  g_ptr_array_sort(requests, mock_request_compare);
+  for (i = 0; i < requests->len; i++) {
+    mock_request_t *request = g_ptr_array_index(requests, i);
+    wm_log(wm, LOG_INFO, "%s: %8lu %s%s", __func__, request->count,
+           request->name, request->round_trip ? " (round trip)" : "");
+  }
+  wm_log(wm, LOG_INFO, "%s: %lu round trips, %lu one-way requests, %lu events",
+         __func__, wm->mock->round_trips, wm->mock->one_way,
+         wm->mock->dispatched);
+  g_ptr_array_free(requests, TRUE);
+} /* void wm_mock_report */
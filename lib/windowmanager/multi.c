@@ -0,0 +1,208 @@
+/*
+ * Several displays from one process.
+ *
+ * All library state lives in the wm_t, so any number of them can run side by
+ * side. The one thing Xlib keeps per process, the error handler, finds the
+ * wm_t for a Display through a locked registry (errors.c).
+ *
+ * wm_multi_add opens a display and wm_multi_run gives each display a thread
+ * of its own, which calls the setup function and then wm_main. Everything a
+ * display does happens on its thread, so there is no locking in the event
+ * path. Listeners run on the thread of the display the event came from; any
+ * state of the program's that they share between displays is the program's
+ * to lock.
+ *
+ * What displays do share is read-only: the theme and key bindings in a
+ * wm_shared_t. Key bindings are kept as keysyms and resolved to keycodes
+ * per display, since keyboard mappings differ between servers.
+ */
+
+#include "windowmanager.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct wm_display {
+  wm_t *wm;
+  wm_setup_func setup;
+  gpointer data;
+  pthread_t thread;
+  Bool started;
+} wm_display_t;
+
+struct wm_multi {
+  const wm_shared_t *shared;
+  GPtrArray *displays; /* wm_display_t */
+};
+
+static const wm_theme_t wm_default_theme = {
+  "fixed",
+  { "#000000", "#7F7F44" },
+  { "#FFFFFF", "#FFFFFF" },
+  "#FFFFFF",
+  "#999933",
+};
+
+static const wm_shared_t wm_default_shared = {
+  &wm_default_theme, NULL, 0
+};
+
+/* Lock and NumLock shouldn't change what a binding does */
+static const unsigned int wm_keys_ignored[] = {
+  0, LockMask, Mod2Mask, LockMask | Mod2Mask
+};
+
+void wm_set_shared(wm_t *wm, const wm_shared_t *shared) {
+  wm->shared = shared;
+} /* void wm_set_shared */
+
+/* The theme in use, with defaults filled in for any field left NULL. The
+ * result is owned by the wm_t. */
+const wm_theme_t *wm_get_theme(wm_t *wm) {
+  const wm_theme_t *theme;
+  wm_theme_t *merged;
+
+  if (wm->shared == NULL || wm->shared->theme == NULL)
+    return &wm_default_theme;
+  if (wm->theme != NULL)
+    return wm->theme;
+
+  theme = wm->shared->theme;
+  merged = malloc(sizeof(wm_theme_t));
+  memcpy(merged, &wm_default_theme, sizeof(wm_theme_t));
+  if (theme->title_font != NULL)
+    merged->title_font = theme->title_font;
+  if (theme->title_bg[False] != NULL)
+    merged->title_bg[False] = theme->title_bg[False];
+  if (theme->title_bg[True] != NULL)
+    merged->title_bg[True] = theme->title_bg[True];
+  if (theme->title_fg[False] != NULL)
+    merged->title_fg[False] = theme->title_fg[False];
+  if (theme->title_fg[True] != NULL)
+    merged->title_fg[True] = theme->title_fg[True];
+  if (theme->title_border != NULL)
+    merged->title_border = theme->title_border;
+  if (theme->frame_border != NULL)
+    merged->frame_border = theme->frame_border;
+  wm->theme = merged;
+  return merged;
+} /* const wm_theme_t *wm_get_theme */
+
+/* Grab every shared key binding on every root window of this display. */
+void wm_keys_grab(wm_t *wm) {
+  const wm_shared_t *shared = wm->shared;
+  unsigned int i, j;
+  int screen;
+
+  if (wm->dpy == NULL || shared == NULL)
+    return;
+
+  for (i = 0; i < shared->num_keys; i++) {
+    const wm_keybinding_t *key = &shared->keys[i];
+    KeyCode keycode = XKeysymToKeycode(wm->dpy, key->keysym);
+
+    if (keycode == 0) {
+      wm_log(wm, LOG_WARN, "%s: no key for keysym %lu (%s)", __func__,
+             key->keysym, key->action);
+      continue;
+    }
+    for (screen = 0; screen < wm->num_screens; screen++)
+      for (j = 0; j < G_N_ELEMENTS(wm_keys_ignored); j++)
+        XGrabKey(wm->dpy, keycode, key->modifiers | wm_keys_ignored[j],
+                 wm->screens[screen]->root, False, GrabModeAsync,
+                 GrabModeAsync);
+  }
+} /* void wm_keys_grab */
+
+/* The binding a key press is for, or NULL. */
+const wm_keybinding_t *wm_keys_lookup(wm_t *wm, XKeyEvent *ev) {
+  const wm_shared_t *shared = wm->shared;
+  unsigned int state = ev->state & ~(LockMask | Mod2Mask);
+  KeySym keysym;
+  unsigned int i;
+
+  if (shared == NULL)
+    return NULL;
+
+  keysym = XLookupKeysym(ev, 0);
+  for (i = 0; i < shared->num_keys; i++)
+    if (shared->keys[i].keysym == keysym && shared->keys[i].modifiers == state)
+      return &shared->keys[i];
+  return NULL;
+} /* const wm_keybinding_t *wm_keys_lookup */
+
+/* 'shared' may be NULL for the default theme and no key bindings. It has to
+ * outlive the displays. */
+wm_multi_t *wm_multi_new(const wm_shared_t *shared) {
+  wm_multi_t *multi;
+
+  /* Before any other Xlib call, and on one thread */
+  XInitThreads();
+
+  multi = calloc(1, sizeof(wm_multi_t));
+  multi->shared = (shared != NULL) ? shared : &wm_default_shared;
+  multi->displays = g_ptr_array_new();
+  return multi;
+} /* wm_multi_t *wm_multi_new */
+
+/* Open a display to be managed by wm_multi_run. 'setup' is called on the
+ * display's thread before its wm_main; it registers listeners and does
+ * anything else wm_main needs done first. If it returns False, the display
+ * isn't run. Returns the new wm_t. */
+wm_t *wm_multi_add(wm_multi_t *multi, const char *display_name,
+                   wm_setup_func setup, gpointer data) {
+  wm_display_t *display;
+  wm_t *wm;
+
+  wm = wm_new2((char *)display_name);
+  wm_set_shared(wm, multi->shared);
+  wm->log_prefix = strdup(DisplayString(wm->dpy));
+
+  display = calloc(1, sizeof(wm_display_t));
+  display->wm = wm;
+  display->setup = setup;
+  display->data = data;
+  g_ptr_array_add(multi->displays, display);
+  return wm;
+} /* wm_t *wm_multi_add */
+
+unsigned int wm_multi_count(wm_multi_t *multi) {
+  return multi->displays->len;
+} /* unsigned int wm_multi_count */
+
+static void *wm_multi_thread(void *arg) {
+  wm_display_t *display = arg;
+  wm_t *wm = display->wm;
+
+  if (display->setup != NULL && !display->setup(wm, display->data)) {
+    wm_log(wm, LOG_ERROR, "%s: setup failed, not managing this display",
+           __func__);
+    return NULL;
+  }
+  wm_main(wm);
+  return NULL;
+} /* static void *wm_multi_thread */
+
+/* Run every display on a thread of its own, and wait for them. Returns the
+ * number of displays that were started. */
+unsigned int wm_multi_run(wm_multi_t *multi) {
+  unsigned int i, started = 0;
+
+  for (i = 0; i < multi->displays->len; i++) {
+    wm_display_t *display = g_ptr_array_index(multi->displays, i);
+    if (pthread_create(&display->thread, NULL, wm_multi_thread, display) != 0) {
+      wm_log(display->wm, LOG_ERROR, "%s: pthread_create failed", __func__);
+      continue;
+    }
+    display->started = True;
+    started++;
+  }
+
+  for (i = 0; i < multi->displays->len; i++) {
+    wm_display_t *display = g_ptr_array_index(multi->displays, i);
+    if (display->started)
+      pthread_join(display->thread, NULL);
+  }
+  return started;
+} /* unsigned int wm_multi_run */
@@ -0,0 +1,197 @@
+/*
+ * Occlusion tracking.
+ *
+ * A client that is completely covered by the windows stacked above it in its
+ * container can't be seen, but it keeps drawing at full rate unless someone
+ * tells it. Using the stacking model (stack.c) and the geometry we already
+ * track, we work out which clients are covered and mark them with
+ * _NET_WM_STATE_HIDDEN. With WM_OCCLUSION_UNMAP they are also unmapped, which
+ * stops nearly every toolkit from drawing at all.
+ *
+ * Our own unmaps and maps are counted in client->ignore_unmaps and
+ * client->ignore_maps, so the notifies they cause don't look like the client
+ * withdrawing or mapping itself. wm_client_reparent and wm_client_unmap
+ * count theirs the same way.
+ *
+ * Only stacks inside a managed window (a container frame) are considered;
+ * top-level windows are left alone. Anything stacking, geometry or map state
+ * changes marks its parent, and wm_occlusion_update(), called once per batch
+ * from wm_main, recomputes those parents. This costs no round trips.
+ */
+
+#include "windowmanager.h"
+
+#include <stdlib.h>
+#include <X11/Xatom.h>
+
+struct wm_occlusion {
+  unsigned int mode;
+  GHashTable *dirty; /* parent Window -> parent Window, to recompute */
+  Atom net_wm_state;
+  Atom net_wm_state_hidden;
+};
+
+void wm_occlusion_init(wm_t *wm) {
+  wm->occlusion = calloc(1, sizeof(struct wm_occlusion));
+  wm->occlusion->mode = WM_OCCLUSION_HIDDEN;
+  wm->occlusion->dirty = g_hash_table_new(g_direct_hash, g_direct_equal);
+} /* void wm_occlusion_init */
+
+void wm_occlusion_mark(wm_t *wm, Window parent) {
+  if (wm->occlusion == NULL || wm->occlusion->mode == WM_OCCLUSION_OFF
+      || parent == None)
+    return;
+  g_hash_table_insert(wm->occlusion->dirty, GUINT_TO_POINTER(parent),
+                      GUINT_TO_POINTER(parent));
+} /* void wm_occlusion_mark */
+
+void wm_occlusion_mark_client(wm_t *wm, client_t *client) {
+  wm_occlusion_mark(wm, client->container);
+} /* void wm_occlusion_mark_client */
+
+static void wm_occlusion_atoms(wm_t *wm) {
+  struct wm_occlusion *occlusion = wm->occlusion;
+
+  if (occlusion->net_wm_state != None)
+    return;
+  occlusion->net_wm_state = wm_x_intern_atom(wm, "_NET_WM_STATE", False);
+  occlusion->net_wm_state_hidden = wm_x_intern_atom(wm, "_NET_WM_STATE_HIDDEN",
+                                                    False);
+} /* static void wm_occlusion_atoms */
+
+/* Write the client's _NET_WM_STATE (client->net_wm_state, kept by
+ * wm_client_fetch) back with or without _NET_WM_STATE_HIDDEN, leaving the
+ * other states in it alone. */
+static void wm_occlusion_set_hidden(wm_t *wm, client_t *client, Bool hidden) {
+  struct wm_occlusion *occlusion = wm->occlusion;
+  Atom *state;
+  unsigned long i, n = 0;
+
+  wm_occlusion_atoms(wm);
+  state = malloc((client->net_wm_state_len + 1) * sizeof(Atom));
+  for (i = 0; i < client->net_wm_state_len; i++)
+    if (client->net_wm_state[i] != occlusion->net_wm_state_hidden)
+      state[n++] = client->net_wm_state[i];
+  if (hidden)
+    state[n++] = occlusion->net_wm_state_hidden;
+
+  if (n > 0)
+    wm_x_change_property(wm, client->window, occlusion->net_wm_state, XA_ATOM,
+                         32, PropModeReplace, (unsigned char *)state, n);
+  else
+    wm_x_delete_property(wm, client->window, occlusion->net_wm_state);
+  free(state);
+} /* static void wm_occlusion_set_hidden */
+
+static void wm_occlusion_hide(wm_t *wm, client_t *client) {
+  struct wm_occlusion *occlusion = wm->occlusion;
+
+  if (client->flags & CLIENT_OCCLUDED)
+    return;
+  wm_log(wm, LOG_INFO, "%s: window %ld is covered", __func__, client->window);
+  client->flags |= CLIENT_OCCLUDED;
+  wm_occlusion_set_hidden(wm, client, True);
+  if (occlusion->mode == WM_OCCLUSION_UNMAP) {
+    client->ignore_unmaps++;
+    wm_x_unmap_window(wm, client->window);
+  }
+  wm_shm_mark_dirty(wm);
+} /* static void wm_occlusion_hide */
+
+/* Undo wm_occlusion_hide. wm_stack_raise calls this right away, so a client
+ * raised by a listener is mapped again before anything else (like focusing
+ * it) is asked of it. */
+void wm_occlusion_reveal(wm_t *wm, client_t *client) {
+  struct wm_occlusion *occlusion = wm->occlusion;
+
+  if (occlusion == NULL || !(client->flags & CLIENT_OCCLUDED))
+    return;
+  wm_log(wm, LOG_INFO, "%s: window %ld is uncovered", __func__, client->window);
+  client->flags &= ~(CLIENT_OCCLUDED);
+  wm_occlusion_set_hidden(wm, client, False);
+  if (occlusion->mode == WM_OCCLUSION_UNMAP) {
+    client->ignore_maps++;
+    wm_x_map_window(wm, client->window);
+  }
+  wm_shm_mark_dirty(wm);
+} /* void wm_occlusion_reveal */
+
+/* The client was mapped by someone other than us, perhaps while we had it
+ * unmapped. Forget what we did to it and work it out again. */
+void wm_occlusion_mapped(wm_t *wm, client_t *client) {
+  if (wm->occlusion == NULL)
+    return;
+  if (client->flags & CLIENT_OCCLUDED) {
+    client->flags &= ~(CLIENT_OCCLUDED);
+    wm_occlusion_set_hidden(wm, client, False);
+  }
+  wm_occlusion_mark_client(wm, client);
+} /* void wm_occlusion_mapped */
+
+/* Walk the children of 'parent' from the top down, collecting the area
+ * covered so far. A client entirely inside it is occluded. */
+static void wm_occlusion_update_one(wm_t *wm, Window parent) {
+  const GQueue *order = wm_stack_order(wm, parent);
+  Region covered;
+  GList *link;
+
+  if (order == NULL || wm_get_client(wm, parent, False) == NULL)
+    return;
+
+  covered = XCreateRegion();
+  for (link = order->tail; link != NULL; link = link->prev) {
+    client_t *client = wm_get_client(wm, GPOINTER_TO_UINT(link->data), False);
+    XRectangle rect;
+
+    if (client == NULL || !(client->flags & CLIENT_VISIBLE)
+        || client->attr.override_redirect)
+      continue;
+
+    rect.x = client->attr.x;
+    rect.y = client->attr.y;
+    rect.width = client->attr.width + 2 * client->attr.border_width;
+    rect.height = client->attr.height + 2 * client->attr.border_width;
+    if (XRectInRegion(covered, rect.x, rect.y, rect.width, rect.height)
+        == RectangleIn)
+      wm_occlusion_hide(wm, client);
+    else
+      wm_occlusion_reveal(wm, client);
+
+    /* A 32-bit visual may be translucent and hides nothing below it */
+    if (client->attr.depth != 32)
+      XUnionRectWithRegion(&rect, covered, covered);
+  }
+  XDestroyRegion(covered);
+} /* static void wm_occlusion_update_one */
+
+void wm_occlusion_update(wm_t *wm) {
+  GHashTableIter iter;
+  gpointer parent;
+
+  if (wm->occlusion == NULL || g_hash_table_size(wm->occlusion->dirty) == 0)
+    return;
+
+  g_hash_table_iter_init(&iter, wm->occlusion->dirty);
+  while (g_hash_table_iter_next(&iter, &parent, NULL))
+    wm_occlusion_update_one(wm, GPOINTER_TO_UINT(parent));
+  g_hash_table_remove_all(wm->occlusion->dirty);
+} /* void wm_occlusion_update */
+
+/* Switching modes reveals everything under the old mode, then recomputes
+ * under the new one. */
+void wm_occlusion_set_mode(wm_t *wm, unsigned int mode) {
+  GHashTableIter iter;
+  gpointer value;
+
+  if (wm->occlusion == NULL || wm->occlusion->mode == mode)
+    return;
+
+  g_hash_table_iter_init(&iter, wm->clients);
+  while (g_hash_table_iter_next(&iter, NULL, &value))
+    wm_occlusion_reveal(wm, value);
+
+  wm->occlusion->mode = mode;
+  g_hash_table_iter_init(&iter, wm->clients);
+  while (g_hash_table_iter_next(&iter, NULL, &value))
+    wm_occlusion_mark_client(wm, value);
+} /* void wm_occlusion_set_mode */
@@ -0,0 +1,319 @@
+/*
+ * Where applications were last put, kept across restarts.
+ *
+ * The store is a small file of fixed-size records, an open-addressed hash
+ * table keyed by WM_CLASS class and WM_WINDOW_ROLE, mapped shared into
+ * memory. A lookup hashes the client's strings and probes the mapping in
+ * place, so a MapRequest listener can ask where a window goes without
+ * allocating or making a system call.
+ *
+ * The class and role are fetched (worker.c) when the window is created, and
+ * have usually come in by the time it asks to be mapped. If they haven't,
+ * wm_place_hold keeps the MapRequest from the listeners until they do, or
+ * until WM_PLACE_HOLD_MS has passed, rather than asking the server for them
+ * on the main thread.
+ *
+ * What a record means is up to the program: it holds a screen and a
+ * rectangle in root coordinates, normally those of the container the
+ * client was put in. wm_place_record only writes into the mapping; the
+ * kernel writes it back, and an idle callback (idle.c) asks it to start
+ * with msync(MS_ASYNC) once the event queue is empty.
+ *
+ * Keys longer than the record's fields are cut short, and the full key's
+ * hash is kept to tell them apart. When a key's probe sequence is full, the
+ * least recently used record in it is replaced.
+ */
+
+#include "windowmanager.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define WM_PLACE_MAGIC 0x574d504cU /* 'WMPL' */
+#define WM_PLACE_VERSION 1U
+#define WM_PLACE_SLOTS 1024U /* a power of two */
+#define WM_PLACE_PROBE 8U /* slots looked at per key */
+#define WM_PLACE_CLASS_MAX 64
+#define WM_PLACE_ROLE_MAX 64
+#define WM_PLACE_FILE ".ifwm-placement"
+#define WM_PLACE_HOLD_MS 50U /* longest a MapRequest waits for the key */
+#define WM_PLACE_KEY (WM_FETCH_CLASS | WM_FETCH_ROLE)
+
+typedef struct place_header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t slots;
+  uint32_t record_size;
+} place_header_t;
+
+typedef struct place_record {
+  uint64_t hash; /* 0 for an empty slot */
+  int64_t used; /* g_get_real_time() of the last record or hit */
+  int32_t screen;
+  int32_t x, y;
+  uint32_t width, height;
+  uint32_t pad;
+  char res_class[WM_PLACE_CLASS_MAX];
+  char role[WM_PLACE_ROLE_MAX];
+} place_record_t;
+
+struct wm_places {
+  place_header_t *header; /* the mapping; NULL until wm_place_open */
+  place_record_t *records;
+  size_t size;
+  Bool sync_pending;
+
+  unsigned long hits;
+  unsigned long misses;
+  unsigned long writes;
+};
+
+void wm_place_init(wm_t *wm) {
+  wm->places = calloc(1, sizeof(struct wm_places));
+} /* void wm_place_init */
+
+/* Map the store at 'path', or ~/.ifwm-placement if 'path' is NULL,
+ * creating it if it doesn't exist. A file of another version or size is
+ * started over. Returns False (and lookups just miss) if it can't be
+ * mapped. */
+Bool wm_place_open(wm_t *wm, const char *path) {
+  struct wm_places *places = wm->places;
+  char default_path[PATH_MAX];
+  place_header_t *header;
+  struct stat st;
+  size_t size;
+  int fd;
+
+  if (path == NULL) {
+    const char *home = getenv("HOME");
+    if (home == NULL)
+      return False;
+    snprintf(default_path, sizeof(default_path), "%s/%s", home,
+             WM_PLACE_FILE);
+    path = default_path;
+  }
+
+  size = sizeof(place_header_t) + WM_PLACE_SLOTS * sizeof(place_record_t);
+  fd = open(path, O_RDWR | O_CREAT, 0600);
+  if (fd < 0 || fstat(fd, &st) < 0) {
+    wm_log(wm, LOG_WARN, "%s: %s: %s", __func__, path, strerror(errno));
+    if (fd >= 0)
+      close(fd);
+    return False;
+  }
+  if ((size_t)st.st_size != size
+      && (ftruncate(fd, 0) < 0 || ftruncate(fd, size) < 0)) {
+    wm_log(wm, LOG_WARN, "%s: %s: %s", __func__, path, strerror(errno));
+    close(fd);
+    return False;
+  }
+  header = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (header == MAP_FAILED) {
+    wm_log(wm, LOG_WARN, "%s: mmap %s: %s", __func__, path, strerror(errno));
+    return False;
+  }
+
+  if (header->magic != WM_PLACE_MAGIC || header->version != WM_PLACE_VERSION
+      || header->slots != WM_PLACE_SLOTS
+      || header->record_size != sizeof(place_record_t)) {
+    wm_log(wm, LOG_INFO, "%s: starting %s over", __func__, path);
+    memset(header, 0, size);
+    header->magic = WM_PLACE_MAGIC;
+    header->version = WM_PLACE_VERSION;
+    header->slots = WM_PLACE_SLOTS;
+    header->record_size = sizeof(place_record_t);
+  }
+
+  if (places->header != NULL)
+    munmap(places->header, places->size);
+  places->header = header;
+  places->records = (place_record_t *)(header + 1);
+  places->size = size;
+  return True;
+} /* Bool wm_place_open */
+
+/* FNV-1a over class, a NUL, then role; never 0, which marks empty slots */
+static uint64_t wm_place_hash(const char *res_class, const char *role) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  const unsigned char *p;
+
+  for (p = (const unsigned char *)res_class; *p != '\0'; p++)
+    hash = (hash ^ *p) * 0x100000001b3ULL;
+  hash *= 0x100000001b3ULL;
+  for (p = (const unsigned char *)role; *p != '\0'; p++)
+    hash = (hash ^ *p) * 0x100000001b3ULL;
+  return (hash != 0) ? hash : 1;
+} /* static uint64_t wm_place_hash */
+
+static Bool wm_place_match(place_record_t *record, uint64_t hash,
+                           const char *res_class, const char *role) {
+  return record->hash == hash
+         && strncmp(record->res_class, res_class, WM_PLACE_CLASS_MAX - 1) == 0
+         && strncmp(record->role, role, WM_PLACE_ROLE_MAX - 1) == 0;
+} /* static Bool wm_place_match */
+
+/* The record for the key, or NULL. If 'slot' isn't NULL it gets where the
+ * key would go instead: an empty slot, else the least recently used one. */
+static place_record_t *wm_place_find(struct wm_places *places,
+                                     const char *res_class, const char *role,
+                                     uint64_t hash, place_record_t **slot) {
+  place_record_t *victim = NULL;
+  unsigned int i;
+
+  for (i = 0; i < WM_PLACE_PROBE; i++) {
+    place_record_t *record =
+      &places->records[(hash + i) & (WM_PLACE_SLOTS - 1)];
+
+    if (record->hash == 0) {
+      /* Nothing is ever removed, so the key isn't further on */
+      if (slot != NULL)
+        *slot = record;
+      return NULL;
+    }
+    if (wm_place_match(record, hash, res_class, role))
+      return record;
+    if (victim == NULL || record->used < victim->used)
+      victim = record;
+  }
+  if (slot != NULL)
+    *slot = victim;
+  return NULL;
+} /* static place_record_t *wm_place_find */
+
+static int wm_place_screen_number(wm_t *wm, Screen *screen) {
+  int i;
+
+  for (i = 0; i < wm->num_screens; i++)
+    if (wm->screens[i] == screen)
+      return i;
+  return 0;
+} /* static int wm_place_screen_number */
+
+/* Where 'client' was last put. Returns False if the store has nothing for
+ * it, or it has no WM_CLASS. Doesn't allocate, so it's cheap enough for a
+ * MapRequest listener. */
+Bool wm_place_lookup(wm_t *wm, client_t *client, wm_place_t *place) {
+  struct wm_places *places = wm->places;
+  const char *role;
+  place_record_t *record;
+
+  if (places->header == NULL || client->res_class == NULL)
+    return False;
+  role = (client->role != NULL) ? client->role : "";
+  record = wm_place_find(places, client->res_class, role,
+                         wm_place_hash(client->res_class, role), NULL);
+  if (record == NULL || record->screen < 0
+      || record->screen >= wm->num_screens) {
+    places->misses++;
+    return False;
+  }
+  record->used = g_get_real_time();
+  place->screen = wm->screens[record->screen];
+  place->x = record->x;
+  place->y = record->y;
+  place->width = record->width;
+  place->height = record->height;
+  places->hits++;
+  return True;
+} /* Bool wm_place_lookup */
+
+static void wm_place_release(wm_t *wm, client_t *client) {
+  client->map_held = 0;
+  wm_listener_call(wm, WM_EVENT_WINDOW_MAP_REQUEST, client, NULL);
+} /* static void wm_place_release */
+
+static void wm_place_hold_expired(wm_t *wm, client_t *client, gpointer data) {
+  wm_log(wm, LOG_INFO, "%s: window %ld: no class after %ums, mapping anyway",
+         __func__, client->window, WM_PLACE_HOLD_MS);
+  wm_place_release(wm, client);
+} /* static void wm_place_hold_expired */
+
+/* Called by wm_event_maprequest before telling the listeners. If the store
+ * is open and the client's class or role hasn't come in yet, the request
+ * is held and True returned; the listeners get it (with a NULL xevent)
+ * from wm_place_fetched or a timer instead. */
+Bool wm_place_hold(wm_t *wm, client_t *client) {
+  if (client->map_held != 0)
+    return True;
+  if (wm->places->header == NULL
+      || (client->fetched & WM_PLACE_KEY) == WM_PLACE_KEY)
+    return False;
+  client->map_held = wm_timer_add(wm, WM_PLACE_HOLD_MS, client,
+                                  wm_place_hold_expired, NULL);
+  return True;
+} /* Bool wm_place_hold */
+
+/* Called by wm_fetch_apply: lets a held MapRequest through once the key is
+ * in. */
+void wm_place_fetched(wm_t *wm, client_t *client) {
+  if (client->map_held == 0
+      || (client->fetched & WM_PLACE_KEY) != WM_PLACE_KEY)
+    return;
+  wm_timer_cancel(wm, client->map_held);
+  wm_place_release(wm, client);
+} /* void wm_place_fetched */
+
+static void wm_place_sync(wm_t *wm, gpointer data) {
+  struct wm_places *places = wm->places;
+
+  places->sync_pending = False;
+  if (places->header != NULL)
+    msync(places->header, places->size, MS_ASYNC);
+} /* static void wm_place_sync */
+
+/* Remember 'place' for clients like 'client'. Replays don't write. */
+void wm_place_record(wm_t *wm, client_t *client, const wm_place_t *place) {
+  struct wm_places *places = wm->places;
+  const char *role;
+  place_record_t *record, *slot = NULL;
+  int screen = wm_place_screen_number(wm, place->screen);
+  uint64_t hash;
+
+  role = (client->role != NULL) ? client->role : "";
+  if (places->header == NULL || client->res_class == NULL
+      || wm_eventlog_replaying(wm))
+    return;
+  hash = wm_place_hash(client->res_class, role);
+  record = wm_place_find(places, client->res_class, role, hash, &slot);
+  if (record != NULL) {
+    record->used = g_get_real_time();
+    if (record->screen == screen && record->x == place->x
+        && record->y == place->y && record->width == place->width
+        && record->height == place->height)
+      return;
+  } else {
+    record = slot;
+    memset(record, 0, sizeof(place_record_t));
+    record->hash = hash;
+    strncpy(record->res_class, client->res_class, WM_PLACE_CLASS_MAX - 1);
+    strncpy(record->role, role, WM_PLACE_ROLE_MAX - 1);
+    record->used = g_get_real_time();
+  }
+  record->screen = screen;
+  record->x = place->x;
+  record->y = place->y;
+  record->width = place->width;
+  record->height = place->height;
+  places->writes++;
+
+  if (!places->sync_pending) {
+    places->sync_pending = True;
+    wm_idle_add(wm, WM_IDLE_LOW, wm_place_sync, NULL);
+  }
+} /* void wm_place_record */
+
+void wm_place_stats(wm_t *wm, unsigned long *hits, unsigned long *misses,
+                    unsigned long *writes) {
+  *hits = wm->places->hits;
+  *misses = wm->places->misses;
+  *writes = wm->places->writes;
+} /* void wm_place_stats */
@@ -0,0 +1,159 @@
+/*
+ * Pointer position, tracked from events.
+ *
+ * Every button, key, motion and crossing event carries where the pointer
+ * was, in root coordinates and relative to the event window. wm_dispatch
+ * hands each one to wm_pointer_event, so the library always knows where the
+ * pointer was last seen without asking the server. At a button press that
+ * is exactly where it is, which is all starting a drag needs.
+ *
+ * Between events the pointer may move without us hearing about it (we don't
+ * select motion on client windows), so the position is the last one seen,
+ * not the current one. When someone else grabs the pointer, we stop seeing
+ * events at all until the grab ends; the state is stale in between, and
+ * wm_pointer_get falls back to XQueryPointer. So it does before the first
+ * event, and for windows whose position we don't know.
+ */
+
+#include "windowmanager.h"
+
+#include <stdlib.h>
+
+struct wm_pointer {
+  Bool known; /* False until the first event, and during others' grabs */
+  Window root;
+  Window window; /* the event window 'x' and 'y' are relative to */
+  int root_x, root_y;
+  int x, y;
+
+  unsigned long updates;
+  unsigned long queries;
+};
+
+void wm_pointer_init(wm_t *wm) {
+  wm->pointer = calloc(1, sizeof(struct wm_pointer));
+} /* void wm_pointer_init */
+
+static void wm_pointer_set(wm_t *wm, Window root, Window window, int root_x,
+                           int root_y, int x, int y) {
+  struct wm_pointer *pointer = wm->pointer;
+
+  pointer->known = True;
+  pointer->root = root;
+  pointer->window = window;
+  pointer->root_x = root_x;
+  pointer->root_y = root_y;
+  pointer->x = x;
+  pointer->y = y;
+  pointer->updates++;
+} /* static void wm_pointer_set */
+
+/* Forget the position, so the next wm_pointer_get asks the server. */
+void wm_pointer_forget(wm_t *wm) {
+  if (wm->pointer != NULL)
+    wm->pointer->known = False;
+} /* void wm_pointer_forget */
+
+/* Note where 'ev' says the pointer is, if it says. */
+void wm_pointer_event(wm_t *wm, XEvent *ev) {
+  if (wm->pointer == NULL)
+    return;
+
+  switch (ev->type) {
+    case KeyPress:
+    case KeyRelease:
+      if (ev->xkey.same_screen)
+        wm_pointer_set(wm, ev->xkey.root, ev->xkey.window, ev->xkey.x_root,
+                       ev->xkey.y_root, ev->xkey.x, ev->xkey.y);
+      break;
+    case ButtonPress:
+    case ButtonRelease:
+      if (ev->xbutton.same_screen)
+        wm_pointer_set(wm, ev->xbutton.root, ev->xbutton.window,
+                       ev->xbutton.x_root, ev->xbutton.y_root,
+                       ev->xbutton.x, ev->xbutton.y);
+      break;
+    case MotionNotify:
+      if (ev->xmotion.same_screen)
+        wm_pointer_set(wm, ev->xmotion.root, ev->xmotion.window,
+                       ev->xmotion.x_root, ev->xmotion.y_root,
+                       ev->xmotion.x, ev->xmotion.y);
+      break;
+    case EnterNotify:
+    case LeaveNotify:
+      /* Not on this screen; the coordinates mean nothing */
+      if (!ev->xcrossing.same_screen) {
+        wm_pointer_forget(wm);
+        break;
+      }
+      wm_pointer_set(wm, ev->xcrossing.root, ev->xcrossing.window,
+                     ev->xcrossing.x_root, ev->xcrossing.y_root,
+                     ev->xcrossing.x, ev->xcrossing.y);
+      /* Someone grabbed the pointer; we won't hear of it until the grab
+       * ends with a NotifyUngrab crossing. */
+      if (ev->xcrossing.mode == NotifyGrab)
+        wm_pointer_forget(wm);
+      break;
+  }
+} /* void wm_pointer_event */
+
+/* Where the inside of 'window' starts in root coordinates, from the client
+ * table. False if some window on the way up isn't a client we know. */
+static Bool wm_pointer_origin(wm_t *wm, Window window, int *x, int *y) {
+  client_t *client = wm_get_client(wm, window, False);
+
+  *x = 0;
+  *y = 0;
+  while (client != NULL) {
+    *x += client->attr.x + client->attr.border_width;
+    *y += client->attr.y + client->attr.border_width;
+    if (client->container == None)
+      return True;
+    client = wm_get_client(wm, client->container, False);
+  }
+  return False;
+} /* static Bool wm_pointer_origin */
+
+/* The pointer position relative to 'window', and the root it's on. Costs a
+ * round trip only when the position isn't known or 'window' is neither a
+ * root, the window of the last pointer event nor a client. Returns False if
+ * the pointer isn't on the same screen as 'window'. */
+Bool wm_pointer_get(wm_t *wm, Window window, Window *root, int *x, int *y) {
+  struct wm_pointer *pointer = wm->pointer;
+  Window child;
+  unsigned int mask;
+  int root_x, root_y, origin_x, origin_y;
+  Bool same_screen;
+
+  if (pointer->known) {
+    *root = pointer->root;
+    if (window == pointer->root) {
+      *x = pointer->root_x;
+      *y = pointer->root_y;
+      return True;
+    }
+    if (window == pointer->window) {
+      *x = pointer->x;
+      *y = pointer->y;
+      return True;
+    }
+    if (wm_pointer_origin(wm, window, &origin_x, &origin_y)) {
+      *x = pointer->root_x - origin_x;
+      *y = pointer->root_y - origin_y;
+      return True;
+    }
+  }
+
+  pointer->queries++;
+  same_screen = wm_x_query_pointer(wm, window, root, &child, &root_x, &root_y,
+                                   x, y, &mask);
+  if (same_screen)
+    wm_pointer_set(wm, *root, window, root_x, root_y, *x, *y);
+  return same_screen;
+} /* Bool wm_pointer_get */
+
+void wm_pointer_stats(wm_t *wm, unsigned long *updates,
+                      unsigned long *queries) {
+  *updates = wm->pointer->updates;
+  *queries = wm->pointer->queries;
+} /* void wm_pointer_stats */
@@ -0,0 +1,658 @@
+/*
+ * Python bindings for libwindowmanager.
+ *
+ * Event decoding, dispatch, the client table and title drawing stay in C;
+ * Python registers listeners and drives layout through a handful of calls.
+ * wm_main runs with the GIL released, and it is only taken back while a
+ * Python listener runs, so the interpreter sees one call per libwindowmanager
+ * event rather than one per X event.
+ *
+ *   import windowmanager
+ *   wm = windowmanager.WindowManager()
+ *   def mapped(wm, event):
+ *     client = event["client"]
+ *     wm.set_tiled(client.window, True)
+ *     wm.moveresize(client.window, 0, 15, 640, 465)
+ *     wm.map_window(client.window)
+ *   wm.add_listener(windowmanager.EVENT_WINDOW_MAP_REQUEST, mapped)
+ *   wm.main()
+ *
+ * Builds against Python 2 and 3; see the windowmanager.so Makefile target.
+ */
+
+#include <Python.h>
+
+#include "windowmanager.h"
+
+#include <string.h>
+
+#if PY_MAJOR_VERSION >= 3
+#define PyWM_FromString PyUnicode_FromString
+#else
+#define PyWM_FromString PyString_FromString
+#endif
+
+typedef struct {
+  PyObject_HEAD
+  wm_t *wm;
+} PyWM;
+
+typedef struct {
+  PyObject_HEAD
+  PyWM *owner;
+  Window window;
+} PyWMClient;
+
+/* Passed as the listener data for each Python listener */
+typedef struct pywm_listener {
+  PyWM *owner;
+  PyObject *callback;
+} pywm_listener_t;
+
+static PyTypeObject PyWMType;
+static PyTypeObject PyWMClientType;
+
+static PyObject *pywm_client_new(PyWM *owner, Window window) {
+  PyWMClient *client;
+
+  client = PyObject_New(PyWMClient, &PyWMClientType);
+  if (client == NULL)
+    return NULL;
+  Py_INCREF(owner);
+  client->owner = owner;
+  client->window = window;
+  return (PyObject *)client;
+} /* static PyObject *pywm_client_new */
+
+static void pywm_client_dealloc(PyWMClient *self) {
+  Py_XDECREF(self->owner);
+  PyObject_Del(self);
+} /* static void pywm_client_dealloc */
+
+/* Client objects hold only the window id; the client itself can go away at
+ * any time, so every attribute access looks it up again. */
+static client_t *pywm_client_get(PyWMClient *self) {
+  client_t *client = wm_get_client(self->owner->wm, self->window, False);
+  if (client == NULL)
+    PyErr_Format(PyExc_LookupError, "window %lu is no longer a client",
+                 self->window);
+  return client;
+} /* static client_t *pywm_client_get */
+
+static PyObject *pywm_string_or_none(const char *value) {
+  if (value == NULL)
+    Py_RETURN_NONE;
+  return PyWM_FromString(value);
+}
+
+static PyObject *pywm_client_getattr(PyWMClient *self, void *closure) {
+  const char *name = closure;
+  client_t *client;
+
+  if (strcmp(name, "window") == 0)
+    return PyLong_FromUnsignedLong(self->window);
+
+  client = pywm_client_get(self);
+  if (client == NULL)
+    return NULL;
+
+  if (strcmp(name, "name") == 0)
+    return pywm_string_or_none(client->name);
+  if (strcmp(name, "res_name") == 0)
+    return pywm_string_or_none(client->res_name);
+  if (strcmp(name, "res_class") == 0)
+    return pywm_string_or_none(client->res_class);
+  if (strcmp(name, "role") == 0)
+    return pywm_string_or_none(client->role);
+  if (strcmp(name, "container") == 0)
+    return PyLong_FromUnsignedLong(client->container);
+  if (strcmp(name, "flags") == 0)
+    return PyLong_FromUnsignedLong(client->flags);
+  if (strcmp(name, "screen") == 0)
+    return PyLong_FromLong(XScreenNumberOfScreen(client->screen));
+  if (strcmp(name, "geometry") == 0)
+    return Py_BuildValue("(iiii)", client->attr.x, client->attr.y,
+                         client->attr.width, client->attr.height);
+
+  PyErr_SetString(PyExc_AttributeError, name);
+  return NULL;
+} /* static PyObject *pywm_client_getattr */
+
+static PyObject *pywm_client_repr(PyWMClient *self) {
+  char buf[64];
+  snprintf(buf, sizeof(buf), "<windowmanager.Client 0x%lx>", self->window);
+  return PyWM_FromString(buf);
+}
+
+static PyGetSetDef pywm_client_getset[] = {
+  { "window", (getter)pywm_client_getattr, NULL, "X window id", "window" },
+  { "name", (getter)pywm_client_getattr, NULL, "window title", "name" },
+  { "res_name", (getter)pywm_client_getattr, NULL, "WM_CLASS name", "res_name" },
+  { "res_class", (getter)pywm_client_getattr, NULL, "WM_CLASS class", "res_class" },
+  { "role", (getter)pywm_client_getattr, NULL, "WM_WINDOW_ROLE", "role" },
+  { "container", (getter)pywm_client_getattr, NULL, "parent window, 0 for the root", "container" },
+  { "flags", (getter)pywm_client_getattr, NULL, "CLIENT_* flags", "flags" },
+  { "screen", (getter)pywm_client_getattr, NULL, "screen number", "screen" },
+  { "geometry", (getter)pywm_client_getattr, NULL, "(x, y, width, height)", "geometry" },
+  { NULL }
+};
+
+/* Turn a libwindowmanager event into a dict for Python listeners. Only the
+ * fields listeners are likely to need are decoded. */
+static PyObject *pywm_event_dict(PyWM *owner, wm_event_t *event) {
+  PyObject *dict, *client;
+  XEvent *ev = event->xevent;
+
+  dict = PyDict_New();
+  if (dict == NULL)
+    return NULL;
+
+  client = pywm_client_new(owner, event->client->window);
+  PyDict_SetItemString(dict, "client", client);
+  Py_XDECREF(client);
+
+#define SET(key, value) do { \
+    PyObject *tmp = (value); \
+    PyDict_SetItemString(dict, key, tmp); \
+    Py_XDECREF(tmp); \
+  } while (0)
+
+  SET("id", PyLong_FromUnsignedLong(event->event_id));
+  if (ev == NULL)
+    return dict;
+
+  SET("type", PyLong_FromLong(ev->type));
+  switch (ev->type) {
+    case KeyPress:
+    case KeyRelease:
+      SET("keycode", PyLong_FromUnsignedLong(ev->xkey.keycode));
+      SET("keysym", PyLong_FromUnsignedLong(XLookupKeysym(&ev->xkey, 0)));
+      SET("state", PyLong_FromUnsignedLong(ev->xkey.state));
+      break;
+    case ButtonPress:
+    case ButtonRelease:
+      SET("button", PyLong_FromUnsignedLong(ev->xbutton.button));
+      SET("state", PyLong_FromUnsignedLong(ev->xbutton.state));
+      SET("x", PyLong_FromLong(ev->xbutton.x));
+      SET("y", PyLong_FromLong(ev->xbutton.y));
+      break;
+    case Expose:
+      SET("x", PyLong_FromLong(ev->xexpose.x));
+      SET("y", PyLong_FromLong(ev->xexpose.y));
+      SET("width", PyLong_FromLong(ev->xexpose.width));
+      SET("height", PyLong_FromLong(ev->xexpose.height));
+      SET("count", PyLong_FromLong(ev->xexpose.count));
+      break;
+    case PropertyNotify:
+      SET("atom", PyLong_FromUnsignedLong(ev->xproperty.atom));
+      break;
+    case EnterNotify:
+    case LeaveNotify:
+      SET("detail", PyLong_FromLong(ev->xcrossing.detail));
+      break;
+  }
+#undef SET
+  return dict;
+} /* static PyObject *pywm_event_dict */
+
+static Bool pywm_listener(wm_t *wm, wm_event_t *event, gpointer data) {
+  pywm_listener_t *listener = data;
+  PyGILState_STATE gil;
+  PyObject *pyevent, *result;
+  Bool ret = False;
+
+  gil = PyGILState_Ensure();
+  pyevent = pywm_event_dict(listener->owner, event);
+  if (pyevent != NULL) {
+    result = PyObject_CallFunctionObjArgs(listener->callback,
+                                          (PyObject *)listener->owner,
+                                          pyevent, NULL);
+    Py_DECREF(pyevent);
+    if (result != NULL) {
+      ret = PyObject_IsTrue(result) ? True : False;
+      Py_DECREF(result);
+    }
+  }
+  /* There's no one to raise to; report it and keep the WM running. */
+  if (PyErr_Occurred())
+    PyErr_Print();
+  PyGILState_Release(gil);
+  return ret;
+} /* static Bool pywm_listener */
+
+static int pywm_init(PyWM *self, PyObject *args, PyObject *kwds) {
+  static char *kwlist[] = { "display", NULL };
+  char *display_name = NULL;
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|z", kwlist, &display_name))
+    return -1;
+  if (self->wm != NULL) {
+    PyErr_SetString(PyExc_RuntimeError, "WindowManager already initialized");
+    return -1;
+  }
+  self->wm = wm_new2(display_name);
+  return 0;
+} /* static int pywm_init */
+
+/* The wm_t is never freed: libwindowmanager has no teardown, and listeners
+ * registered with it hold references to this object anyway. */
+static void pywm_dealloc(PyWM *self) {
+  Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static PyObject *pywm_main(PyWM *self, PyObject *unused) {
+  Py_BEGIN_ALLOW_THREADS
+  wm_main(self->wm);
+  Py_END_ALLOW_THREADS
+  Py_RETURN_NONE;
+} /* static PyObject *pywm_main */
+
+static PyObject *pywm_add_listener(PyWM *self, PyObject *args) {
+  unsigned int event_id;
+  PyObject *callback;
+  pywm_listener_t *listener;
+
+  if (!PyArg_ParseTuple(args, "IO", &event_id, &callback))
+    return NULL;
+  if (event_id < WM_EVENT_MIN || event_id > WM_EVENT_MAX) {
+    PyErr_Format(PyExc_ValueError, "no such event %u", event_id);
+    return NULL;
+  }
+  if (!PyCallable_Check(callback)) {
+    PyErr_SetString(PyExc_TypeError, "listener must be callable");
+    return NULL;
+  }
+
+  listener = malloc(sizeof(pywm_listener_t));
+  Py_INCREF(self);
+  Py_INCREF(callback);
+  listener->owner = self;
+  listener->callback = callback;
+  wm_listener_add(self->wm, event_id, pywm_listener, listener);
+  Py_RETURN_NONE;
+} /* static PyObject *pywm_add_listener */
+
+static PyObject *pywm_clients(PyWM *self, PyObject *unused) {
+  GHashTableIter iter;
+  gpointer key;
+  PyObject *list;
+
+  list = PyList_New(0);
+  if (list == NULL)
+    return NULL;
+  g_hash_table_iter_init(&iter, self->wm->clients);
+  while (g_hash_table_iter_next(&iter, &key, NULL)) {
+    PyObject *client = pywm_client_new(self, GPOINTER_TO_UINT(key));
+    if (client == NULL || PyList_Append(list, client) < 0) {
+      Py_XDECREF(client);
+      Py_DECREF(list);
+      return NULL;
+    }
+    Py_DECREF(client);
+  }
+  return list;
+} /* static PyObject *pywm_clients */
+
+static PyObject *pywm_get_client(PyWM *self, PyObject *args) {
+  unsigned long window;
+
+  if (!PyArg_ParseTuple(args, "k", &window))
+    return NULL;
+  if (wm_get_client(self->wm, window, False) == NULL)
+    Py_RETURN_NONE;
+  return pywm_client_new(self, window);
+} /* static PyObject *pywm_get_client */
+
+static PyObject *pywm_screens(PyWM *self, PyObject *unused) {
+  PyObject *list;
+  int i;
+
+  list = PyList_New(self->wm->num_screens);
+  if (list == NULL)
+    return NULL;
+  for (i = 0; i < self->wm->num_screens; i++) {
+    Screen *screen = self->wm->screens[i];
+    PyList_SET_ITEM(list, i, Py_BuildValue("(kii)", RootWindowOfScreen(screen),
+                                           WidthOfScreen(screen),
+                                           HeightOfScreen(screen)));
+  }
+  return list;
+} /* static PyObject *pywm_screens */
+
+static PyObject *pywm_focus(PyWM *self, PyObject *unused) {
+  return PyLong_FromUnsignedLong(self->wm->focus);
+}
+
+static client_t *pywm_require_client(PyWM *self, unsigned long window) {
+  client_t *client = wm_get_client(self->wm, window, False);
+  if (client == NULL)
+    PyErr_Format(PyExc_LookupError, "window %lu is not a client", window);
+  return client;
+}
+
+static PyObject *pywm_moveresize(PyWM *self, PyObject *args) {
+  unsigned long window;
+  int x, y;
+  unsigned int width, height;
+  client_t *client;
+
+  if (!PyArg_ParseTuple(args, "kiiII", &window, &x, &y, &width, &height))
+    return NULL;
+  client = pywm_require_client(self, window);
+  if (client == NULL)
+    return NULL;
+  wm_client_moveresize(self->wm, client, x, y, width, height);
+  Py_RETURN_NONE;
+} /* static PyObject *pywm_moveresize */
+
+static PyObject *pywm_set_tiled(PyWM *self, PyObject *args) {
+  unsigned long window;
+  int tiled;
+  client_t *client;
+
+  if (!PyArg_ParseTuple(args, "ki", &window, &tiled))
+    return NULL;
+  client = pywm_require_client(self, window);
+  if (client == NULL)
+    return NULL;
+  wm_client_set_tiled(self->wm, client, tiled ? True : False);
+  Py_RETURN_NONE;
+} /* static PyObject *pywm_set_tiled */
+
+static PyObject *pywm_set_occlusion_mode(PyWM *self, PyObject *args) {
+  unsigned int mode;
+
+  if (!PyArg_ParseTuple(args, "I", &mode))
+    return NULL;
+  wm_occlusion_set_mode(self->wm, mode);
+  Py_RETURN_NONE;
+} /* static PyObject *pywm_set_occlusion_mode */
+
+static PyObject *pywm_map_window(PyWM *self, PyObject *args) {
+  unsigned long window;
+
+  if (!PyArg_ParseTuple(args, "k", &window))
+    return NULL;
+  wm_x_map_window(self->wm, window);
+  Py_RETURN_NONE;
+}
+
+static PyObject *pywm_unmap_window(PyWM *self, PyObject *args) {
+  unsigned long window;
+  client_t *client;
+
+  if (!PyArg_ParseTuple(args, "k", &window))
+    return NULL;
+  client = wm_get_client(self->wm, window, False);
+  if (client != NULL)
+    wm_client_unmap(self->wm, client);
+  else
+    wm_x_unmap_window(self->wm, window);
+  Py_RETURN_NONE;
+}
+
+static PyObject *pywm_move_resize_window(PyWM *self, PyObject *args) {
+  unsigned long window;
+  int x, y;
+  unsigned int width, height;
+
+  if (!PyArg_ParseTuple(args, "kiiII", &window, &x, &y, &width, &height))
+    return NULL;
+  wm_x_move_resize_window(self->wm, window, x, y, width, height);
+  Py_RETURN_NONE;
+}
+
+/* Reparent 'window' into 'parent' and add it to the save set, so it
+ * survives us exiting. */
+static PyObject *pywm_reparent(PyWM *self, PyObject *args) {
+  unsigned long window, parent;
+  client_t *client;
+  int x, y;
+
+  if (!PyArg_ParseTuple(args, "kkii", &window, &parent, &x, &y))
+    return NULL;
+  XAddToSaveSet(self->wm->dpy, window);
+  client = wm_get_client(self->wm, window, False);
+  if (client != NULL)
+    wm_client_reparent(self->wm, client, parent, x, y);
+  else
+    wm_x_reparent_window(self->wm, window, parent, x, y);
+  Py_RETURN_NONE;
+} /* static PyObject *pywm_reparent */
+
+static PyObject *pywm_create_window(PyWM *self, PyObject *args) {
+  int screen_num, x, y;
+  unsigned int width, height;
+  long event_mask = ExposureMask | ButtonPressMask | ButtonReleaseMask
+                    | EnterWindowMask | LeaveWindowMask;
+  XSetWindowAttributes attr;
+  Screen *screen;
+  Window window;
+
+  if (!PyArg_ParseTuple(args, "iiiII|l", &screen_num, &x, &y, &width, &height,
+                        &event_mask))
+    return NULL;
+  if (screen_num < 0 || screen_num >= self->wm->num_screens) {
+    PyErr_Format(PyExc_ValueError, "no such screen %d", screen_num);
+    return NULL;
+  }
+  screen = self->wm->screens[screen_num];
+  attr.event_mask = event_mask;
+  attr.background_pixel = BlackPixelOfScreen(screen);
+  window = XCreateWindow(self->wm->dpy, RootWindowOfScreen(screen),
+                         x, y, width, height, 0, CopyFromParent,
+                         InputOutput, CopyFromParent,
+                         CWEventMask | CWBackPixel, &attr);
+  return PyLong_FromUnsignedLong(window);
+} /* static PyObject *pywm_create_window */
+
+static PyObject *pywm_set_input_focus(PyWM *self, PyObject *args) {
+  unsigned long window;
+
+  if (!PyArg_ParseTuple(args, "k", &window))
+    return NULL;
+  XSetInputFocus(self->wm->dpy, window, RevertToParent, CurrentTime);
+  Py_RETURN_NONE;
+}
+
+static PyObject *pywm_grab_key(PyWM *self, PyObject *args) {
+  const char *keysym_name;
+  unsigned int modifiers;
+  KeySym keysym;
+  KeyCode keycode;
+  int i;
+
+  if (!PyArg_ParseTuple(args, "sI", &keysym_name, &modifiers))
+    return NULL;
+  keysym = XStringToKeysym(keysym_name);
+  keycode = (keysym != NoSymbol) ? XKeysymToKeycode(self->wm->dpy, keysym) : 0;
+  if (keycode == 0) {
+    PyErr_Format(PyExc_ValueError, "no keycode for '%s'", keysym_name);
+    return NULL;
+  }
+  for (i = 0; i < self->wm->num_screens; i++)
+    XGrabKey(self->wm->dpy, keycode, modifiers,
+             RootWindowOfScreen(self->wm->screens[i]), False,
+             GrabModeAsync, GrabModeAsync);
+  return PyLong_FromUnsignedLong(keysym);
+} /* static PyObject *pywm_grab_key */
+
+static PyObject *pywm_title_init(PyWM *self, PyObject *args) {
+  const char *font = "fixed";
+  unsigned int max_entries = 256;
+
+  if (!PyArg_ParseTuple(args, "|sI", &font, &max_entries))
+    return NULL;
+  if (!wm_title_init(self->wm, font, max_entries)) {
+    PyErr_Format(PyExc_RuntimeError, "can't load title font '%s'", font);
+    return NULL;
+  }
+  return PyLong_FromUnsignedLong(wm_title_height(self->wm));
+} /* static PyObject *pywm_title_init */
+
+static PyObject *pywm_draw_title(PyWM *self, PyObject *args) {
+  unsigned long drawable;
+  int screen_num, x, y, focused;
+  unsigned int width, height;
+  const char *text;
+
+  if (!PyArg_ParseTuple(args, "kiiiIIzi", &drawable, &screen_num, &x, &y,
+                        &width, &height, &text, &focused))
+    return NULL;
+  if (screen_num < 0 || screen_num >= self->wm->num_screens) {
+    PyErr_Format(PyExc_ValueError, "no such screen %d", screen_num);
+    return NULL;
+  }
+  wm_title_draw(self->wm, drawable, self->wm->screens[screen_num], x, y,
+                width, height, text, focused ? True : False);
+  Py_RETURN_NONE;
+} /* static PyObject *pywm_draw_title */
+
+static PyObject *pywm_flush(PyWM *self, PyObject *unused) {
+  XFlush(self->wm->dpy);
+  Py_RETURN_NONE;
+}
+
+static PyMethodDef pywm_methods[] = {
+  { "main", (PyCFunction)pywm_main, METH_NOARGS,
+    "main()\nRun the event loop. Doesn't return." },
+  { "add_listener", (PyCFunction)pywm_add_listener, METH_VARARGS,
+    "add_listener(event_id, callback)\n"
+    "Call callback(wm, event) for each EVENT_* event; 'event' is a dict." },
+  { "clients", (PyCFunction)pywm_clients, METH_NOARGS,
+    "clients() -> list of Client" },
+  { "get_client", (PyCFunction)pywm_get_client, METH_VARARGS,
+    "get_client(window) -> Client or None" },
+  { "screens", (PyCFunction)pywm_screens, METH_NOARGS,
+    "screens() -> list of (root, width, height)" },
+  { "focus", (PyCFunction)pywm_focus, METH_NOARGS,
+    "focus() -> focused client window, or 0" },
+  { "moveresize", (PyCFunction)pywm_moveresize, METH_VARARGS,
+    "moveresize(window, x, y, width, height)\n"
+    "Place a client within its container (see wm_client_moveresize)." },
+  { "set_tiled", (PyCFunction)pywm_set_tiled, METH_VARARGS,
+    "set_tiled(window, tiled)" },
+  { "set_occlusion_mode", (PyCFunction)pywm_set_occlusion_mode, METH_VARARGS,
+    "set_occlusion_mode(OCCLUSION_OFF | OCCLUSION_HIDDEN | OCCLUSION_UNMAP)" },
+  { "map_window", (PyCFunction)pywm_map_window, METH_VARARGS,
+    "map_window(window)" },
+  { "unmap_window", (PyCFunction)pywm_unmap_window, METH_VARARGS,
+    "unmap_window(window)" },
+  { "move_resize_window", (PyCFunction)pywm_move_resize_window, METH_VARARGS,
+    "move_resize_window(window, x, y, width, height)" },
+  { "reparent", (PyCFunction)pywm_reparent, METH_VARARGS,
+    "reparent(window, parent, x, y)" },
+  { "create_window", (PyCFunction)pywm_create_window, METH_VARARGS,
+    "create_window(screen, x, y, width, height[, event_mask]) -> window\n"
+    "Create an unmapped child of the screen's root, e.g. a frame." },
+  { "set_input_focus", (PyCFunction)pywm_set_input_focus, METH_VARARGS,
+    "set_input_focus(window)" },
+  { "grab_key", (PyCFunction)pywm_grab_key, METH_VARARGS,
+    "grab_key(keysym_name, modifiers) -> keysym\n"
+    "Grab a key on every root window." },
+  { "title_init", (PyCFunction)pywm_title_init, METH_VARARGS,
+    "title_init([font[, max_entries]]) -> title height" },
+  { "draw_title", (PyCFunction)pywm_draw_title, METH_VARARGS,
+    "draw_title(drawable, screen, x, y, width, height, text, focused)" },
+  { "flush", (PyCFunction)pywm_flush, METH_NOARGS,
+    "flush()" },
+  { NULL }
+};
+
+static PyTypeObject PyWMClientType = {
+  PyVarObject_HEAD_INIT(NULL, 0)
+  "windowmanager.Client",      /* tp_name */
+  sizeof(PyWMClient),          /* tp_basicsize */
+};
+
+static PyTypeObject PyWMType = {
+  PyVarObject_HEAD_INIT(NULL, 0)
+  "windowmanager.WindowManager", /* tp_name */
+  sizeof(PyWM),                  /* tp_basicsize */
+};
+
+static int pywm_setup_types(void) {
+  PyWMClientType.tp_dealloc = (destructor)pywm_client_dealloc;
+  PyWMClientType.tp_repr = (reprfunc)pywm_client_repr;
+  PyWMClientType.tp_flags = Py_TPFLAGS_DEFAULT;
+  PyWMClientType.tp_doc = "A window in the client table";
+  PyWMClientType.tp_getset = pywm_client_getset;
+  if (PyType_Ready(&PyWMClientType) < 0)
+    return -1;
+
+  PyWMType.tp_dealloc = (destructor)pywm_dealloc;
+  PyWMType.tp_flags = Py_TPFLAGS_DEFAULT;
+  PyWMType.tp_doc = "WindowManager(display=None)";
+  PyWMType.tp_methods = pywm_methods;
+  PyWMType.tp_init = (initproc)pywm_init;
+  PyWMType.tp_new = PyType_GenericNew;
+  if (PyType_Ready(&PyWMType) < 0)
+    return -1;
+  return 0;
+} /* static int pywm_setup_types */
+
+static void pywm_add_constants(PyObject *module) {
+#define CONSTANT(name) PyModule_AddIntConstant(module, #name, WM_##name)
+  CONSTANT(EVENT_EXPOSE);
+  CONSTANT(EVENT_KEY_DOWN);
+  CONSTANT(EVENT_KEY_UP);
+  CONSTANT(EVENT_MOUSE_MOTION);
+  CONSTANT(EVENT_WINDOW_ENTER);
+  CONSTANT(EVENT_WINDOW_LEAVE);
+  CONSTANT(EVENT_WINDOW_MAP);
+  CONSTANT(EVENT_WINDOW_MAP_REQUEST);
+  CONSTANT(EVENT_WINDOW_NAME);
+  CONSTANT(EVENT_WINDOW_PROPERTY_CHANGE);
+  CONSTANT(EVENT_WINDOW_PROPERTY_DELETE);
+  CONSTANT(EVENT_WINDOW_UNMAP);
+  CONSTANT(OCCLUSION_OFF);
+  CONSTANT(OCCLUSION_HIDDEN);
+  CONSTANT(OCCLUSION_UNMAP);
+#undef CONSTANT
+  PyModule_AddIntConstant(module, "CLIENT_VISIBLE", CLIENT_VISIBLE);
+  PyModule_AddIntConstant(module, "CLIENT_TILED", CLIENT_TILED);
+  PyModule_AddIntConstant(module, "CLIENT_OCCLUDED", CLIENT_OCCLUDED);
+  PyModule_AddIntConstant(module, "Mod1Mask", Mod1Mask);
+  PyModule_AddIntConstant(module, "Mod4Mask", Mod4Mask);
+  PyModule_AddIntConstant(module, "ShiftMask", ShiftMask);
+  PyModule_AddIntConstant(module, "ControlMask", ControlMask);
+} /* static void pywm_add_constants */
+
+#if PY_MAJOR_VERSION >= 3
+static struct PyModuleDef pywm_module = {
+  PyModuleDef_HEAD_INIT, "windowmanager", "libwindowmanager bindings", -1, NULL
+};
+
+PyMODINIT_FUNC PyInit_windowmanager(void) {
+  PyObject *module;
+
+  if (pywm_setup_types() < 0)
+    return NULL;
+  module = PyModule_Create(&pywm_module);
+  if (module == NULL)
+    return NULL;
+  Py_INCREF(&PyWMType);
+  PyModule_AddObject(module, "WindowManager", (PyObject *)&PyWMType);
+  Py_INCREF(&PyWMClientType);
+  PyModule_AddObject(module, "Client", (PyObject *)&PyWMClientType);
+  pywm_add_constants(module);
+  return module;
+} /* PyMODINIT_FUNC PyInit_windowmanager */
+#else
+PyMODINIT_FUNC initwindowmanager(void) {
+  PyObject *module;
+
+  /* Listeners take the GIL from inside wm_main */
+  PyEval_InitThreads();
+  if (pywm_setup_types() < 0)
+    return;
+  module = Py_InitModule3("windowmanager", NULL, "libwindowmanager bindings");
+  if (module == NULL)
+    return;
+  Py_INCREF(&PyWMType);
+  PyModule_AddObject(module, "WindowManager", (PyObject *)&PyWMType);
+  Py_INCREF(&PyWMClientType);
+  PyModule_AddObject(module, "Client", (PyObject *)&PyWMClientType);
+  pywm_add_constants(module);
+} /* PyMODINIT_FUNC initwindowmanager */
+#endif
@@ -0,0 +1,212 @@
+/*
+ * Resource accounting, for finding leaks in long sessions.
+ *
+ * When enabled (wm_res_enable, or WM_RESOURCE_DEBUG in the environment), every
+ * X resource and heap object the library creates is recorded with its type
+ * and the file:line that created it, and forgotten again when it's freed.
+ * Strings and arrays owned by a recorded object, and the per-subsystem state
+ * made once by wm_init, aren't recorded separately. Fetches live on the
+ * worker thread, so they're recorded per window when queued and forgotten
+ * when their result is collected. Programs using the library can record
+ * their own the same way.
+ *
+ * wm_res_snapshot() counts what is alive per type and creation site, and
+ * wm_res_diff() logs what changed between two snapshots. Sending the process
+ * SIGUSR1 logs the change since the previous SIGUSR1, so a long-running
+ * session can be checked for growth without restarting it.
+ *
+ * Disabled, each call is a single test.
+ */
+
+#include "windowmanager.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct res_record {
+  const char *site;
+  unsigned int refs; /* colors can be allocated more than once */
+} res_record_t;
+
+struct wm_resources {
+  GHashTable *live[WM_RES_MAX + 1]; /* key -> res_record_t */
+  wm_res_snapshot_t *last; /* as of the last SIGUSR1 */
+  sig_atomic_t signals_seen;
+};
+
+struct wm_res_snapshot {
+  GHashTable *counts; /* "type site" -> count */
+  unsigned int totals[WM_RES_MAX + 1];
+};
+
+static const char *res_type_names[WM_RES_MAX + 1] = {
+  "client", "heap", "window", "pixmap", "gc", "color", "alarm", "icon", "fetch"
+};
+
+static volatile sig_atomic_t res_signals = 0;
+
+static void wm_res_sigusr1(int sig) {
+  res_signals++;
+}
+
+void wm_res_enable(wm_t *wm) {
+  struct sigaction action;
+  int i;
+
+  if (wm->resources != NULL)
+    return;
+
+  wm->resources = calloc(1, sizeof(struct wm_resources));
+  for (i = 0; i <= WM_RES_MAX; i++)
+    wm->resources->live[i] = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                                   NULL, free);
+  wm->resources->signals_seen = res_signals;
+
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = wm_res_sigusr1;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGUSR1, &action, NULL);
+  wm_log(wm, LOG_INFO, "%s: tracking resources; SIGUSR1 logs what changed",
+         __func__);
+} /* void wm_res_enable */
+
+/* Enabled from the environment, so any program can be checked for leaks */
+void wm_res_init(wm_t *wm) {
+  if (getenv("WM_RESOURCE_DEBUG") != NULL)
+    wm_res_enable(wm);
+} /* void wm_res_init */
+
+Bool wm_res_enabled(wm_t *wm) {
+  return wm->resources != NULL;
+} /* Bool wm_res_enabled */
+
+void wm_res_created_at(wm_t *wm, unsigned int type, gconstpointer key,
+                       const char *site) {
+  res_record_t *record;
+
+  if (wm->resources == NULL || type > WM_RES_MAX)
+    return;
+
+  record = g_hash_table_lookup(wm->resources->live[type], key);
+  if (record == NULL) {
+    record = malloc(sizeof(res_record_t));
+    record->site = site;
+    record->refs = 0;
+    g_hash_table_insert(wm->resources->live[type], (gpointer)key, record);
+  }
+  record->refs++;
+} /* void wm_res_created_at */
+
+/* Freeing something we never saw created (e.g. from before tracking was
+ * enabled) is ignored. */
+void wm_res_freed(wm_t *wm, unsigned int type, gconstpointer key) {
+  res_record_t *record;
+
+  if (wm->resources == NULL || type > WM_RES_MAX)
+    return;
+
+  record = g_hash_table_lookup(wm->resources->live[type], key);
+  if (record != NULL && --record->refs == 0)
+    g_hash_table_remove(wm->resources->live[type], key);
+} /* void wm_res_freed */
+
+unsigned int wm_res_count(wm_t *wm, unsigned int type) {
+  if (wm->resources == NULL || type > WM_RES_MAX)
+    return 0;
+  return g_hash_table_size(wm->resources->live[type]);
+} /* unsigned int wm_res_count */
+
+wm_res_snapshot_t *wm_res_snapshot(wm_t *wm) {
+  wm_res_snapshot_t *snapshot;
+  GHashTableIter iter;
+  gpointer value;
+  char name[256];
+  int i;
+
+  if (wm->resources == NULL)
+    return NULL;
+
+  snapshot = calloc(1, sizeof(wm_res_snapshot_t));
+  snapshot->counts = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+  for (i = 0; i <= WM_RES_MAX; i++) {
+    g_hash_table_iter_init(&iter, wm->resources->live[i]);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+      res_record_t *record = value;
+      gpointer count;
+
+      snprintf(name, sizeof(name), "%s %s", res_type_names[i], record->site);
+      count = g_hash_table_lookup(snapshot->counts, name);
+      g_hash_table_replace(snapshot->counts, strdup(name),
+                           GUINT_TO_POINTER(GPOINTER_TO_UINT(count) + 1));
+      snapshot->totals[i]++;
+    }
+  }
+  return snapshot;
+} /* wm_res_snapshot_t *wm_res_snapshot */
+
+void wm_res_snapshot_free(wm_res_snapshot_t *snapshot) {
+  if (snapshot == NULL)
+    return;
+  g_hash_table_destroy(snapshot->counts);
+  free(snapshot);
+} /* void wm_res_snapshot_free */
+
+/* Log every type and creation site whose count differs. 'before' may be
+ * NULL, in which case everything in 'after' is logged. Returns the number of
+ * sites that changed. */
+unsigned int wm_res_diff(wm_t *wm, wm_res_snapshot_t *before,
+                         wm_res_snapshot_t *after) {
+  GHashTableIter iter;
+  gpointer key, value;
+  unsigned int changed = 0;
+  int i;
+
+  if (after == NULL)
+    return 0;
+
+  g_hash_table_iter_init(&iter, after->counts);
+  while (g_hash_table_iter_next(&iter, &key, &value)) {
+    unsigned int now = GPOINTER_TO_UINT(value);
+    unsigned int then = (before != NULL)
+      ? GPOINTER_TO_UINT(g_hash_table_lookup(before->counts, key)) : 0;
+    if (now != then) {
+      wm_log(wm, LOG_INFO, "%s: %s: %u -> %u (%+d)", __func__, (char *)key,
+             then, now, (int)now - (int)then);
+      changed++;
+    }
+  }
+  if (before != NULL) {
+    g_hash_table_iter_init(&iter, before->counts);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+      if (g_hash_table_lookup(after->counts, key) == NULL) {
+        wm_log(wm, LOG_INFO, "%s: %s: %u -> 0 (-%u)", __func__, (char *)key,
+               GPOINTER_TO_UINT(value), GPOINTER_TO_UINT(value));
+        changed++;
+      }
+    }
+  }
+
+  for (i = 0; i <= WM_RES_MAX; i++)
+    wm_log(wm, LOG_INFO, "%s: %s total: %u -> %u", __func__, res_type_names[i],
+           (before != NULL) ? before->totals[i] : 0, after->totals[i]);
+  return changed;
+} /* unsigned int wm_res_diff */
+
+/* Called once per batch by wm_main; answers SIGUSR1. */
+void wm_res_poll(wm_t *wm) {
+  struct wm_resources *resources = wm->resources;
+  wm_res_snapshot_t *snapshot;
+
+  if (resources == NULL || resources->signals_seen == res_signals)
+    return;
+  resources->signals_seen = res_signals;
+
+  snapshot = wm_res_snapshot(wm);
+  wm_log(wm, LOG_INFO, "%s: resources changed since %s:", __func__,
+         (resources->last != NULL) ? "the last SIGUSR1" : "startup");
+  wm_res_diff(wm, resources->last, snapshot);
+  wm_res_snapshot_free(resources->last);
+  resources->last = snapshot;
+} /* void wm_res_poll */
@@ -0,0 +1,248 @@
+/*
+ * Round-trip accounting.
+ *
+ * A request with a reply stalls the whole window manager until the server
+ * answers. The wm_x_* wrappers for such requests (eventlog.c) note how many
+ * requests they sent and how long they blocked, along with who asked: the X
+ * event being dispatched, the WM_EVENT_* listener running, if any, and the
+ * function that called the wrapper. A request Xlib answers from its own
+ * cache, like a repeated XInternAtom, sends nothing and isn't counted.
+ *
+ * wm_roundtrip_report() logs the totals per (event, listener, caller), most
+ * expensive first. With a budget set (wm_roundtrip_set_budget, or
+ * WM_ROUNDTRIP_BUDGET=count in the environment) every event whose handling
+ * takes more round trips than that is logged as it happens, so a new round
+ * trip on a hot path shows up the first time it runs.
+ */
+
+#include "windowmanager.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct roundtrip_stat {
+  char *key; /* "event listener caller" */
+  unsigned long calls;
+  unsigned long requests;
+  gint64 usec;
+} roundtrip_stat_t;
+
+struct wm_roundtrips {
+  GHashTable *stats; /* key -> roundtrip_stat_t */
+
+  int event_type; /* being dispatched, 0 if none */
+  unsigned int listener; /* WM_EVENT_* running, 0 if none */
+
+  /* Spent on the event being dispatched */
+  unsigned long event_requests;
+  gint64 event_usec;
+  const char *event_worst; /* caller of the slowest one */
+  gint64 event_worst_usec;
+
+  unsigned int budget; /* round trips per event; 0 for no limit */
+  unsigned long over_budget;
+};
+
+static const char *roundtrip_event_names[LASTEvent] = {
+  [KeyPress] = "KeyPress", [KeyRelease] = "KeyRelease",
+  [ButtonPress] = "ButtonPress", [ButtonRelease] = "ButtonRelease",
+  [MotionNotify] = "MotionNotify", [EnterNotify] = "EnterNotify",
+  [LeaveNotify] = "LeaveNotify", [FocusIn] = "FocusIn",
+  [FocusOut] = "FocusOut", [Expose] = "Expose",
+  [CreateNotify] = "CreateNotify", [DestroyNotify] = "DestroyNotify",
+  [UnmapNotify] = "UnmapNotify", [MapNotify] = "MapNotify",
+  [MapRequest] = "MapRequest", [ReparentNotify] = "ReparentNotify",
+  [ConfigureNotify] = "ConfigureNotify",
+  [ConfigureRequest] = "ConfigureRequest",
+  [PropertyNotify] = "PropertyNotify", [ClientMessage] = "ClientMessage",
+};
+
+static const char *roundtrip_listener_names[WM_EVENT_MAX + 1] = {
+  "-", "EXPOSE", "KEY_DOWN", "KEY_UP", "MOUSE_MOTION", "WINDOW_ENTER",
+  "WINDOW_LEAVE", "WINDOW_MAP", "WINDOW_MAP_REQUEST", "WINDOW_NAME",
+  "WINDOW_PROPERTY_CHANGE", "WINDOW_PROPERTY_DELETE", "WINDOW_UNMAP",
+  "WINDOW_ICON"
+};
+
+static void roundtrip_stat_free(gpointer data) {
+  roundtrip_stat_t *stat = data;
+  free(stat->key);
+  free(stat);
+} /* static void roundtrip_stat_free */
+
+void wm_roundtrip_init(wm_t *wm) {
+  const char *budget = getenv("WM_ROUNDTRIP_BUDGET");
+
+  wm->roundtrips = calloc(1, sizeof(struct wm_roundtrips));
+  wm->roundtrips->stats = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+                                                roundtrip_stat_free);
+  if (budget != NULL)
+    wm_roundtrip_set_budget(wm, strtoul(budget, NULL, 10));
+} /* void wm_roundtrip_init */
+
+/* Log every event that takes more than 'max' round trips to handle. 0 turns
+ * this off. */
+void wm_roundtrip_set_budget(wm_t *wm, unsigned int max) {
+  wm->roundtrips->budget = max;
+  if (max > 0)
+    wm_log(wm, LOG_INFO, "%s: warning about events taking over %u round trips",
+           __func__, max);
+} /* void wm_roundtrip_set_budget */
+
+static const char *roundtrip_event_name(int type, char *buf, size_t size) {
+  if (type > 0 && type < LASTEvent && roundtrip_event_names[type] != NULL)
+    return roundtrip_event_names[type];
+  if (type == 0)
+    return "-";
+  snprintf(buf, size, "event%d", type);
+  return buf;
+} /* static const char *roundtrip_event_name */
+
+/* Called by wm_dispatch around each handler; returns what was being
+ * dispatched before, for wm_roundtrip_event_end. */
+int wm_roundtrip_event_begin(wm_t *wm, int event_type) {
+  struct wm_roundtrips *rt = wm->roundtrips;
+  int previous;
+
+  if (rt == NULL)
+    return 0;
+  previous = rt->event_type;
+  rt->event_type = event_type;
+  rt->event_requests = 0;
+  rt->event_usec = 0;
+  rt->event_worst = NULL;
+  rt->event_worst_usec = 0;
+  return previous;
+} /* int wm_roundtrip_event_begin */
+
+void wm_roundtrip_event_end(wm_t *wm, int previous) {
+  struct wm_roundtrips *rt = wm->roundtrips;
+  char buf[32];
+
+  if (rt == NULL)
+    return;
+  if (rt->budget > 0 && rt->event_requests > rt->budget) {
+    rt->over_budget++;
+    wm_log(wm, LOG_WARN, "%s: %s took %lu round trips (budget %u), %lld usec;"
+           " slowest from %s", __func__,
+           roundtrip_event_name(rt->event_type, buf, sizeof(buf)),
+           rt->event_requests, rt->budget, (long long)rt->event_usec,
+           rt->event_worst != NULL ? rt->event_worst : "?");
+  }
+  rt->event_type = previous;
+} /* void wm_roundtrip_event_end */
+
+/* Called around each listener; returns the listener it interrupts. */
+unsigned int wm_roundtrip_listener(wm_t *wm, unsigned int event_id) {
+  struct wm_roundtrips *rt = wm->roundtrips;
+  unsigned int previous;
+
+  if (rt == NULL)
+    return 0;
+  previous = rt->listener;
+  rt->listener = event_id;
+  return previous;
+} /* unsigned int wm_roundtrip_listener */
+
+/* Take note before making requests that wait for a reply. */
+void wm_roundtrip_begin(wm_t *wm, wm_roundtrip_t *mark) {
+  mark->serial = (wm->dpy != NULL) ? NextRequest(wm->dpy) : 0;
+  mark->start = g_get_monotonic_time();
+} /* void wm_roundtrip_begin */
+
+/* ... and after. 'caller' is who to blame. */
+void wm_roundtrip_end(wm_t *wm, wm_roundtrip_t *mark, const char *caller) {
+  struct wm_roundtrips *rt = wm->roundtrips;
+  roundtrip_stat_t *stat;
+  unsigned long requests;
+  gint64 usec;
+  char key[256], buf[32];
+
+  if (rt == NULL || wm->dpy == NULL)
+    return;
+  requests = NextRequest(wm->dpy) - mark->serial;
+  if (requests == 0)
+    return;
+  usec = g_get_monotonic_time() - mark->start;
+
+  snprintf(key, sizeof(key), "%s %s %s",
+           roundtrip_event_name(rt->event_type, buf, sizeof(buf)),
+           roundtrip_listener_names[rt->listener <= WM_EVENT_MAX
+                                    ? rt->listener : 0],
+           caller);
+  stat = g_hash_table_lookup(rt->stats, key);
+  if (stat == NULL) {
+    stat = calloc(1, sizeof(roundtrip_stat_t));
+    stat->key = strdup(key);
+    g_hash_table_insert(rt->stats, stat->key, stat);
+  }
+  stat->calls++;
+  stat->requests += requests;
+  stat->usec += usec;
+
+  rt->event_requests += requests;
+  rt->event_usec += usec;
+  if (usec >= rt->event_worst_usec) {
+    rt->event_worst = caller;
+    rt->event_worst_usec = usec;
+  }
+} /* void wm_roundtrip_end */
+
+static gint roundtrip_stat_compare(gconstpointer a, gconstpointer b) {
+  const roundtrip_stat_t *sa = *(roundtrip_stat_t **)a;
+  const roundtrip_stat_t *sb = *(roundtrip_stat_t **)b;
+  return (sb->usec > sa->usec) - (sb->usec < sa->usec);
+} /* static gint roundtrip_stat_compare */
+
+/* Log round trips by event, listener and caller, most time first. */
+void wm_roundtrip_report(wm_t *wm) {
+  struct wm_roundtrips *rt = wm->roundtrips;
+  GHashTableIter iter;
+  gpointer value;
+  GPtrArray *stats;
+  unsigned long requests = 0;
+  gint64 usec = 0;
+  unsigned int i;
+
+  stats = g_ptr_array_new();
+  g_hash_table_iter_init(&iter, rt->stats);
+  while (g_hash_table_iter_next(&iter, NULL, &value))
+    g_ptr_array_add(stats, value);
+  g_ptr_array_sort(stats, roundtrip_stat_compare);
+
+  wm_log(wm, LOG_INFO, "%s: %8s %8s %10s  event listener caller", __func__,
+         "calls", "requests", "usec");
+  for (i = 0; i < stats->len; i++) {
+    roundtrip_stat_t *stat = g_ptr_array_index(stats, i);
+    wm_log(wm, LOG_INFO, "%s: %8lu %8lu %10lld  %s", __func__, stat->calls,
+           stat->requests, (long long)stat->usec, stat->key);
+    requests += stat->requests;
+    usec += stat->usec;
+  }
+  wm_log(wm, LOG_INFO, "%s: %lu round trips, %lld usec, %lu events over budget",
+         __func__, requests, (long long)usec, rt->over_budget);
+  g_ptr_array_free(stats, TRUE);
+} /* void wm_roundtrip_report */
+
+void wm_roundtrip_reset(wm_t *wm) {
+  g_hash_table_remove_all(wm->roundtrips->stats);
+  wm->roundtrips->over_budget = 0;
+} /* void wm_roundtrip_reset */
+
+/* Totals since the last reset */
+void wm_roundtrip_stats(wm_t *wm, unsigned long *requests, gint64 *usec,
+                        unsigned long *over_budget) {
+  GHashTableIter iter;
+  gpointer value;
+
+  *requests = 0;
+  *usec = 0;
+  g_hash_table_iter_init(&iter, wm->roundtrips->stats);
+  while (g_hash_table_iter_next(&iter, NULL, &value)) {
+    roundtrip_stat_t *stat = value;
+    *requests += stat->requests;
+    *usec += stat->usec;
+  }
+  *over_budget = wm->roundtrips->over_budget;
+} /* void wm_roundtrip_stats */
@@ -0,0 +1,183 @@
+/*
+ * Export the client table to a shared-memory segment so other programs can
+ * query the window list without hitting the X server. See wmshm.h for the
+ * layout and locking rules.
+ */
+
+#include "windowmanager.h"
+#include "wmshm.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct wm_shm {
+  char *name;
+  int fd; /* open for as long as we hold the flock on it */
+  wm_shm_header_t *header;
+  size_t size;
+  Bool dirty;
+};
+
+static void wm_shm_release(wm_t *wm, Bool unlink_segment) {
+  struct wm_shm *shm = wm->shm;
+
+  if (shm == NULL)
+    return;
+
+  munmap(shm->header, shm->size);
+  if (unlink_segment)
+    shm_unlink(shm->name);
+  close(shm->fd); /* and with it the lock */
+  free(shm->name);
+  free(shm);
+  wm->shm = NULL;
+} /* static void wm_shm_release */
+
+/* Export the client table in the segment 'name', or the one for our
+ * display (wm_shm_default_name) if it's NULL. Fails if another window
+ * manager is still writing that segment. Titles are private to the user,
+ * so it's created mode 0600. */
+Bool wm_shm_open(wm_t *wm, const char *name, unsigned int max_clients) {
+  struct wm_shm *shm;
+  wm_shm_header_t *header;
+  char default_name[WM_SHM_NAME_MAX];
+  size_t size;
+  int fd;
+
+  if (name == NULL) {
+    wm_shm_default_name(default_name, sizeof(default_name),
+                        (wm->dpy != NULL) ? DisplayString(wm->dpy) : NULL);
+    name = default_name;
+  }
+
+  /* Reopening under the same name reuses the segment: let go of our lock on
+   * it, but don't unlink it, which would hide it from readers */
+  if (wm->shm != NULL && strcmp(wm->shm->name, name) == 0)
+    wm_shm_release(wm, False);
+
+  size = WM_SHM_SIZE(max_clients);
+  fd = shm_open(name, O_RDWR | O_CREAT, 0600);
+  if (fd < 0) {
+    wm_log(wm, LOG_ERROR, "%s: shm_open(%s) failed: %s", __func__, name,
+           strerror(errno));
+    return False;
+  }
+
+  if (flock(fd, LOCK_EX | LOCK_NB) < 0) {
+    wm_log(wm, LOG_ERROR, "%s: %s is in use by another window manager",
+           __func__, name);
+    close(fd);
+    return False;
+  }
+
+  if (ftruncate(fd, size) < 0) {
+    wm_log(wm, LOG_ERROR, "%s: ftruncate(%s) failed: %s", __func__, name,
+           strerror(errno));
+    close(fd);
+    return False;
+  }
+
+  header = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (header == MAP_FAILED) {
+    wm_log(wm, LOG_ERROR, "%s: mmap(%s) failed: %s", __func__, name,
+           strerror(errno));
+    close(fd);
+    return False;
+  }
+
+  /* Readers check magic last, so fill in the rest first. */
+  memset(header, 0, size);
+  header->version = WM_SHM_VERSION;
+  header->max_clients = max_clients;
+  header->record_size = sizeof(wm_shm_client_t);
+  __atomic_store_n(&header->magic, WM_SHM_MAGIC, __ATOMIC_RELEASE);
+
+  shm = malloc(sizeof(struct wm_shm));
+  shm->name = strdup(name);
+  shm->fd = fd;
+  shm->header = header;
+  shm->size = size;
+  shm->dirty = True;
+
+  wm_shm_close(wm);
+  wm->shm = shm;
+  wm_log(wm, LOG_INFO, "%s: exporting up to %u clients in %s", __func__,
+         max_clients, name);
+  return True;
+} /* Bool wm_shm_open */
+
+void wm_shm_close(wm_t *wm) {
+  wm_shm_release(wm, True);
+} /* void wm_shm_close */
+
+void wm_shm_mark_dirty(wm_t *wm) {
+  if (wm->shm != NULL)
+    wm->shm->dirty = True;
+} /* void wm_shm_mark_dirty */
+
+static void wm_shm_fill_client(wm_t *wm, wm_shm_client_t *rec, client_t *client) {
+  rec->window = client->window;
+  rec->container = client->container;
+  rec->x = client->attr.x;
+  rec->y = client->attr.y;
+  rec->width = client->attr.width;
+  rec->height = client->attr.height;
+  rec->screen = (client->screen != NULL) ? XScreenNumberOfScreen(client->screen) : 0;
+  rec->flags = 0;
+  if (client->flags & CLIENT_VISIBLE)
+    rec->flags |= WM_SHM_CLIENT_VISIBLE;
+  if (client->window == wm->focus)
+    rec->flags |= WM_SHM_CLIENT_FOCUSED;
+  if (client->flags & CLIENT_OCCLUDED)
+    rec->flags |= WM_SHM_CLIENT_OCCLUDED;
+
+  if (client->name != NULL)
+    strncpy(rec->title, client->name, WM_SHM_TITLE_LEN - 1);
+  else
+    rec->title[0] = '\0';
+  rec->title[WM_SHM_TITLE_LEN - 1] = '\0';
+} /* static void wm_shm_fill_client */
+
+void wm_shm_publish(wm_t *wm) {
+  wm_shm_header_t *header;
+  GHashTableIter iter;
+  gpointer value;
+  uint32_t seq;
+  unsigned int count = 0;
+  unsigned int truncated = 0;
+
+  if (wm->shm == NULL || !wm->shm->dirty)
+    return;
+
+  header = wm->shm->header;
+
+  /* Begin write: seq goes odd. The release fence keeps the table stores
+   * below from being reordered before it. */
+  seq = header->seq;
+  __atomic_store_n(&header->seq, seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  g_hash_table_iter_init(&iter, wm->clients);
+  while (g_hash_table_iter_next(&iter, NULL, &value)) {
+    if (count == header->max_clients) {
+      truncated++;
+      continue;
+    }
+    wm_shm_fill_client(wm, &header->clients[count], (client_t *)value);
+    count++;
+  }
+  header->num_clients = count;
+  header->focus = wm->focus;
+  header->truncated = truncated;
+
+  /* End write: seq goes even again. */
+  __atomic_store_n(&header->seq, seq + 2, __ATOMIC_RELEASE);
+  wm->shm->dirty = False;
+} /* void wm_shm_publish */
@@ -0,0 +1,103 @@
+/*
+ * Compare reading the window list from the shared-memory export against
+ * asking the X server for it the way panels usually do (XQueryTree on each
+ * root, then attributes and name for each child).
+ *
+ * usage: shmbench [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+
+#include "wmshm.h"
+
+static double now(void) {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static int query_x(Display *dpy) {
+  int screen;
+  int count = 0;
+
+  for (screen = 0; screen < ScreenCount(dpy); screen++) {
+    Window root, parent, *children = NULL;
+    unsigned int nchildren, i;
+
+    if (!XQueryTree(dpy, RootWindow(dpy, screen), &root, &parent,
+                    &children, &nchildren))
+      continue;
+    for (i = 0; i < nchildren; i++) {
+      XWindowAttributes attr;
+      char *name = NULL;
+      XGetWindowAttributes(dpy, children[i], &attr);
+      if (XFetchName(dpy, children[i], &name) && name != NULL)
+        XFree(name);
+      count++;
+    }
+    if (children != NULL)
+      XFree(children);
+  }
+  return count;
+}
+
+int main(int argc, char **argv) {
+  int iterations = 1000;
+  wm_shm_reader_t *reader;
+  wm_shm_client_t *clients;
+  unsigned int max_clients;
+  Display *dpy;
+  char name[WM_SHM_NAME_MAX];
+  uint32_t focus;
+  double start, shm_time, x_time;
+  int i, count = 0;
+
+  if (argc > 1)
+    iterations = atoi(argv[1]);
+
+  wm_shm_default_name(name, sizeof(name), NULL);
+  reader = wm_shm_reader_open(name);
+  if (reader == NULL) {
+    fprintf(stderr, "Failed opening %s; is the window manager exporting it?\n",
+            name);
+    return 1;
+  }
+  max_clients = wm_shm_reader_max_clients(reader);
+  clients = malloc(max_clients * sizeof(wm_shm_client_t));
+
+  start = now();
+  for (i = 0; i < iterations; i++)
+    count = wm_shm_reader_snapshot(reader, clients, max_clients, &focus);
+  if (count < 0) {
+    fprintf(stderr, "No consistent snapshot; did the window manager die?\n");
+    return 1;
+  }
+  shm_time = now() - start;
+  printf("shm: %d clients, %d iterations, %.3f usec/snapshot\n",
+         count, iterations, shm_time * 1000000 / iterations);
+
+  dpy = XOpenDisplay(NULL);
+  if (dpy == NULL) {
+    fprintf(stderr, "Failed opening display\n");
+    return 1;
+  }
+
+  start = now();
+  for (i = 0; i < iterations; i++)
+    count = query_x(dpy);
+  x_time = now() - start;
+  printf("x11: %d windows, %d iterations, %.3f usec/query\n",
+         count, iterations, x_time * 1000000 / iterations);
+
+  if (shm_time > 0)
+    printf("speedup: %.1fx\n", x_time / shm_time);
+
+  XCloseDisplay(dpy);
+  wm_shm_reader_close(reader);
+  free(clients);
+  return 0;
+}
@@ -0,0 +1,111 @@
+/*
+ * Reader side of the shared-memory client table export.
+ *
+ * This file depends only on libc so that panels and pagers can link it
+ * without pulling in Xlib or glib. Taking a snapshot makes no syscalls.
+ */
+
+#include "wmshm.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* A writer holds 'seq' odd for microseconds; far more than that means it's
+ * gone. */
+#define WM_SHM_READ_TRIES 1000000U
+
+struct wm_shm_reader {
+  const wm_shm_header_t *header;
+  size_t size;
+};
+
+/* Map the segment called 'name', or the one for $DISPLAY if it's NULL */
+wm_shm_reader_t *wm_shm_reader_open(const char *name) {
+  wm_shm_reader_t *reader;
+  const wm_shm_header_t *header;
+  char default_name[WM_SHM_NAME_MAX];
+  struct stat st;
+  int fd;
+
+  if (name == NULL) {
+    wm_shm_default_name(default_name, sizeof(default_name), NULL);
+    name = default_name;
+  }
+
+  fd = shm_open(name, O_RDONLY, 0);
+  if (fd < 0)
+    return NULL;
+
+  if (fstat(fd, &st) < 0 || st.st_size < sizeof(wm_shm_header_t)) {
+    close(fd);
+    return NULL;
+  }
+
+  header = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (header == MAP_FAILED)
+    return NULL;
+
+  if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != WM_SHM_MAGIC
+      || header->version != WM_SHM_VERSION
+      || header->record_size != sizeof(wm_shm_client_t)
+      || WM_SHM_SIZE(header->max_clients) > (size_t)st.st_size) {
+    munmap((void *)header, st.st_size);
+    return NULL;
+  }
+
+  reader = malloc(sizeof(wm_shm_reader_t));
+  if (reader == NULL) {
+    munmap((void *)header, st.st_size);
+    return NULL;
+  }
+  reader->header = header;
+  reader->size = st.st_size;
+  return reader;
+} /* wm_shm_reader_t *wm_shm_reader_open */
+
+void wm_shm_reader_close(wm_shm_reader_t *reader) {
+  munmap((void *)reader->header, reader->size);
+  free(reader);
+} /* void wm_shm_reader_close */
+
+unsigned int wm_shm_reader_max_clients(wm_shm_reader_t *reader) {
+  return reader->header->max_clients;
+} /* unsigned int wm_shm_reader_max_clients */
+
+/* Copy a consistent snapshot of the client table into 'clients'.
+ * Returns the number of clients copied. At most 'max_clients' are copied.
+ * Returns -1 if no consistent copy could be had in WM_SHM_READ_TRIES
+ * attempts, say because the writer died halfway through an update. */
+int wm_shm_reader_snapshot(wm_shm_reader_t *reader, wm_shm_client_t *clients,
+                           unsigned int max_clients, uint32_t *focus) {
+  const wm_shm_header_t *header = reader->header;
+  uint32_t seq1, seq2;
+  unsigned int count;
+  unsigned int tries;
+
+  for (tries = 0; tries < WM_SHM_READ_TRIES; tries++) {
+    seq1 = __atomic_load_n(&header->seq, __ATOMIC_ACQUIRE);
+    if (seq1 & 1)
+      continue; /* writer active */
+
+    count = header->num_clients;
+    if (count > header->max_clients)
+      count = header->max_clients;
+    if (count > max_clients)
+      count = max_clients;
+    memcpy(clients, header->clients, count * sizeof(wm_shm_client_t));
+    if (focus != NULL)
+      *focus = header->focus;
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    seq2 = __atomic_load_n(&header->seq, __ATOMIC_RELAXED);
+    if (seq1 == seq2)
+      return count;
+  }
+  return -1;
+} /* int wm_shm_reader_snapshot */
@@ -0,0 +1,301 @@
+/*
+ * Stacking order, kept in memory per parent window.
+ *
+ * The order comes from the initial window scan, CreateNotify, ReparentNotify,
+ * ConfigureNotify's 'above' field and DestroyNotify, plus our own reparent,
+ * raise and lower calls. Our reparents are applied when they're sent, so a
+ * raise right after one works in the new parent. Raising and lowering only change the model and mark the
+ * parent dirty. wm_stack_flush(), which wm_main calls once per batch of
+ * events, then sends a single XRestackWindows per parent whose order really
+ * changed. Only the part of the order that moved is included.
+ *
+ * Finding the top client of a container is then a lookup rather than an
+ * XQueryTree.
+ */
+
+#include "windowmanager.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct stack {
+  Window parent;
+  GQueue order;    /* Window, bottom first */
+  GArray *flushed; /* Window, top first, as of the last flush */
+  Bool dirty;      /* we changed the order; needs a restack */
+  Bool stale;      /* the server changed the order; 'flushed' is out of date */
+} stack_t;
+
+typedef struct stack_entry {
+  stack_t *stack;
+  GList *link; /* in stack->order */
+} stack_entry_t;
+
+struct wm_stacks {
+  GHashTable *parents; /* Window -> stack_t */
+  GHashTable *windows; /* Window -> stack_entry_t */
+  GPtrArray *touched;  /* stack_t that are dirty or stale */
+};
+
+void wm_stack_init(wm_t *wm) {
+  wm->stacks = calloc(1, sizeof(struct wm_stacks));
+  wm->stacks->parents = g_hash_table_new(g_direct_hash, g_direct_equal);
+  wm->stacks->windows = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                              NULL, free);
+  wm->stacks->touched = g_ptr_array_new();
+} /* void wm_stack_init */
+
+static void wm_stack_touch(wm_t *wm, stack_t *stack, Bool ours) {
+  if (!stack->dirty && !stack->stale)
+    g_ptr_array_add(wm->stacks->touched, stack);
+  if (ours)
+    stack->dirty = True;
+  else
+    stack->stale = True;
+  wm_occlusion_mark(wm, stack->parent);
+  wm_ewmh_mark_stacking(wm);
+} /* static void wm_stack_touch */
+
+static stack_t *wm_stack_get(wm_t *wm, Window parent, Bool create) {
+  stack_t *stack;
+
+  stack = g_hash_table_lookup(wm->stacks->parents, GUINT_TO_POINTER(parent));
+  if (stack == NULL && create) {
+    stack = calloc(1, sizeof(stack_t));
+    wm_res_created(wm, WM_RES_HEAP, stack);
+    stack->parent = parent;
+    g_queue_init(&stack->order);
+    stack->flushed = g_array_new(FALSE, FALSE, sizeof(Window));
+    g_hash_table_insert(wm->stacks->parents, GUINT_TO_POINTER(parent), stack);
+  }
+  return stack;
+} /* static stack_t *wm_stack_get */
+
+static stack_entry_t *wm_stack_entry(wm_t *wm, Window window) {
+  return g_hash_table_lookup(wm->stacks->windows, GUINT_TO_POINTER(window));
+}
+
+static void wm_stack_unlink(wm_t *wm, stack_entry_t *entry) {
+  g_queue_delete_link(&entry->stack->order, entry->link);
+  wm_stack_touch(wm, entry->stack, False);
+  entry->stack = NULL;
+  entry->link = NULL;
+} /* static void wm_stack_unlink */
+
+/* Put 'window' in 'parent' directly above 'sibling', or at the bottom if
+ * sibling is None. Used for what the server tells us. */
+void wm_stack_place(wm_t *wm, Window window, Window parent, Window sibling) {
+  stack_t *stack = wm_stack_get(wm, parent, True);
+  stack_entry_t *entry = wm_stack_entry(wm, window);
+  stack_entry_t *below = NULL;
+
+  if (entry == NULL) {
+    entry = calloc(1, sizeof(stack_entry_t));
+    wm_res_created(wm, WM_RES_HEAP, entry);
+    g_hash_table_insert(wm->stacks->windows, GUINT_TO_POINTER(window), entry);
+  } else if (entry->stack != NULL) {
+    if (entry->stack == stack
+        && ((sibling == None && entry->link->prev == NULL)
+            || (sibling != None && entry->link->prev != NULL
+                && GPOINTER_TO_UINT(entry->link->prev->data) == sibling)))
+      return; /* already there */
+    wm_stack_unlink(wm, entry);
+  }
+
+  if (sibling != None) {
+    below = wm_stack_entry(wm, sibling);
+    if (below == NULL || below->stack != stack) {
+      /* A sibling we haven't seen; it must be somewhere below us. */
+      wm_stack_place(wm, sibling, parent, None);
+      below = wm_stack_entry(wm, sibling);
+    }
+  }
+
+  if (below == NULL) {
+    g_queue_push_head(&stack->order, GUINT_TO_POINTER(window));
+    entry->link = stack->order.head;
+  } else {
+    g_queue_insert_after(&stack->order, below->link, GUINT_TO_POINTER(window));
+    entry->link = below->link->next;
+  }
+  entry->stack = stack;
+  wm_stack_touch(wm, stack, False);
+} /* void wm_stack_place */
+
+/* A new (or newly reparented) child goes on top of its parent's stack. */
+void wm_stack_add(wm_t *wm, Window window, Window parent) {
+  Window top = wm_stack_top(wm, parent);
+
+  if (top != window)
+    wm_stack_place(wm, window, parent, top);
+} /* void wm_stack_add */
+
+/* ReparentNotify. If the window is already in 'parent', it's one of our
+ * own reparents (wm_x_reparent_window added it then), and anything stacked
+ * over it since is right where it is. */
+void wm_stack_reparented(wm_t *wm, Window window, Window parent) {
+  stack_entry_t *entry = wm_stack_entry(wm, window);
+
+  if (entry != NULL && entry->stack != NULL && entry->stack->parent == parent)
+    return;
+  wm_stack_add(wm, window, parent);
+} /* void wm_stack_reparented */
+
+/* The window was destroyed: drop it, and its own stack if it had children. */
+void wm_stack_remove(wm_t *wm, Window window) {
+  stack_entry_t *entry = wm_stack_entry(wm, window);
+  stack_t *stack;
+
+  if (entry != NULL) {
+    if (entry->stack != NULL)
+      wm_stack_unlink(wm, entry);
+    wm_res_freed(wm, WM_RES_HEAP, entry);
+    g_hash_table_remove(wm->stacks->windows, GUINT_TO_POINTER(window));
+  }
+
+  stack = wm_stack_get(wm, window, False);
+  if (stack != NULL) {
+    GList *link;
+    for (link = stack->order.head; link != NULL; link = link->next) {
+      stack_entry_t *child = wm_stack_entry(wm, GPOINTER_TO_UINT(link->data));
+      if (child != NULL) {
+        child->stack = NULL;
+        child->link = NULL;
+      }
+    }
+    g_hash_table_remove(wm->stacks->parents, GUINT_TO_POINTER(window));
+    g_ptr_array_remove_fast(wm->stacks->touched, stack);
+    g_queue_clear(&stack->order);
+    g_array_free(stack->flushed, TRUE);
+    wm_res_freed(wm, WM_RES_HEAP, stack);
+    free(stack);
+  }
+} /* void wm_stack_remove */
+
+/* Raise a window within its parent. The restack is sent by wm_stack_flush. */
+void wm_stack_raise(wm_t *wm, Window window) {
+  stack_entry_t *entry = wm_stack_entry(wm, window);
+  client_t *client = wm_get_client(wm, window, False);
+  stack_t *stack;
+
+  if (client != NULL)
+    wm_occlusion_reveal(wm, client);
+
+  if (entry == NULL || entry->stack == NULL) {
+    wm_log(wm, LOG_WARN, "%s: window %ld isn't in any stack we know of",
+           __func__, window);
+    return;
+  }
+  stack = entry->stack;
+  if (entry->link == stack->order.tail)
+    return;
+  g_queue_unlink(&stack->order, entry->link);
+  g_queue_push_tail_link(&stack->order, entry->link);
+  wm_stack_touch(wm, stack, True);
+} /* void wm_stack_raise */
+
+void wm_stack_lower(wm_t *wm, Window window) {
+  stack_entry_t *entry = wm_stack_entry(wm, window);
+  stack_t *stack;
+
+  if (entry == NULL || entry->stack == NULL) {
+    wm_log(wm, LOG_WARN, "%s: window %ld isn't in any stack we know of",
+           __func__, window);
+    return;
+  }
+  stack = entry->stack;
+  if (entry->link == stack->order.head)
+    return;
+  g_queue_unlink(&stack->order, entry->link);
+  g_queue_push_head_link(&stack->order, entry->link);
+  wm_stack_touch(wm, stack, True);
+} /* void wm_stack_lower */
+
+/* Topmost child of 'parent', or None. */
+Window wm_stack_top(wm_t *wm, Window parent) {
+  stack_t *stack = wm_stack_get(wm, parent, False);
+
+  if (stack == NULL || stack->order.tail == NULL)
+    return None;
+  return GPOINTER_TO_UINT(stack->order.tail->data);
+} /* Window wm_stack_top */
+
+/* Children of 'parent', bottom first, or NULL if we know of none. The
+ * queue belongs to the model; don't change it. */
+const GQueue *wm_stack_order(wm_t *wm, Window parent) {
+  stack_t *stack = wm_stack_get(wm, parent, False);
+
+  return (stack != NULL) ? &stack->order : NULL;
+} /* const GQueue *wm_stack_order */
+
+/* Topmost child of 'parent' that is a client with all of 'flags' set. */
+client_t *wm_stack_top_client(wm_t *wm, Window parent, unsigned int flags) {
+  stack_t *stack = wm_stack_get(wm, parent, False);
+  GList *link;
+
+  if (stack == NULL)
+    return NULL;
+  for (link = stack->order.tail; link != NULL; link = link->prev) {
+    client_t *client = wm_get_client(wm, GPOINTER_TO_UINT(link->data), False);
+    if (client != NULL && (client->flags & flags) == flags)
+      return client;
+  }
+  return NULL;
+} /* client_t *wm_stack_top_client */
+
+static void wm_stack_snapshot(stack_t *stack) {
+  GList *link;
+
+  g_array_set_size(stack->flushed, 0);
+  for (link = stack->order.tail; link != NULL; link = link->prev) {
+    Window window = GPOINTER_TO_UINT(link->data);
+    g_array_append_val(stack->flushed, window);
+  }
+} /* static void wm_stack_snapshot */
+
+static void wm_stack_flush_one(wm_t *wm, stack_t *stack) {
+  unsigned int n = stack->order.length;
+  unsigned int old_n = stack->flushed->len;
+  Window *windows, *old;
+  unsigned int i, common = 0;
+  GList *link;
+
+  windows = malloc(n * sizeof(Window));
+  for (i = 0, link = stack->order.tail; link != NULL; link = link->prev, i++)
+    windows[i] = GPOINTER_TO_UINT(link->data);
+  old = (Window *)stack->flushed->data;
+
+  /* The bottom of the stack that didn't move doesn't need restacking. */
+  while (common < n && common < old_n
+         && windows[n - 1 - common] == old[old_n - 1 - common])
+    common++;
+
+  if (common < n) {
+    if (old_n == 0 || windows[0] != old[0])
+      wm_x_raise_window(wm, windows[0]);
+    /* Include one unmoved window so the moved ones land on top of it. */
+    if (n - common + (common > 0) > 1)
+      wm_x_restack_windows(wm, windows, n - common + (common > 0));
+  }
+  free(windows);
+} /* static void wm_stack_flush_one */
+
+/* Send the restacks for everything raised or lowered since the last call. */
+void wm_stack_flush(wm_t *wm) {
+  GPtrArray *touched;
+  unsigned int i;
+
+  if (wm->stacks == NULL)
+    return;
+
+  touched = wm->stacks->touched;
+  for (i = 0; i < touched->len; i++) {
+    stack_t *stack = g_ptr_array_index(touched, i);
+    if (stack->dirty)
+      wm_stack_flush_one(wm, stack);
+    wm_stack_snapshot(stack);
+    stack->dirty = False;
+    stack->stale = False;
+  }
+  g_ptr_array_set_size(touched, 0);
+} /* void wm_stack_flush */
@@ -0,0 +1,196 @@
+/*
+ * _NET_WM_SYNC_REQUEST resize pacing.
+ *
+ * Clients that support the protocol publish an XSync counter. Before each
+ * resize we send them a sync request with a new counter value, and we don't
+ * send the next resize until the client has bumped its counter to that
+ * value, meaning it has redrawn at the new size. Resizes that arrive in the
+ * meantime are coalesced: only the latest allotted geometry is sent when the
+ * client catches up. A client that doesn't answer within WM_SYNC_TIMEOUT_MS
+ * gets its next resize anyway; the timeout is a timer tied to the client
+ * (timer.c).
+ *
+ * We learn about counter updates from an XSync alarm per client, so waiting
+ * costs no round trips.
+ */
+
+#include "windowmanager.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <X11/extensions/sync.h>
+
+#define WM_SYNC_TIMEOUT_MS 200
+
+void wm_sync_init(wm_t *wm) {
+  int event_base, error_base;
+  int major, minor;
+
+  wm->sync_event_base = -1;
+  wm->sync_pending = g_ptr_array_new();
+
+  if (wm->dpy == NULL)
+    return;
+
+  if (!XSyncQueryExtension(wm->dpy, &event_base, &error_base)
+      || !XSyncInitialize(wm->dpy, &major, &minor)) {
+    wm_log(wm, LOG_INFO, "%s: no XSync extension, resizes won't be paced",
+           __func__);
+    return;
+  }
+  wm->sync_event_base = event_base;
+} /* void wm_sync_init */
+
+/* A bad counter (or a client that destroyed its counter) means no more
+ * pacing for that client. */
+static void wm_sync_alarm_failed(wm_t *wm, XErrorEvent *error, Window window,
+                                 const char *op, gpointer data) {
+  client_t *client = wm_get_client(wm, window, False);
+
+  wm_log(wm, LOG_INFO, "%s: %s failed for window %ld, not pacing its resizes",
+         __func__, op, window);
+  if (client != NULL) {
+    /* A failed create leaves nothing to destroy */
+    if (GPOINTER_TO_INT(data)) {
+      wm_res_freed(wm, WM_RES_ALARM, GUINT_TO_POINTER(client->sync.alarm));
+      client->sync.alarm = None;
+    }
+    wm_sync_set_counter(wm, client, None);
+  }
+} /* static void wm_sync_alarm_failed */
+
+static void wm_sync_set_alarm(wm_t *wm, client_t *client) {
+  XSyncAlarmAttributes attr;
+  unsigned long mask;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.trigger.counter = client->sync.counter;
+  attr.trigger.value_type = XSyncAbsolute;
+  attr.trigger.test_type = XSyncPositiveComparison;
+  XSyncIntsToValue(&attr.trigger.wait_value,
+                   (unsigned int)(client->sync.value & 0xffffffff),
+                   (int)(client->sync.value >> 32));
+  XSyncIntsToValue(&attr.delta, 0, 0);
+  attr.events = True;
+  mask = XSyncCACounter | XSyncCAValueType | XSyncCAValue | XSyncCATestType
+         | XSyncCADelta | XSyncCAEvents;
+
+  wm_error_track(wm, client->window, __func__, wm_sync_alarm_failed,
+                 GINT_TO_POINTER(client->sync.alarm == None));
+  if (client->sync.alarm == None) {
+    client->sync.alarm = XSyncCreateAlarm(wm->dpy, mask, &attr);
+    wm_res_created(wm, WM_RES_ALARM, GUINT_TO_POINTER(client->sync.alarm));
+  } else {
+    XSyncChangeAlarm(wm->dpy, client->sync.alarm, mask, &attr);
+  }
+} /* static void wm_sync_set_alarm */
+
+static void wm_sync_timed_out(wm_t *wm, client_t *client, gpointer data);
+
+static void wm_sync_send_request(wm_t *wm, client_t *client) {
+  XEvent ev;
+
+  client->sync.value++;
+
+  memset(&ev, 0, sizeof(ev));
+  ev.xclient.type = ClientMessage;
+  ev.xclient.window = client->window;
+  ev.xclient.message_type = XInternAtom(wm->dpy, "WM_PROTOCOLS", False);
+  ev.xclient.format = 32;
+  ev.xclient.data.l[0] = XInternAtom(wm->dpy, "_NET_WM_SYNC_REQUEST", False);
+  ev.xclient.data.l[1] = CurrentTime;
+  ev.xclient.data.l[2] = client->sync.value & 0xffffffff;
+  ev.xclient.data.l[3] = (client->sync.value >> 32) & 0xffffffff;
+  ev.xclient.data.l[4] = 0;
+  wm_x_send_event(wm, client->window, NoEventMask, &ev);
+
+  wm_sync_set_alarm(wm, client);
+  client->sync.sent = g_get_monotonic_time();
+  client->sync.timeout = wm_timer_add(wm, WM_SYNC_TIMEOUT_MS, client,
+                                      wm_sync_timed_out, NULL);
+  g_ptr_array_add(wm->sync_pending, client);
+} /* static void wm_sync_send_request */
+
+/* Called by wm_client_moveresize once the new geometry is in
+ * client->allotted. Returns False if the client doesn't do sync requests and
+ * the caller should just configure it. */
+Bool wm_sync_resize(wm_t *wm, client_t *client) {
+  if (wm->dpy == NULL || wm->sync_event_base < 0 || client->sync.counter == None)
+    return False;
+
+  if (client->sync.sent != 0) {
+    /* Still waiting on the last one; send the latest geometry later. */
+    client->sync.queued = True;
+    return True;
+  }
+
+  client->sync.queued = False;
+  wm_sync_send_request(wm, client);
+  wm_x_move_resize_window(wm, client->window,
+                          client->allotted.x, client->allotted.y,
+                          client->allotted.width, client->allotted.height);
+  return True;
+} /* Bool wm_sync_resize */
+
+/* The client caught up, or we gave up waiting. Send whatever came in since. */
+static void wm_sync_done(wm_t *wm, client_t *client) {
+  g_ptr_array_remove_fast(wm->sync_pending, client);
+  wm_timer_cancel(wm, client->sync.timeout);
+  client->sync.timeout = 0;
+  client->sync.sent = 0;
+  if (client->sync.queued)
+    wm_sync_resize(wm, client);
+} /* static void wm_sync_done */
+
+void wm_sync_alarm_notify(wm_t *wm, XEvent *ev) {
+  XSyncAlarmNotifyEvent *aev = (XSyncAlarmNotifyEvent *)ev;
+  gint64 value;
+  unsigned int i;
+
+  value = ((gint64)XSyncValueHigh32(aev->counter_value) << 32)
+          | XSyncValueLow32(aev->counter_value);
+
+  for (i = 0; i < wm->sync_pending->len; i++) {
+    client_t *client = g_ptr_array_index(wm->sync_pending, i);
+    if (client->sync.alarm == aev->alarm) {
+      if (value >= client->sync.value)
+        wm_sync_done(wm, client);
+      return;
+    }
+  }
+} /* void wm_sync_alarm_notify */
+
+/* Stop waiting on a client that didn't answer in time. */
+static void wm_sync_timed_out(wm_t *wm, client_t *client, gpointer data) {
+  wm_log(wm, LOG_INFO, "%s: window %ld didn't answer sync request %lld",
+         __func__, client->window, (long long)client->sync.value);
+  client->sync.timeout = 0;
+  wm_sync_done(wm, client);
+} /* static void wm_sync_timed_out */
+
+/* Set or change the counter a client told us about. */
+void wm_sync_set_counter(wm_t *wm, client_t *client, XID counter) {
+  if (client->sync.counter == counter)
+    return;
+  if (client->sync.alarm != None && wm->dpy != NULL) {
+    XSyncDestroyAlarm(wm->dpy, client->sync.alarm);
+    wm_res_freed(wm, WM_RES_ALARM, GUINT_TO_POINTER(client->sync.alarm));
+  }
+  client->sync.alarm = None;
+  client->sync.counter = counter;
+  if (client->sync.sent != 0)
+    wm_sync_done(wm, client);
+} /* void wm_sync_set_counter */
+
+void wm_sync_forget(wm_t *wm, client_t *client) {
+  if (client->sync.sent != 0)
+    g_ptr_array_remove_fast(wm->sync_pending, client);
+  wm_timer_cancel(wm, client->sync.timeout);
+  client->sync.timeout = 0;
+  client->sync.sent = 0;
+  if (client->sync.alarm != None && wm->dpy != NULL) {
+    XSyncDestroyAlarm(wm->dpy, client->sync.alarm);
+    wm_res_freed(wm, WM_RES_ALARM, GUINT_TO_POINTER(client->sync.alarm));
+  }
+  client->sync.alarm = None;
+} /* void wm_sync_forget */
@@ -0,0 +1,282 @@
+/*
+ * Timers, on a hierarchical timing wheel.
+ *
+ * Time is counted in millisecond ticks. The wheel has WHEEL_LEVELS levels of
+ * WHEEL_SLOTS slots each: level 0 holds timers due within 64ms, one slot per
+ * tick, level 1 those due within 64*64ms, one slot per 64 ticks, and so on.
+ * When level 0 wraps around, the next level 1 slot is cascaded: its timers
+ * are spread over level 0. Adding and cancelling a timer is a list insert or
+ * unlink, whatever the number of timers.
+ *
+ * Nothing ticks while nothing is due. A bitmap of occupied slots per level
+ * tells wm_timer_timeout() how long wm_main may sleep, and lets
+ * wm_timer_run() jump straight past empty ticks after a long sleep.
+ *
+ * A timer can belong to a client, in which case it is cancelled when the
+ * client is removed (on withdrawal or destruction), so callbacks never see a
+ * freed client. Timers are referred to by id, so cancelling one that already
+ * fired is harmless.
+ */
+
+#include "windowmanager.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS 4
+/* Anything further out waits in the last level and is re-added when it
+ * comes up; about 4.6 hours. */
+#define WHEEL_MAX_DELTA (((guint64)1 << (WHEEL_BITS * WHEEL_LEVELS)) - 1)
+
+struct wm_timer {
+  guint id;
+  guint64 expires; /* tick */
+  wm_timer_func func;
+  client_t *client; /* NULL if not tied to a client */
+  gpointer data;
+
+  unsigned char level, slot;
+  struct wm_timer *prev, *next; /* in the wheel slot */
+  struct wm_timer *client_prev, *client_next; /* in client->timers */
+};
+
+struct wm_timers {
+  gint64 epoch; /* monotonic usec at tick 0 */
+  guint64 tick; /* every timer due at or before this has fired */
+  struct wm_timer *slots[WHEEL_LEVELS][WHEEL_SLOTS];
+  guint64 occupied[WHEEL_LEVELS]; /* bit per non-empty slot */
+  GHashTable *ids; /* id -> struct wm_timer */
+  guint next_id;
+};
+
+static guint64 wm_timer_now(struct wm_timers *timers) {
+  return (g_get_monotonic_time() - timers->epoch) / 1000;
+} /* static guint64 wm_timer_now */
+
+void wm_timer_init(wm_t *wm) {
+  wm->timers = calloc(1, sizeof(struct wm_timers));
+  wm->timers->epoch = g_get_monotonic_time();
+  wm->timers->ids = g_hash_table_new(g_direct_hash, g_direct_equal);
+  wm->timers->next_id = 1;
+} /* void wm_timer_init */
+
+/* 'earliest' is the first tick whose slot hasn't been processed yet */
+static void wm_timer_link(struct wm_timers *timers, struct wm_timer *timer,
+                          guint64 earliest) {
+  guint64 expires = timer->expires;
+  guint64 delta;
+  int level;
+
+  if (expires < earliest)
+    expires = earliest;
+  delta = expires - timers->tick;
+  if (delta > WHEEL_MAX_DELTA) {
+    delta = WHEEL_MAX_DELTA;
+    expires = timers->tick + delta;
+  }
+
+  for (level = 0; level < WHEEL_LEVELS - 1; level++)
+    if (delta < ((guint64)1 << (WHEEL_BITS * (level + 1))))
+      break;
+
+  timer->level = level;
+  timer->slot = (expires >> (WHEEL_BITS * level)) & WHEEL_MASK;
+  timer->prev = NULL;
+  timer->next = timers->slots[level][timer->slot];
+  if (timer->next != NULL)
+    timer->next->prev = timer;
+  timers->slots[level][timer->slot] = timer;
+  timers->occupied[level] |= (guint64)1 << timer->slot;
+} /* static void wm_timer_link */
+
+static void wm_timer_unlink(struct wm_timers *timers, struct wm_timer *timer) {
+  if (timer->prev != NULL)
+    timer->prev->next = timer->next;
+  else
+    timers->slots[timer->level][timer->slot] = timer->next;
+  if (timer->next != NULL)
+    timer->next->prev = timer->prev;
+  if (timers->slots[timer->level][timer->slot] == NULL)
+    timers->occupied[timer->level] &= ~((guint64)1 << timer->slot);
+} /* static void wm_timer_unlink */
+
+/* Call func(wm, client, data) in 'msec' milliseconds. If client isn't NULL
+ * the timer goes away with it. Returns an id for wm_timer_cancel; never 0. */
+guint wm_timer_add(wm_t *wm, unsigned int msec, client_t *client,
+                   wm_timer_func func, gpointer data) {
+  struct wm_timers *timers = wm->timers;
+  struct wm_timer *timer;
+
+  timer = malloc(sizeof(struct wm_timer));
+  wm_res_created(wm, WM_RES_HEAP, timer);
+  while (timers->next_id == 0
+         || g_hash_table_lookup(timers->ids, GUINT_TO_POINTER(timers->next_id)))
+    timers->next_id++;
+  timer->id = timers->next_id++;
+  /* The wheel only moves in wm_timer_run, so count from the real time */
+  timer->expires = wm_timer_now(timers) + msec;
+  timer->func = func;
+  timer->client = client;
+  timer->data = data;
+
+  timer->client_prev = NULL;
+  timer->client_next = NULL;
+  if (client != NULL) {
+    timer->client_next = client->timers;
+    if (client->timers != NULL)
+      client->timers->client_prev = timer;
+    client->timers = timer;
+  }
+
+  wm_timer_link(timers, timer, timers->tick + 1);
+  g_hash_table_insert(timers->ids, GUINT_TO_POINTER(timer->id), timer);
+  return timer->id;
+} /* guint wm_timer_add */
+
+static void wm_timer_forget(wm_t *wm, struct wm_timer *timer) {
+  client_t *client = timer->client;
+
+  wm_timer_unlink(wm->timers, timer);
+  g_hash_table_remove(wm->timers->ids, GUINT_TO_POINTER(timer->id));
+  wm_res_freed(wm, WM_RES_HEAP, timer);
+  if (client != NULL) {
+    if (timer->client_prev != NULL)
+      timer->client_prev->client_next = timer->client_next;
+    else
+      client->timers = timer->client_next;
+    if (timer->client_next != NULL)
+      timer->client_next->client_prev = timer->client_prev;
+  }
+} /* static void wm_timer_forget */
+
+/* Cancel a pending timer. Ids of timers that fired or were cancelled are
+ * ignored. */
+void wm_timer_cancel(wm_t *wm, guint id) {
+  struct wm_timer *timer;
+
+  if (id == 0 || wm->timers == NULL)
+    return;
+  timer = g_hash_table_lookup(wm->timers->ids, GUINT_TO_POINTER(id));
+  if (timer == NULL)
+    return;
+  wm_timer_forget(wm, timer);
+  free(timer);
+} /* void wm_timer_cancel */
+
+/* wm_remove_client calls this before freeing the client */
+void wm_timer_cancel_client(wm_t *wm, client_t *client) {
+  while (client->timers != NULL)
+    wm_timer_cancel(wm, client->timers->id);
+} /* void wm_timer_cancel_client */
+
+/* Ticks from 'tick' until the next slot at 'level' that has timers comes
+ * up, or 0 if none do. */
+static guint64 wm_timer_next_slot(struct wm_timers *timers, guint64 tick,
+                                  int level) {
+  int shift = WHEEL_BITS * level;
+  guint64 occupied = timers->occupied[level];
+  guint64 base, rotated;
+  unsigned int start, distance;
+
+  if (occupied == 0)
+    return 0;
+
+  /* The next time this level is processed is when the levels below wrap */
+  base = (tick >> shift) + 1;
+  start = base & WHEEL_MASK;
+  rotated = (occupied >> start) | (start ? occupied << (WHEEL_SLOTS - start) : 0);
+  distance = __builtin_ctzll(rotated);
+  return ((base + distance) << shift) - tick;
+} /* static guint64 wm_timer_next_slot */
+
+/* Ticks until something needs doing, or 0 if nothing ever does. */
+static guint64 wm_timer_next(struct wm_timers *timers) {
+  guint64 next = 0, ticks;
+  int level;
+
+  for (level = 0; level < WHEEL_LEVELS; level++) {
+    ticks = wm_timer_next_slot(timers, timers->tick, level);
+    if (ticks != 0 && (next == 0 || ticks < next))
+      next = ticks;
+  }
+  return next;
+} /* static guint64 wm_timer_next */
+
+/* Milliseconds until the next timer is due, or -1 if none is pending. For
+ * poll(). */
+int wm_timer_timeout(wm_t *wm) {
+  struct wm_timers *timers = wm->timers;
+  guint64 next, now, due;
+
+  if (timers == NULL || g_hash_table_size(timers->ids) == 0)
+    return -1;
+  next = wm_timer_next(timers);
+  if (next == 0)
+    return -1;
+  due = timers->tick + next;
+  now = wm_timer_now(timers);
+  if (due <= now)
+    return 0;
+  return (due - now > G_MAXINT) ? G_MAXINT : (int)(due - now);
+} /* int wm_timer_timeout */
+
+/* Move the timers in a slot of 'level' down toward level 0 */
+static void wm_timer_cascade(struct wm_timers *timers, int level,
+                             unsigned int slot) {
+  struct wm_timer *timer;
+
+  while ((timer = timers->slots[level][slot]) != NULL) {
+    wm_timer_unlink(timers, timer);
+    wm_timer_link(timers, timer, timers->tick);
+  }
+} /* static void wm_timer_cascade */
+
+/* Fire everything that is due. */
+void wm_timer_run(wm_t *wm) {
+  struct wm_timers *timers = wm->timers;
+  guint64 now, next;
+  struct wm_timer *timer;
+  unsigned int slot;
+  int level;
+
+  if (timers == NULL)
+    return;
+
+  now = wm_timer_now(timers);
+  while (timers->tick < now) {
+    next = wm_timer_next(timers);
+    if (next == 0 || timers->tick + next > now) {
+      timers->tick = now;
+      break;
+    }
+    timers->tick += next;
+
+    /* Cascade each level whose turn it is, top down */
+    for (level = WHEEL_LEVELS - 1; level > 0; level--) {
+      if ((timers->tick & (((guint64)1 << (WHEEL_BITS * level)) - 1)) == 0)
+        wm_timer_cascade(timers, level,
+                         (timers->tick >> (WHEEL_BITS * level)) & WHEEL_MASK);
+    }
+
+    slot = timers->tick & WHEEL_MASK;
+    while ((timer = timers->slots[0][slot]) != NULL) {
+      if (timer->expires > timers->tick) {
+        /* Was too far out for the wheel; keep waiting */
+        wm_timer_unlink(timers, timer);
+        wm_timer_link(timers, timer, timers->tick + 1);
+        continue;
+      }
+      /* The callback may add and cancel timers, even this slot's */
+      wm_timer_forget(wm, timer);
+      timer->func(wm, timer->client, timer->data);
+      free(timer);
+    }
+  }
+} /* void wm_timer_run */
+
+unsigned int wm_timer_count(wm_t *wm) {
+  return (wm->timers != NULL) ? g_hash_table_size(wm->timers->ids) : 0;
+} /* unsigned int wm_timer_count */
@@ -0,0 +1,311 @@
+/*
+ * Title bar rendering.
+ *
+ * Titles are measured and rendered once per (text, size, focus state, font,
+ * screen, icon) into a pixmap, and exposes are answered by copying from the
+ * pixmap. The rendered pixmaps are kept in an LRU cache of bounded size so a
+ * frame with dozens of tabs repaints with nothing but XCopyArea.
+ *
+ * Text widths are cached separately since truncating a long title to fit
+ * means measuring it more than once.
+ *
+ * An icon (icon.c) goes at the left, blended over the background once at
+ * render time. Icons are keyed by their content hash, so every window of an
+ * application shares the same rendered titles.
+ */
+
+#include "windowmanager.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TITLE_ELLIPSIS "..."
+#define TITLE_PADDING 4
+#define TITLE_MAX_EXTENTS 4096
+
+typedef struct title_key {
+  char *text;
+  unsigned int width;
+  unsigned int height;
+  Bool focused;
+  Font font;
+  int screen;
+  guint64 icon; /* hash of the icon, 0 for none */
+} title_key_t;
+
+typedef struct title_entry {
+  title_key_t key;
+  Pixmap pixmap;
+  GList *link; /* position in the LRU queue; head is most recently used */
+} title_entry_t;
+
+typedef struct title_screen {
+  GC bg[2]; /* indexed by focus state */
+  XColor bg_color[2]; /* for blending icons over */
+  GC fg[2];
+  GC border;
+} title_screen_t;
+
+struct wm_titles {
+  XFontStruct *font;
+  title_screen_t *screens;
+
+  GHashTable *cache; /* title_key_t -> title_entry_t */
+  GQueue lru;
+  unsigned int max_entries;
+
+  GHashTable *extents; /* text -> width + 1 */
+
+  unsigned long hits;
+  unsigned long misses;
+};
+
+static guint title_key_hash(gconstpointer data) {
+  const title_key_t *key = data;
+  return g_str_hash(key->text) ^ (key->width * 31) ^ (key->height << 16)
+         ^ (key->focused << 30) ^ key->font ^ (key->screen << 24)
+         ^ (guint)key->icon ^ (guint)(key->icon >> 32);
+} /* static guint title_key_hash */
+
+static gboolean title_key_equal(gconstpointer a, gconstpointer b) {
+  const title_key_t *ka = a, *kb = b;
+  return ka->width == kb->width && ka->height == kb->height
+         && ka->focused == kb->focused && ka->font == kb->font
+         && ka->screen == kb->screen && ka->icon == kb->icon
+         && strcmp(ka->text, kb->text) == 0;
+} /* static gboolean title_key_equal */
+
+/* 'xcolor' gets the color as allocated */
+static GC title_gc(wm_t *wm, Screen *screen, const char *color, Font font,
+                   XColor *xcolor) {
+  GC gc;
+  XGCValues gcv;
+  unsigned long valuemask = GCForeground | GCLineWidth | GCLineStyle;
+
+  XParseColor(wm->dpy, DefaultColormapOfScreen(screen), color, xcolor);
+  XAllocColor(wm->dpy, DefaultColormapOfScreen(screen), xcolor);
+  wm_res_created(wm, WM_RES_COLOR, GUINT_TO_POINTER(xcolor->pixel));
+  gcv.foreground = xcolor->pixel;
+  gcv.line_width = 1;
+  gcv.line_style = LineSolid;
+  if (font != None) {
+    gcv.font = font;
+    valuemask |= GCFont;
+  }
+  gc = XCreateGC(wm->dpy, RootWindowOfScreen(screen), valuemask, &gcv);
+  wm_res_created(wm, WM_RES_GC, gc);
+  return gc;
+} /* static GC title_gc */
+
+/* Load the title font and colors. A NULL font_name means the theme's.
+ * max_entries bounds the number of rendered titles kept around; the one
+ * being drawn is always kept, so it's at least 1. */
+Bool wm_title_init(wm_t *wm, const char *font_name, unsigned int max_entries) {
+  const wm_theme_t *theme = wm_get_theme(wm);
+  struct wm_titles *titles;
+  int i;
+
+  if (wm->titles != NULL)
+    return True;
+  if (font_name == NULL)
+    font_name = theme->title_font;
+
+  titles = calloc(1, sizeof(struct wm_titles));
+  titles->font = XLoadQueryFont(wm->dpy, font_name);
+  if (titles->font == NULL) {
+    wm_log(wm, LOG_WARN, "%s: can't load font '%s', using 'fixed'", __func__,
+           font_name);
+    titles->font = XLoadQueryFont(wm->dpy, "fixed");
+  }
+  if (titles->font == NULL) {
+    wm_log(wm, LOG_ERROR, "%s: can't load any title font", __func__);
+    free(titles);
+    return False;
+  }
+
+  titles->screens = calloc(wm->num_screens, sizeof(title_screen_t));
+  for (i = 0; i < wm->num_screens; i++) {
+    Screen *screen = wm->screens[i];
+    Font fid = titles->font->fid;
+    title_screen_t *ts = &titles->screens[i];
+    XColor unused;
+    ts->bg[False] = title_gc(wm, screen, theme->title_bg[False], None,
+                             &ts->bg_color[False]);
+    ts->bg[True] = title_gc(wm, screen, theme->title_bg[True], None,
+                            &ts->bg_color[True]);
+    ts->fg[False] = title_gc(wm, screen, theme->title_fg[False], fid, &unused);
+    ts->fg[True] = title_gc(wm, screen, theme->title_fg[True], fid, &unused);
+    ts->border = title_gc(wm, screen, theme->title_border, None, &unused);
+  }
+
+  titles->cache = g_hash_table_new(title_key_hash, title_key_equal);
+  g_queue_init(&titles->lru);
+  titles->max_entries = (max_entries > 0) ? max_entries : 1;
+  titles->extents = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+
+  wm->titles = titles;
+  return True;
+} /* Bool wm_title_init */
+
+/* Height of a title bar with the current font */
+unsigned int wm_title_height(wm_t *wm) {
+  if (wm->titles == NULL)
+    return 0;
+  return wm->titles->font->ascent + wm->titles->font->descent + TITLE_PADDING;
+} /* unsigned int wm_title_height */
+
+static unsigned int wm_title_text_width(struct wm_titles *titles,
+                                        const char *text, int len) {
+  gpointer value;
+  char *key;
+  int width;
+
+  /* Only whole strings are worth caching; prefixes are measured directly. */
+  if (text[len] != '\0')
+    return XTextWidth(titles->font, text, len);
+
+  value = g_hash_table_lookup(titles->extents, text);
+  if (value != NULL)
+    return GPOINTER_TO_UINT(value) - 1;
+
+  if (g_hash_table_size(titles->extents) >= TITLE_MAX_EXTENTS)
+    g_hash_table_remove_all(titles->extents);
+
+  width = XTextWidth(titles->font, text, len);
+  key = strdup(text);
+  g_hash_table_insert(titles->extents, key, GUINT_TO_POINTER(width + 1));
+  return width;
+} /* static unsigned int wm_title_text_width */
+
+static void wm_title_render(wm_t *wm, title_entry_t *entry, Screen *screen,
+                            const wm_icon_t *icon) {
+  struct wm_titles *titles = wm->titles;
+  title_screen_t *ts = &titles->screens[entry->key.screen];
+  title_key_t *key = &entry->key;
+  const char *text = key->text;
+  int len = strlen(text);
+  unsigned int text_width, space = key->width;
+  int xpos, ypos, left = 0;
+  char *truncated = NULL;
+
+  entry->pixmap = XCreatePixmap(wm->dpy, RootWindowOfScreen(screen),
+                                key->width, key->height,
+                                DefaultDepthOfScreen(screen));
+  wm_res_created(wm, WM_RES_PIXMAP, GUINT_TO_POINTER(entry->pixmap));
+
+  XFillRectangle(wm->dpy, entry->pixmap, ts->bg[key->focused], 0, 0,
+                 key->width, key->height);
+  XDrawRectangle(wm->dpy, entry->pixmap, ts->border, 0, 0,
+                 key->width - 1, key->height - 1);
+
+  /* The icon, if it fits, and the text centered in what's left of it */
+  if (icon != NULL && icon->width + TITLE_PADDING < key->width
+      && icon->height <= key->height) {
+    wm_icon_draw(wm, icon, entry->pixmap, ts->bg[key->focused], screen,
+                 TITLE_PADDING / 2, (key->height - icon->height) / 2,
+                 &ts->bg_color[key->focused]);
+    left = icon->width + TITLE_PADDING / 2;
+    space -= left;
+  }
+
+  /* Shorten the title until it fits, ending it with an ellipsis. */
+  text_width = wm_title_text_width(titles, text, len);
+  if (text_width + TITLE_PADDING > space) {
+    unsigned int ellipsis = XTextWidth(titles->font, TITLE_ELLIPSIS,
+                                       strlen(TITLE_ELLIPSIS));
+    while (len > 0 && text_width + ellipsis + TITLE_PADDING > space) {
+      len--;
+      text_width = wm_title_text_width(titles, text, len);
+    }
+    truncated = malloc(len + strlen(TITLE_ELLIPSIS) + 1);
+    memcpy(truncated, text, len);
+    strcpy(truncated + len, TITLE_ELLIPSIS);
+    text = truncated;
+    len = strlen(truncated);
+    text_width += ellipsis;
+  }
+
+  xpos = ((int)space - (int)text_width) / 2;
+  if (xpos < TITLE_PADDING / 2)
+    xpos = TITLE_PADDING / 2;
+  xpos += left;
+  ypos = (key->height - titles->font->ascent - titles->font->descent) / 2
+         + titles->font->ascent;
+  XDrawString(wm->dpy, entry->pixmap, ts->fg[key->focused], xpos, ypos,
+              text, len);
+  free(truncated);
+} /* static void wm_title_render */
+
+static void wm_title_evict(wm_t *wm) {
+  struct wm_titles *titles = wm->titles;
+  title_entry_t *entry;
+
+  while (g_queue_get_length(&titles->lru) > titles->max_entries) {
+    entry = g_queue_pop_tail(&titles->lru);
+    g_hash_table_remove(titles->cache, &entry->key);
+    XFreePixmap(wm->dpy, entry->pixmap);
+    wm_res_freed(wm, WM_RES_PIXMAP, GUINT_TO_POINTER(entry->pixmap));
+    wm_res_freed(wm, WM_RES_HEAP, entry);
+    free(entry->key.text);
+    free(entry);
+  }
+} /* static void wm_title_evict */
+
+/* Draw a title of the given size onto 'dest' at x,y, with 'icon' (from
+ * wm_icon_get, or NULL) at its left. Rendering only happens the first time a
+ * given title is drawn; after that it's a copy. */
+void wm_title_draw_icon(wm_t *wm, Drawable dest, Screen *screen, int x, int y,
+                        unsigned int width, unsigned int height,
+                        const char *text, Bool focused, const wm_icon_t *icon) {
+  struct wm_titles *titles = wm->titles;
+  title_entry_t *entry;
+  title_key_t key;
+
+  if (titles == NULL || width == 0 || height == 0)
+    return;
+
+  key.text = (char *)(text != NULL ? text : "");
+  key.width = width;
+  key.height = height;
+  key.focused = focused ? True : False;
+  key.font = titles->font->fid;
+  key.screen = XScreenNumberOfScreen(screen);
+  key.icon = (icon != NULL) ? icon->hash : 0;
+
+  entry = g_hash_table_lookup(titles->cache, &key);
+  if (entry != NULL) {
+    titles->hits++;
+    g_queue_unlink(&titles->lru, entry->link);
+    g_queue_push_head_link(&titles->lru, entry->link);
+  } else {
+    titles->misses++;
+    entry = calloc(1, sizeof(title_entry_t));
+    wm_res_created(wm, WM_RES_HEAP, entry);
+    entry->key = key;
+    entry->key.text = strdup(key.text);
+    wm_title_render(wm, entry, screen, icon);
+    g_queue_push_head(&titles->lru, entry);
+    entry->link = titles->lru.head;
+    g_hash_table_insert(titles->cache, &entry->key, entry);
+    wm_title_evict(wm);
+  }
+
+  XCopyArea(wm->dpy, entry->pixmap, dest, titles->screens[key.screen].fg[False],
+            0, 0, width, height, x, y);
+} /* void wm_title_draw_icon */
+
+void wm_title_draw(wm_t *wm, Drawable dest, Screen *screen, int x, int y,
+                   unsigned int width, unsigned int height,
+                   const char *text, Bool focused) {
+  wm_title_draw_icon(wm, dest, screen, x, y, width, height, text, focused,
+                     NULL);
+} /* void wm_title_draw */
+
+void wm_title_stats(wm_t *wm, unsigned long *hits, unsigned long *misses,
+                    unsigned int *entries) {
+  struct wm_titles *titles = wm->titles;
+  *hits = (titles != NULL) ? titles->hits : 0;
+  *misses = (titles != NULL) ? titles->misses : 0;
+  *entries = (titles != NULL) ? g_queue_get_length(&titles->lru) : 0;
+} /* void wm_title_stats */
@@ -0,0 +1,294 @@
+/*
+ * Layout transactions.
+ *
+ * One user action is often a string of requests to several windows: a
+ * container shrinks, a frame is moved into place and mapped, a client is
+ * reparented into it, resized and focused. Sent as they're made, the server
+ * shows every step. Between wm_txn_begin() and wm_txn_commit() the wm_x_*
+ * wrappers for geometry, mapping and focus record what they're asked for
+ * instead, merging repeated changes to the same window, and the commit
+ * sends what's left in this order:
+ *
+ *   1. windows that end up unmapped
+ *   2. geometry: one ConfigureWindow per window, the last value of each
+ *      field winning
+ *   3. stacking, through wm_stack_flush() (stack.c already batches it)
+ *   4. windows that end up mapped, now that they're in place
+ *   5. focus, the last window asked for
+ *
+ * and flushes. With WM_TXN_GRAB the server is grabbed from wm_txn_begin
+ * until then, so other clients (a compositor, say) never see it half done,
+ * including the requests that aren't recorded: reparents, property
+ * changes, and anything sent with Xlib directly.
+ *
+ * Merging keeps the events the server would have sent: a map or unmap only
+ * disappears if it repeats the one before it, which the server would have
+ * ignored anyway, so the ignore counts in client_t stay right. A reparent
+ * sends the window's maps and unmaps ahead of it, and replaces its recorded
+ * position (see wm_txn_barrier). Everything else, round trips included,
+ * goes straight through, though wm_x_get_window_attributes answers with the
+ * recorded geometry. Transactions nest; the outermost commit sends.
+ */
+
+#include "windowmanager.h"
+
+#include <stdlib.h>
+
+#define TXN_GEOMETRY (CWX | CWY | CWWidth | CWHeight | CWBorderWidth)
+
+typedef struct txn_window {
+  Window window;
+  unsigned int mask; /* TXN_GEOMETRY bits set in 'changes' */
+  XWindowChanges changes;
+  /* Maps and unmaps alternate, so they're the first one and a count */
+  Bool first_map;
+  unsigned int maps;
+} txn_window_t;
+
+struct wm_txn {
+  unsigned int depth;
+  unsigned int flags;
+  Bool grabbed; /* by wm_txn_begin, for WM_TXN_GRAB */
+  Bool applying; /* the wrappers are sending, not recording */
+
+  GArray *windows; /* txn_window_t, in the order first touched */
+  GHashTable *index; /* Window -> position in 'windows' + 1 */
+  Window focus;
+  int revert_to;
+  Bool focus_pending;
+
+  unsigned long commits;
+  unsigned long recorded;
+  unsigned long sent;
+};
+
+void wm_txn_init(wm_t *wm) {
+  struct wm_txn *txn;
+
+  txn = calloc(1, sizeof(struct wm_txn));
+  txn->windows = g_array_new(False, True, sizeof(txn_window_t));
+  txn->index = g_hash_table_new(g_direct_hash, g_direct_equal);
+  wm->txn = txn;
+} /* void wm_txn_init */
+
+/* Start recording. Flags from every level of nesting apply to the
+ * commit; a nested WM_TXN_GRAB grabs from there on. */
+void wm_txn_begin(wm_t *wm, unsigned int flags) {
+  struct wm_txn *txn = wm->txn;
+
+  txn->depth++;
+  txn->flags |= flags;
+  if ((txn->flags & WM_TXN_GRAB) && !txn->grabbed) {
+    wm_x_grab_server(wm);
+    txn->grabbed = True;
+  }
+} /* void wm_txn_begin */
+
+/* Whether the wrappers should record rather than send */
+static Bool wm_txn_recording(wm_t *wm) {
+  return wm->txn != NULL && wm->txn->depth > 0 && !wm->txn->applying;
+} /* static Bool wm_txn_recording */
+
+static txn_window_t *wm_txn_window(wm_t *wm, Window w) {
+  struct wm_txn *txn = wm->txn;
+  guint position;
+  txn_window_t *tw;
+
+  position = GPOINTER_TO_UINT(g_hash_table_lookup(txn->index,
+                                                  GUINT_TO_POINTER(w)));
+  if (position > 0)
+    return &g_array_index(txn->windows, txn_window_t, position - 1);
+  g_array_set_size(txn->windows, txn->windows->len + 1);
+  tw = &g_array_index(txn->windows, txn_window_t, txn->windows->len - 1);
+  tw->window = w;
+  g_hash_table_insert(txn->index, GUINT_TO_POINTER(w),
+                      GUINT_TO_POINTER(txn->windows->len));
+  return tw;
+} /* static txn_window_t *wm_txn_window */
+
+/* An odd number starting with an unmap, or an even number starting with a
+ * map */
+static Bool wm_txn_ends_unmapped(txn_window_t *tw) {
+  return tw->maps > 0 && tw->first_map == (tw->maps % 2 == 0);
+} /* static Bool wm_txn_ends_unmapped */
+
+/* Record a map (or unmap) of 'w'. Returns False if there's no transaction
+ * and the caller should send it. */
+Bool wm_txn_map(wm_t *wm, Window w, Bool map) {
+  txn_window_t *tw;
+
+  if (!wm_txn_recording(wm))
+    return False;
+  wm->txn->recorded++;
+  tw = wm_txn_window(wm, w);
+  if (tw->maps == 0)
+    tw->first_map = map;
+  /* The last one is a map if the first was and there were an odd number */
+  if (tw->maps == 0 || (tw->first_map == map) != (tw->maps % 2 == 1))
+    tw->maps++;
+  return True;
+} /* Bool wm_txn_map */
+
+/* Record the geometry part of a ConfigureWindow. Returns the part of
+ * 'value_mask' the caller should still send now: all of it outside a
+ * transaction, else only stacking. */
+unsigned int wm_txn_configure(wm_t *wm, Window w, unsigned int value_mask,
+                              XWindowChanges *changes) {
+  txn_window_t *tw;
+
+  if (!wm_txn_recording(wm) || !(value_mask & TXN_GEOMETRY))
+    return value_mask;
+  wm->txn->recorded++;
+  tw = wm_txn_window(wm, w);
+  if (value_mask & CWX)
+    tw->changes.x = changes->x;
+  if (value_mask & CWY)
+    tw->changes.y = changes->y;
+  if (value_mask & CWWidth)
+    tw->changes.width = changes->width;
+  if (value_mask & CWHeight)
+    tw->changes.height = changes->height;
+  if (value_mask & CWBorderWidth)
+    tw->changes.border_width = changes->border_width;
+  tw->mask |= value_mask & TXN_GEOMETRY;
+  return value_mask & ~TXN_GEOMETRY;
+} /* unsigned int wm_txn_configure */
+
+/* Make 'attr', as the server has it, look the way it will once the
+ * transaction commits, so code inside one sees its own changes. */
+void wm_txn_overlay(wm_t *wm, Window w, XWindowAttributes *attr) {
+  struct wm_txn *txn = wm->txn;
+  guint position;
+  txn_window_t *tw;
+
+  if (!wm_txn_recording(wm))
+    return;
+  position = GPOINTER_TO_UINT(g_hash_table_lookup(txn->index,
+                                                  GUINT_TO_POINTER(w)));
+  if (position == 0)
+    return;
+  tw = &g_array_index(txn->windows, txn_window_t, position - 1);
+  if (tw->mask & CWX)
+    attr->x = tw->changes.x;
+  if (tw->mask & CWY)
+    attr->y = tw->changes.y;
+  if (tw->mask & CWWidth)
+    attr->width = tw->changes.width;
+  if (tw->mask & CWHeight)
+    attr->height = tw->changes.height;
+  if (tw->mask & CWBorderWidth)
+    attr->border_width = tw->changes.border_width;
+  if (wm_txn_ends_unmapped(tw))
+    attr->map_state = IsUnmapped;
+  else if (tw->maps > 0 && attr->map_state == IsUnmapped)
+    attr->map_state = IsViewable; /* unless its parent isn't */
+} /* void wm_txn_overlay */
+
+/* Record a SetInputFocus. Returns False if the caller should send it. */
+Bool wm_txn_focus(wm_t *wm, Window w, int revert_to) {
+  if (!wm_txn_recording(wm))
+    return False;
+  wm->txn->recorded++;
+  wm->txn->focus = w;
+  wm->txn->revert_to = revert_to;
+  wm->txn->focus_pending = True;
+  return True;
+} /* Bool wm_txn_focus */
+
+static void wm_txn_send_maps(wm_t *wm, txn_window_t *tw) {
+  Bool map = tw->first_map;
+  unsigned int i;
+
+  for (i = 0; i < tw->maps; i++, map = !map) {
+    if (map)
+      wm_x_map_window(wm, tw->window);
+    else
+      wm_x_unmap_window(wm, tw->window);
+    wm->txn->sent++;
+  }
+  tw->maps = 0;
+} /* static void wm_txn_send_maps */
+
+static void wm_txn_send_geometry(wm_t *wm, txn_window_t *tw) {
+  if (tw->mask == 0)
+    return;
+  wm_x_configure_window(wm, tw->window, tw->mask, &tw->changes);
+  wm->txn->sent++;
+  tw->mask = 0;
+} /* static void wm_txn_send_geometry */
+
+/* 'w' is about to be reparented; wm_x_reparent_window calls this first.
+ * Reparenting a mapped window isn't the same as an unmapped one, so its
+ * maps and unmaps go now. The reparent puts it at a new position, so any
+ * recorded one is dropped; size and border can still wait. */
+void wm_txn_barrier(wm_t *wm, Window w) {
+  struct wm_txn *txn = wm->txn;
+  guint position;
+  txn_window_t *tw;
+
+  if (!wm_txn_recording(wm))
+    return;
+  position = GPOINTER_TO_UINT(g_hash_table_lookup(txn->index,
+                                                  GUINT_TO_POINTER(w)));
+  if (position == 0)
+    return;
+  tw = &g_array_index(txn->windows, txn_window_t, position - 1);
+  tw->mask &= ~(CWX | CWY);
+  txn->applying = True;
+  wm_txn_send_maps(wm, tw);
+  txn->applying = False;
+} /* void wm_txn_barrier */
+
+/* Finish a transaction. The outermost one sends everything recorded. */
+void wm_txn_commit(wm_t *wm) {
+  struct wm_txn *txn = wm->txn;
+  guint i;
+
+  if (txn->depth == 0) {
+    wm_log(wm, LOG_WARN, "%s: no transaction to commit", __func__);
+    return;
+  }
+  if (--txn->depth > 0)
+    return;
+
+  txn->applying = True;
+  for (i = 0; i < txn->windows->len; i++) {
+    txn_window_t *tw = &g_array_index(txn->windows, txn_window_t, i);
+    if (wm_txn_ends_unmapped(tw))
+      wm_txn_send_maps(wm, tw);
+  }
+  for (i = 0; i < txn->windows->len; i++)
+    wm_txn_send_geometry(wm, &g_array_index(txn->windows, txn_window_t, i));
+  wm_stack_flush(wm);
+  for (i = 0; i < txn->windows->len; i++)
+    wm_txn_send_maps(wm, &g_array_index(txn->windows, txn_window_t, i));
+  if (txn->focus_pending) {
+    wm_x_set_input_focus(wm, txn->focus, txn->revert_to);
+    txn->sent++;
+  }
+
+  if (txn->grabbed)
+    wm_x_ungrab_server(wm);
+  txn->grabbed = False;
+  wm_x_flush(wm);
+  txn->applying = False;
+
+  g_array_set_size(txn->windows, 0);
+  g_hash_table_remove_all(txn->index);
+  txn->focus_pending = False;
+  txn->flags = 0;
+  txn->commits++;
+} /* void wm_txn_commit */
+
+Bool wm_txn_active(wm_t *wm) {
+  return wm->txn->depth > 0;
+} /* Bool wm_txn_active */
+
+/* 'recorded' requests were asked for inside transactions, 'sent' went out
+ * when they committed. */
+void wm_txn_stats(wm_t *wm, unsigned long *commits, unsigned long *recorded,
+                  unsigned long *sent) {
+  *commits = wm->txn->commits;
+  *recorded = wm->txn->recorded;
+  *sent = wm->txn->sent;
+} /* void wm_txn_stats */
@@ -30,17 +30,16 @@
 
 #include "windowmanager.h"
 
+#include <poll.h>
 #include <stdio.h>
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
 #include <glib.h>
+#include <X11/Xatom.h>
+#include <X11/extensions/sync.h>
 
 #define DISPLAY_TO_WM_XID (0)
-static int wm_x_event_error(Display *dpy, XErrorEvent *ev);
-
-static int global_init = 0;
-static wm_t *global_wm;
 
 static int tracecount = 0;
 static int xtracer() {
@@ -67,26 +66,50 @@ wm_t *wm_new(void) {
 wm_t *wm_new2(char *display_name) {
   wm_t *wm = NULL;
 
-  int i;
   wm = xmalloc(sizeof(wm_t));
+  wm->log_level = LOG_INFO;
+
+  /* The fetch worker uses Xlib from a second thread */
+  XInitThreads();
   wm_x_open(wm, display_name);
+  wm_error_init(wm);
   wm_x_init_screens(wm);
   //_Xdebug = 1;
   //XSynchronize(wm->dpy, True);
   wm->xdo = xdo_new_with_opened_display(wm_x_get_display(wm), NULL, True);
 
-  if (global_init == 0) {
-    global_init = 1;
-    global_wm = wm;
-  }
+  wm_init(wm);
+  return wm;
+} /* wm_t *wm_create(char *display_name) */
+
+/* State that doesn't depend on having a display */
+void wm_init(wm_t *wm) {
+  int i;
+
+  /* First, so everything created below is accounted for */
+  wm_res_init(wm);
+
+  wm->clients = g_hash_table_new(g_direct_hash, g_direct_equal);
+  wm_index_init(wm);
+  wm->focus = None;
 
   /* Initialize the listeners lists */
-  wm->listeners = malloc(WM_EVENT_MAX * sizeof(GPtrArray *));
-  for (i = WM_EVENT_MIN; i < WM_EVENT_MAX; i++)
+  wm->listeners = malloc((WM_EVENT_MAX + 1) * sizeof(GPtrArray *));
+  for (i = WM_EVENT_MIN; i <= WM_EVENT_MAX; i++)
     wm->listeners[i] = g_ptr_array_new();
 
-  return wm;
-} /* wm_t *wm_create(char *display_name) */
+  wm_sync_init(wm);
+  wm_stack_init(wm);
+  wm_occlusion_init(wm);
+  wm_idle_init(wm);
+  wm_timer_init(wm);
+  wm_pointer_init(wm);
+  wm_roundtrip_init(wm);
+  wm_icon_init(wm);
+  wm_ewmh_init(wm);
+  wm_place_init(wm);
+  wm_txn_init(wm);
+} /* void wm_init */
 
 void wm_x_init_screens(wm_t *wm) {
   int num_screens;
@@ -134,16 +157,10 @@ void wm_x_init_handlers(wm_t *wm) {
   wm->x_event_handlers[UnmapNotify] = wm_event_unmapnotify;
   wm->x_event_handlers[DestroyNotify] = wm_event_destroynotify;
   wm->x_event_handlers[Expose] = wm_event_expose;
-
-  global_wm = wm;
-  //XSetErrorHandler(wm_x_event_error);
+  wm->x_event_handlers[ReparentNotify] = wm_event_reparentnotify;
+  wm->x_event_handlers[FocusIn] = wm_event_focusin;
 } /* void wm_x_init_handlers */
 
-int wm_x_event_error(Display *dpy, XErrorEvent *ev) {
-  wm_log(global_wm, LOG_ERROR, "x11 error for request %lu. resource %lu\n",
-         ev->serial, ev->resourceid);
-} /* int wm_x_event_error */
-
 void wm_x_init_windows(wm_t *wm) {
   Window root, parent, *wins;
   unsigned int nwins;
@@ -151,16 +168,21 @@ void wm_x_init_windows(wm_t *wm) {
   int nscreens;
   int i;
 
-  XGrabServer(wm->dpy);
-  nscreens = ScreenCount(wm->dpy);
+  wm_x_grab_server(wm);
+  nscreens = wm->num_screens;
   for (screen = 0; screen < nscreens; screen++) {
     wm_log(wm, LOG_INFO, "Querying window tree for screen %d", screen);
-    XQueryTree(wm->dpy, wm->screens[screen]->root, &root, &parent, &wins, &nwins);
+    if (!wm_x_query_tree(wm, wm->screens[screen]->root, &root, &parent, &wins, &nwins))
+      continue;
     for (i = 0; i < nwins; i++) {
+      /* XQueryTree lists children bottom to top */
+      wm_stack_add(wm, wins[i], root);
       wm_fake_maprequest(wm, wins[i]);
     }
+    if (wins != NULL)
+      XFree(wins);
   }
-  XUngrabServer(wm->dpy);
+  wm_x_ungrab_server(wm);
 } /* void wm_x_init_windows */
 
 void wm_set_log_level(wm_t *wm, int log_level) {
@@ -177,15 +199,18 @@ void wm_log(wm_t *wm, int log_level, char *format, ...) {
   va_list args;
   char *msg;
   //static const char *logprefix = "FEWI";
-  //if (log_level > wm->log_level)
-    //return;
+  if (log_level > wm->log_level)
+    return;
 
   /** XXX: add datestamping */
   va_start(args, format);
   vasprintf(&msg, format, args);
   va_end(args);
 
-  fprintf(stderr, "%s\n", msg);
+  if (wm->log_prefix != NULL)
+    fprintf(stderr, "[%s] %s\n", wm->log_prefix, msg);
+  else
+    fprintf(stderr, "%s\n", msg);
   free(msg);
 
   if (log_level == LOG_FATAL) {
@@ -198,8 +223,6 @@ void wm_x_open(wm_t *wm, char *display_name) {
   wm->dpy = XOpenDisplay(display_name);
   if (wm->dpy == NULL)
     wm_log(wm, LOG_FATAL, "Failed opening display: '%s'", display_name);
-
-  wm->context = XUniqueContext();
 } /* void wm_x_open */
 
 void wm_main(wm_t *wm) {
@@ -208,12 +231,87 @@ void wm_main(wm_t *wm) {
   wm_x_init_handlers(wm);
   wm_x_init_windows(wm);
 
+  if (wm->mock != NULL) {
+    /* Nothing to wait for; run what the mock has queued and return. */
+    wm_mock_run(wm);
+    return;
+  }
+
+  if (wm_eventlog_replaying(wm)) {
+    /* No display; run the recorded events through as fast as we can. */
+    while (wm_eventlog_next_event(wm, &ev)) {
+      wm_dispatch(wm, &ev);
+      wm_timer_run(wm);
+      wm_occlusion_update(wm);
+      wm_stack_flush(wm);
+      wm_ewmh_flush(wm);
+      wm_idle_run(wm);
+      wm_shm_publish(wm);
+    }
+    return;
+  }
+
   for (;;) {
-    XNextEvent(wm->dpy, &ev);
-    wm->x_event_handlers[ev.type](wm, &ev);
+    while (XPending(wm->dpy)) {
+      XNextEvent(wm->dpy, &ev);
+      wm_eventlog_event(wm, &ev);
+      wm_dispatch(wm, &ev);
+    }
+
+    /* Failures of requests made above, e.g. on windows that went away */
+    wm_error_process(wm);
+    wm_worker_collect(wm);
+    wm_timer_run(wm);
+    wm_occlusion_update(wm);
+    wm_stack_flush(wm);
+    wm_ewmh_flush(wm);
+    wm_res_poll(wm);
+
+    /* Publish the client table once per batch of events rather than once
+     * per event. */
+    wm_shm_publish(wm);
+    wm_eventlog_flush(wm);
+
+    /* Anything above may have made a round trip that queued more events.
+     * Deferred work only runs once there are none. */
+    if (XEventsQueued(wm->dpy, QueuedAfterFlush) == 0) {
+      wm_idle_run(wm);
+      if (XEventsQueued(wm->dpy, QueuedAfterFlush) == 0)
+        wm_wait(wm);
+    }
   }
 }
 
+/* Sleep until there is input on the X connection or from the worker, or
+ * until the next timer is due. With deferred work left over, only check for
+ * input and come back to it. */
+void wm_wait(wm_t *wm) {
+  struct pollfd fds[2];
+  int nfds = 1;
+
+  fds[0].fd = ConnectionNumber(wm->dpy);
+  fds[0].events = POLLIN;
+  if (wm_worker_fd(wm) >= 0) {
+    fds[1].fd = wm_worker_fd(wm);
+    fds[1].events = POLLIN;
+    nfds++;
+  }
+  poll(fds, nfds, wm_idle_pending(wm) ? 0 : wm_timer_timeout(wm));
+} /* void wm_wait */
+
+void wm_dispatch(wm_t *wm, XEvent *ev) {
+  /* Extension events are past LASTEvent and have no handler slot. */
+  if (ev->type < LASTEvent) {
+    int previous = wm_roundtrip_event_begin(wm, ev->type);
+    wm_pointer_event(wm, ev);
+    wm->x_event_handlers[ev->type](wm, ev);
+    wm_roundtrip_event_end(wm, previous);
+  }
+  else if (wm->sync_event_base >= 0
+           && ev->type == wm->sync_event_base + XSyncAlarmNotify)
+    wm_sync_alarm_notify(wm, ev);
+} /* void wm_dispatch */
+
 void wm_event_keypress(wm_t *wm, XEvent *ev) {
   XKeyEvent kev = ev->xkey;
   client_t *client;
@@ -230,47 +328,50 @@ void wm_event_keyrelease(wm_t *wm, XEvent *ev) {
   wm_listener_call(wm, WM_EVENT_KEY_UP, client, ev);
 }
 
+/* Last known pointer position relative to 'window'; see pointer.c */
 void wm_get_mouse_position(wm_t *wm, int *x, int *y, Window window) {
-  Window unused_root, unused_child;
-  unsigned int unused_mask;
-  int unused_root_x, unused_root_y;
+  Window unused_root;
 
-  XQueryPointer(wm->dpy, window, &unused_root, &unused_child,
-                &unused_root_x, &unused_root_y, x, y, &unused_mask);
+  wm_pointer_get(wm, window, &unused_root, x, y);
 } /* void wm_get_mouse_position */
 
 void wm_event_buttonpress(wm_t *wm, XEvent *ev) {
   XButtonEvent bev = ev->xbutton;
   XWindowAttributes attr;
+  client_t *client;
   int offset_x, offset_y;
-  int old_win_x, old_win_y;
   wm_log(wm, LOG_INFO, "%s", __func__);
-  XGetWindowAttributes(wm->dpy, bev.window, &attr);
+
+  /* The event says where the pointer is, and the client table where the
+   * window is; only a window we don't know costs a round trip. */
+  client = wm_get_client(wm, bev.window, False);
+  if (client != NULL)
+    memcpy(&attr, &client->attr, sizeof(XWindowAttributes));
+  else if (!wm_x_get_window_attributes(wm, bev.window, &attr))
+    return;
 
   // GrabPointer for mousemask
-  XGrabPointer(wm->dpy, attr.root, False, MouseEventMask,
-               GrabModeAsync, GrabModeAsync, None, None, CurrentTime);
+  wm_x_grab_pointer(wm, bev.root, MouseEventMask);
 
-  old_win_x = attr.x;
-  old_win_x = attr.y;
-  wm_get_mouse_position(wm, &offset_x, &offset_y, attr.root);
+  wm_get_mouse_position(wm, &offset_x, &offset_y, bev.root);
 
   offset_x = offset_x - attr.x;
   offset_y = offset_y - attr.y;
 
-  if (attr.screen->root != bev.window) {
+  if (bev.root != bev.window) {
     /* Window button event */
     for (;;) {
       XEvent ev;
-      XMaskEvent(wm->dpy, MouseEventMask | ExposureMask, &ev);
+      wm_x_mask_event(wm, MouseEventMask | ExposureMask, &ev);
+      wm_pointer_event(wm, &ev);
       switch (ev.type) {
         case MotionNotify:
-          XMoveWindow(wm->dpy, bev.window,
-                      ev.xmotion.x - offset_x,
-                      ev.xmotion.y - offset_y);
+          wm_x_move_window(wm, bev.window,
+                           ev.xmotion.x - offset_x,
+                           ev.xmotion.y - offset_y);
           break;
         case ButtonRelease:
-          XUngrabPointer(wm->dpy, CurrentTime);
+          wm_x_ungrab_pointer(wm);
           return;
           break;
         case Expose:
@@ -291,36 +392,69 @@ void wm_event_buttonrelease(wm_t *wm, XEvent *ev) {
 void wm_event_configurerequest(wm_t *wm, XEvent *ev) {
   XConfigureRequestEvent crev = ev->xconfigurerequest;
   XWindowChanges wc;
+  client_t *client;
   wm_log(wm, LOG_INFO, "%s: %d wants to be %dx%d@%d,%d", __func__,
          crev.window, crev.width, crev.height, crev.x, crev.y);
 
+  /* Tiled clients don't get to pick their geometry. Rather than let them
+   * resize and then fight back, tell them where they are (ICCCM 4.1.5) and
+   * leave the window alone. */
+  client = wm_get_client(wm, crev.window, False);
+  if (client != NULL && (client->flags & CLIENT_TILED)) {
+    wm_client_send_configure(wm, client);
+    return;
+  }
+
   wc.sibling = crev.above;
   wc.stack_mode = crev.detail;
   wc.x = crev.x;
   wc.y = crev.y;
   wc.width = crev.width;
   wc.height = crev.height;
-  XConfigureWindow(wm->dpy, crev.window, crev.value_mask, &wc);
+  wm_x_configure_window(wm, crev.window, crev.value_mask, &wc);
 } /* wm_event_configurenotify */
 
 void wm_event_configurenotify(wm_t *wm, XEvent *ev) {
-  XConfigureEvent cev;
+  XConfigureEvent cev = ev->xconfigure;
   XWindowChanges changes;
   unsigned long valuemask = 0;
+  client_t *client;
+  Window parent = None;
   //wm_log(wm, LOG_INFO, "%s: %d reconfigured.", __func__, cev.window);
 
   if (cev.border_width > 0) {
     changes.border_width = 0;
     valuemask |= CWBorderWidth;
   }
+
+  client = wm_get_client(wm, cev.window, False);
+
+  /* 'above' is the sibling we're now directly on top of, None for bottom */
+  if (cev.event != cev.window)
+    parent = cev.event;
+  else if (client != NULL && client->container != None)
+    parent = client->container;
+  else if (client != NULL)
+    parent = RootWindowOfScreen(client->screen);
+  if (parent != None)
+    wm_stack_place(wm, cev.window, parent, cev.above);
+
+  if (client != NULL) {
+    client->attr.x = cev.x;
+    client->attr.y = cev.y;
+    client->attr.width = cev.width;
+    client->attr.height = cev.height;
+    client->attr.border_width = cev.border_width;
+    wm_occlusion_mark_client(wm, client);
+    wm_shm_mark_dirty(wm);
+  }
 }
 
 void wm_event_createnotify(wm_t *wm, XEvent *ev) {
   XCreateWindowEvent xcwe = ev->xcreatewindow;
   wm_log(wm, LOG_INFO, "===> CREATE NOTIFY");
-  XGrabServer(wm->dpy);
+  wm_stack_add(wm, xcwe.window, xcwe.parent);
   wm_get_client(wm, xcwe.window, True);
-  XUngrabServer(wm->dpy);
 }
 
 void wm_event_maprequest(wm_t *wm, XEvent *ev) {
@@ -329,25 +463,26 @@ void wm_event_maprequest(wm_t *wm, XEvent *ev) {
   client_t *client;
   wm_log(wm, LOG_INFO, "%s: window %d", __func__, mrev.window);
 
-  /* I grab here because everyone else seems to do this */
-  XGrabServer(wm->dpy);
-
+  /* No server grab: if the window dies while we handle this, the errors
+   * come back through errors.c and the client is dropped there. */
   client = wm_get_client(wm, mrev.window, True);
   if (client == NULL)
     return;
 
   client->flags |= CLIENT_VISIBLE;
+  wm_index_update(wm, client);
 
   if (client->attr.override_redirect) {
     wm_log(wm, LOG_INFO, "%s: skipping window %d, override_redirect is set",
            __func__, mrev.window);
-    XMapWindow(wm->dpy, client->window);
-    XUngrabServer(wm->dpy);
+    wm_x_map_window(wm, client->window);
     return;
   }
 
+  wm_ewmh_manage(wm, client);
+  if (wm_place_hold(wm, client))
+    return;
   wm_listener_call(wm, WM_EVENT_WINDOW_MAP_REQUEST, client, ev);
-  XUngrabServer(wm->dpy);
 }
 
 void wm_event_mapnotify(wm_t *wm, XEvent *ev) {
@@ -363,15 +498,30 @@ void wm_event_mapnotify(wm_t *wm, XEvent *ev) {
     return;
   }
 
+  /* Occlusion mapping the window back, or the server mapping it again
+   * after wm_client_reparent; it never stopped being visible */
+  if (client->ignore_maps > 0 && mev.event == mev.window) {
+    client->ignore_maps--;
+    return;
+  }
+
+  /* Nobody asks us before mapping an override-redirect window */
+  if (client->attr.override_redirect)
+    client->flags |= CLIENT_MAPPED;
   client->flags |= CLIENT_VISIBLE;
+  wm_index_update(wm, client);
+  wm_occlusion_mapped(wm, client);
+  wm_shm_mark_dirty(wm);
   wm_listener_call(wm, WM_EVENT_WINDOW_MAP, client, ev);
 }
 
 void wm_event_clientmessage(wm_t *wm, XEvent *ev) {
   XClientMessageEvent cmev = ev->xclient;
+  char *atom_name = wm_x_get_atom_name(wm, cmev.message_type);
   wm_log(wm, LOG_INFO, "%s: Window %ld, atom %ld(%s), format %ld",
-         __func__, cmev.window, cmev.message_type,
-         XGetAtomName(wm->dpy, cmev.message_type), cmev.format);
+         __func__, cmev.window, cmev.message_type, atom_name, cmev.format);
+  if (atom_name != NULL)
+    XFree(atom_name);
 }
 
 void wm_event_enternotify(wm_t *wm, XEvent *ev) {
@@ -398,10 +548,33 @@ void wm_event_propertynotify(wm_t *wm, XEvent *ev) {
 
   /* XInternAtom has an internal cache local to the client, so we don't
    * need to worry about caching these ourselves. */
-  if ((pev.atom == XInternAtom(wm->dpy, "WM_NAME", False))
-      || (pev.atom == XInternAtom(wm->dpy, "_NET_WM_NAME", False))
-      || (pev.atom == XInternAtom(wm->dpy, "_NET_WM_VISIBLE_NAME", False))) {
+  if ((pev.atom == wm_x_intern_atom(wm, "WM_NAME", False))
+      || (pev.atom == wm_x_intern_atom(wm, "_NET_WM_NAME", False))
+      || (pev.atom == wm_x_intern_atom(wm, "_NET_WM_VISIBLE_NAME", False))) {
     wm_log(wm, LOG_INFO, "%s: WINDOW NAME CHANGED", __func__);
+    if (client != NULL)
+      wm_client_fetch(wm, client, WM_FETCH_NAME);
+  } else if (client != NULL && pev.atom == XA_WM_CLASS) {
+    wm_client_fetch(wm, client, WM_FETCH_CLASS);
+  } else if (client != NULL
+             && pev.atom == wm_x_intern_atom(wm, "WM_WINDOW_ROLE", False)) {
+    wm_client_fetch(wm, client, WM_FETCH_ROLE);
+  } else if (client != NULL
+             && pev.atom == wm_x_intern_atom(wm, "_NET_WM_STATE", False)) {
+    wm_client_fetch(wm, client, WM_FETCH_STATE);
+  } else if (client != NULL && pev.atom == XA_WM_HINTS) {
+    wm_client_fetch(wm, client, WM_FETCH_HINTS);
+  } else if (client != NULL && pev.atom == XA_WM_TRANSIENT_FOR) {
+    wm_client_fetch(wm, client, WM_FETCH_TRANSIENT);
+  } else if (client != NULL
+             && (pev.atom == wm_x_intern_atom(wm, "WM_PROTOCOLS", False)
+                 || pev.atom == wm_x_intern_atom(wm, "_NET_WM_SYNC_REQUEST_COUNTER",
+                                                 False))) {
+    wm_client_fetch(wm, client, WM_FETCH_SYNC);
+  } else if (client != NULL && client->icon_wanted
+             && pev.atom == wm_x_intern_atom(wm, "_NET_WM_ICON", False)) {
+    /* Icons are only fetched for clients someone asked about */
+    wm_client_fetch(wm, client, WM_FETCH_ICON);
   }
 
   switch (pev.state) {
@@ -423,8 +596,19 @@ void wm_event_unmapnotify(wm_t *wm, XEvent *ev) {
     return;
   wm_log(wm, LOG_INFO, "%s: Unmap %d", __func__, uev.window);
   client = wm_get_client(wm, uev.window, False);
+  if (client == NULL)
+    return;
+
+  /* Unmapped by us (occlusion.c, wm_client_reparent, wm_client_unmap), not
+   * withdrawn. A synthetic unmap is always the client withdrawing (ICCCM
+   * 4.1.4). */
+  if (client->ignore_unmaps > 0 && !uev.send_event) {
+    client->ignore_unmaps--;
+    return;
+  }
 
   client->flags &= ~(CLIENT_VISIBLE);
+  wm_index_update(wm, client);
   wm_listener_call(wm, WM_EVENT_WINDOW_UNMAP, client, ev);
   wm_remove_client(wm, client);
 }
@@ -436,6 +620,42 @@ void wm_event_destroynotify(wm_t *wm, XEvent *ev) {
          __func__, dev.window, parent);
 
   //XDestroyWindow(wm->dpy, parent);
+  wm_stack_remove(wm, dev.window);
+  client_t *client = wm_get_client(wm, dev.window, False);
+  if (client != NULL)
+    wm_remove_client(wm, client);
+}
+
+void wm_event_reparentnotify(wm_t *wm, XEvent *ev) {
+  XReparentEvent rev = ev->xreparent;
+  client_t *client;
+
+  wm_stack_reparented(wm, rev.window, rev.parent);
+  client = wm_get_client(wm, rev.window, False);
+  if (client == NULL)
+    return;
+
+  if (rev.parent == RootWindowOfScreen(client->screen))
+    client->container = None;
+  else
+    client->container = rev.parent;
+  wm_index_update(wm, client);
+  client->attr.x = rev.x;
+  client->attr.y = rev.y;
+  wm_shm_mark_dirty(wm);
+}
+
+void wm_event_focusin(wm_t *wm, XEvent *ev) {
+  XFocusChangeEvent fev = ev->xfocus;
+
+  /* Pointer focus and grab-related focus changes are not real focus moves */
+  if (fev.detail == NotifyPointer || fev.mode != NotifyNormal)
+    return;
+
+  if (wm_get_client(wm, fev.window, False) == NULL)
+    return;
+  wm->focus = fev.window;
+  wm_shm_mark_dirty(wm);
 }
 
 void wm_event_expose(wm_t *wm, XEvent *ev) {
@@ -456,7 +676,7 @@ void wm_listener_add(wm_t *wm, wm_event_id event, wm_event_handler_func callback
   wm_log(wm, LOG_INFO, "Adding listener for event %d: %016tx", 
          event, callback);
 
-  if (event >= WM_EVENT_MAX) {
+  if (event > WM_EVENT_MAX) {
     wm_log(wm, LOG_FATAL, 
            "Attempt to register for event '%d' when max event is '%d'",
            event, WM_EVENT_MAX);
@@ -486,7 +706,7 @@ void wm_listener_call(wm_t *wm, unsigned int event_id, client_t *client, XEvent
   event.client = client;
   event.wm = wm;
 
-  if (event_id >= WM_EVENT_MAX) {
+  if (event_id > WM_EVENT_MAX) {
     wm_log(wm, LOG_FATAL, 
            "Attempt to call listener for event '%d' when max event is '%d'",
            event, WM_EVENT_MAX);
@@ -503,7 +723,7 @@ void wm_listener_call(wm_t *wm, unsigned int event_id, client_t *client, XEvent
       case ButtonRelease:
       case KeyPress:
       case KeyRelease:
-        XUngrabServer(wm->dpy);
+        wm_x_ungrab_server(wm);
         break;
     }
     return;
@@ -515,8 +735,11 @@ void wm_listener_call(wm_t *wm, unsigned int event_id, client_t *client, XEvent
 void wm_listener_call_each(gpointer data, gpointer g_wmevent) {
   wm_event_t *event = g_wmevent;
   wm_event_handler_t *handler = data;
+  unsigned int previous;
   wm_log(event->wm, LOG_INFO, "Calling func %016tx", handler->callback);
+  previous = wm_roundtrip_listener(event->wm, event->event_id);
   handler->callback(event->wm, event, handler->data);
+  wm_roundtrip_listener(event->wm, previous);
 }
 
 /* Fake map requests are mainly to capture windows we don't know about that exist
@@ -525,9 +748,12 @@ void wm_fake_maprequest(wm_t *wm, Window w) {
   XEvent e;
   XWindowAttributes attr;
 
-  XGetWindowAttributes(wm->dpy, w, &attr);
+  if (!wm_x_get_window_attributes(wm, w, &attr))
+    return;
   if (attr.map_state == IsViewable /* && attr.class != InputOnly */) {
-    e.xmap.window = w;
+    memset(&e, 0, sizeof(e));
+    e.xcreatewindow.parent = attr.root;
+    e.xcreatewindow.window = w;
     wm_log(wm, LOG_INFO, "fake map for: %d", w);
     wm_event_createnotify(wm, &e);
   }
@@ -544,11 +770,12 @@ Bool wm_grab_button(wm_t *wm, Window window, unsigned int mask, unsigned int but
 
 void wm_map_window(wm_t *wm, Window win) {
   Window frame;
+  client_t *client;
   //Window root;
   XWindowAttributes new_win_attr;
   XSetWindowAttributes frame_attr;
 
-  if (!XGetWindowAttributes(wm->dpy, win, &new_win_attr)) {
+  if (!wm_x_get_window_attributes(wm, win, &new_win_attr)) {
     wm_log(wm, LOG_ERROR, "%s: XGetWindowAttributes failed", __func__);
     return;
   }
@@ -559,7 +786,7 @@ void wm_map_window(wm_t *wm, Window win) {
   unsigned long valuemask;
   XColor border_color;
   //int status;
-  char *colorstring = "#999933";
+  const char *colorstring = wm_get_theme(wm)->frame_border;
 
   x = new_win_attr.x - BORDER;
   y = new_win_attr.y - TITLE_HEIGHT - BORDER;
@@ -569,11 +796,17 @@ void wm_map_window(wm_t *wm, Window win) {
   frame_attr.event_mask = (SubstructureNotifyMask | SubstructureRedirectMask \
                            | ButtonPressMask | ButtonReleaseMask \
                            | EnterWindowMask | LeaveWindowMask);
-  XParseColor(wm->dpy, wm->screens[0]->cmap, colorstring, &border_color);
-  XAllocColor(wm->dpy, wm->screens[0]->cmap, &border_color);
-  wm_log(wm, LOG_INFO, "%s: color: %d.%d.%d = %d", __func__, border_color.red, border_color.green, border_color.blue, border_color.pixel);
+  /* Every frame shares one color cell rather than allocating its own */
+  if (!wm->frame_border_allocated) {
+    XParseColor(wm->dpy, wm->screens[0]->cmap, colorstring, &border_color);
+    XAllocColor(wm->dpy, wm->screens[0]->cmap, &border_color);
+    wm_log(wm, LOG_INFO, "%s: color: %d.%d.%d = %d", __func__, border_color.red, border_color.green, border_color.blue, border_color.pixel);
+    wm_res_created(wm, WM_RES_COLOR, GUINT_TO_POINTER(border_color.pixel));
+    wm->frame_border_pixel = border_color.pixel;
+    wm->frame_border_allocated = True;
+  }
 
-  frame_attr.border_pixel = border_color.pixel;
+  frame_attr.border_pixel = wm->frame_border_pixel;
   //frame_attr.background_pixel = border_color.pixel;
 
   valuemask = CWEventMask | CWBorderPixel;
@@ -586,29 +819,35 @@ void wm_map_window(wm_t *wm, Window win) {
                         new_win_attr.visual,
                         valuemask,
                         &frame_attr);
+  wm_res_created(wm, WM_RES_WINDOW, GUINT_TO_POINTER(frame));
 
   /* AddToSaveSet tells X to remember the last parenting
    * so if we die, the client window we're reparenting doesn't die too. */
   XAddToSaveSet(wm->dpy, win);
-  XReparentWindow(wm->dpy, win, frame, BORDER, TITLE_HEIGHT);
-
-  XMapWindow(wm->dpy, win);
-  XMapWindow(wm->dpy, frame);
-  XRaiseWindow(wm->dpy, frame);
+  client = wm_get_client(wm, win, False);
+  if (client != NULL)
+    wm_client_reparent(wm, client, frame, BORDER, TITLE_HEIGHT);
+  else
+    wm_x_reparent_window(wm, win, frame, BORDER, TITLE_HEIGHT);
+
+  wm_x_map_window(wm, win);
+  wm_x_map_window(wm, frame);
+  wm_x_raise_window(wm, frame);
 }
 
 client_t *wm_get_client(wm_t *wm, Window window, Bool create_if_necessary) {
   client_t *c = NULL;
-  int ret;
   wm_log(wm, LOG_INFO, "%s: window %ld", __func__, window);
-  ret = XFindContext(wm->dpy, window, wm->context, (XPointer*)&c);
+  c = g_hash_table_lookup(wm->clients, GUINT_TO_POINTER(window));
 
-  if (ret == XCNOENT && create_if_necessary) { /* window not found */
+  if (c == NULL && create_if_necessary) { /* window not found */
     XWindowAttributes attr;
-    XGrabServer(wm->dpy);
-    Status ret;
     wm_log(wm, LOG_INFO, "New client window: %d", window);
-    //ret = XGetWindowAttributes(wm->dpy, window, &attr);
+    if (!wm_x_get_window_attributes(wm, window, &attr)) {
+      wm_log(wm, LOG_INFO, "%s: XGetWindowAttributes(%ld) failed", __func__,
+             window);
+      return NULL;
+    }
     //if (attr.class == InputOnly) {
       //wm_log(wm, LOG_INFO, 
              //"%s: Window class is InputOnly, should we ignore this?", __func__);
@@ -622,23 +861,141 @@ client_t *wm_get_client(wm_t *wm, Window window, Bool create_if_necessary) {
     memset(c, 0, sizeof(client_t));
     c->window = window;
     c->screen = attr.screen;
-    c->flags = 0;
+    c->flags = (attr.map_state != IsUnmapped) ? CLIENT_MAPPED : 0;
+    c->container = None;
     memcpy(&(c->attr), &attr, sizeof(XWindowAttributes));
-    ret = XSaveContext(wm->dpy, window, wm->context, (XPointer)c);
-    //wm_log(wm, LOG_INFO, "%s: XSaveContext(%ld) returned %d.", __func__, window, ret);
-    if (ret != 0) {
-      wm_log(wm, LOG_ERROR, "%s: XSaveContext failed.", __func__);
-    }
-    XSelectInput(wm->dpy, window, ClientWindowMask);
-    XSync(wm->dpy, False);
-    XUngrabServer(wm->dpy);
+    g_hash_table_insert(wm->clients, GUINT_TO_POINTER(window), c);
+    wm_index_update(wm, c);
+    wm_res_created(wm, WM_RES_CLIENT, c);
+    /* If the window is already gone this fails with BadWindow, and
+     * wm_error_process drops the client again. */
+    wm_x_select_input(wm, window, ClientWindowMask);
+    wm_shm_mark_dirty(wm);
+    wm_client_fetch(wm, c, WM_FETCH_NAME | WM_FETCH_CLASS | WM_FETCH_ROLE
+                           | WM_FETCH_STATE | WM_FETCH_HINTS | WM_FETCH_SYNC
+                           | WM_FETCH_TRANSIENT);
   }
 
   return c;
 }
 
+void wm_client_set_tiled(wm_t *wm, client_t *client, Bool tiled) {
+  if (tiled)
+    client->flags |= CLIENT_TILED;
+  else
+    client->flags &= ~(CLIENT_TILED);
+} /* void wm_client_set_tiled */
+
+/* Place a client within its container. For tiled clients this is also the
+ * geometry we answer their ConfigureRequests with. Clients that do
+ * _NET_WM_SYNC_REQUEST get resized at the rate they can redraw; see sync.c. */
+void wm_client_moveresize(wm_t *wm, client_t *client, int x, int y,
+                          unsigned int width, unsigned int height) {
+  client->allotted.x = x;
+  client->allotted.y = y;
+  client->allotted.width = width;
+  client->allotted.height = height;
+  if (!wm_sync_resize(wm, client))
+    wm_x_move_resize_window(wm, client->window, x, y, width, height);
+} /* void wm_client_moveresize */
+
+/* Whether the client's window is mapped on the server once the requests
+ * we've made so far are done. That isn't CLIENT_VISIBLE: a client is
+ * visible from its MapRequest on, before anyone maps it, and stays visible
+ * while occlusion.c has it unmapped. */
+Bool wm_client_mapped(wm_t *wm, client_t *client) {
+  return (client->flags & CLIENT_MAPPED) ? True : False;
+} /* Bool wm_client_mapped */
+
+/* wm_x_map_window and wm_x_unmap_window call this for every window they're
+ * asked to map or unmap, inside a transaction or not. */
+void wm_client_map_requested(wm_t *wm, Window window, Bool mapped) {
+  client_t *client = g_hash_table_lookup(wm->clients,
+                                         GUINT_TO_POINTER(window));
+
+  if (client == NULL)
+    return;
+  if (mapped)
+    client->flags |= CLIENT_MAPPED;
+  else
+    client->flags &= ~(CLIENT_MAPPED);
+} /* void wm_client_map_requested */
+
+/* Reparent a client. The server unmaps a mapped window, reparents it and
+ * maps it again; those notifies are our doing, not the client withdrawing
+ * and coming back, so they're counted to be ignored and listeners never see
+ * them. The ReparentNotify still updates client->container. */
+void wm_client_reparent(wm_t *wm, client_t *client, Window parent, int x,
+                        int y) {
+  if (wm_client_mapped(wm, client)) {
+    client->ignore_unmaps++;
+    client->ignore_maps++;
+  }
+  wm_x_reparent_window(wm, client->window, parent, x, y);
+} /* void wm_client_reparent */
+
+/* Hide a client without it counting as a withdrawal: it stays in the client
+ * table and WM_EVENT_WINDOW_UNMAP isn't called. Mapping it again later is
+ * an ordinary map. */
+void wm_client_unmap(wm_t *wm, client_t *client) {
+  if (wm_client_mapped(wm, client)) {
+    client->ignore_unmaps++;
+    wm_x_unmap_window(wm, client->window);
+  }
+  client->flags &= ~(CLIENT_VISIBLE);
+  wm_index_update(wm, client);
+  wm_occlusion_mark_client(wm, client);
+  wm_shm_mark_dirty(wm);
+} /* void wm_client_unmap */
+
+/* Send a synthetic ConfigureNotify telling a tiled client its real
+ * geometry. Coordinates are root-relative, which we can work out from the
+ * containers in the client table without asking the server. */
+void wm_client_send_configure(wm_t *wm, client_t *client) {
+  XEvent ev;
+  client_t *parent;
+  int x = client->allotted.x;
+  int y = client->allotted.y;
+
+  for (parent = wm_get_client(wm, client->container, False); parent != NULL;
+       parent = wm_get_client(wm, parent->container, False)) {
+    x += parent->attr.x + parent->attr.border_width;
+    y += parent->attr.y + parent->attr.border_width;
+  }
+
+  memset(&ev, 0, sizeof(ev));
+  ev.xconfigure.type = ConfigureNotify;
+  ev.xconfigure.event = client->window;
+  ev.xconfigure.window = client->window;
+  ev.xconfigure.x = x;
+  ev.xconfigure.y = y;
+  ev.xconfigure.width = client->allotted.width;
+  ev.xconfigure.height = client->allotted.height;
+  ev.xconfigure.border_width = 0;
+  ev.xconfigure.above = None;
+  ev.xconfigure.override_redirect = False;
+  wm_x_send_event(wm, client->window, StructureNotifyMask, &ev);
+} /* void wm_client_send_configure */
+
 void wm_remove_client(wm_t *wm, client_t *client) {
-  XDeleteContext(wm->dpy, client->window, wm->context);
+  g_hash_table_remove(wm->clients, GUINT_TO_POINTER(client->window));
+  wm_index_remove(wm, client);
+  wm_occlusion_mark_client(wm, client);
+  if (wm->focus == client->window)
+    wm->focus = None;
+  wm_shm_mark_dirty(wm);
+  wm_timer_cancel_client(wm, client);
+  wm_sync_forget(wm, client);
+  wm_ewmh_forget(wm, client);
+
+  free(client->name);
+  free(client->res_name);
+  free(client->res_class);
+  free(client->role);
+  free(client->net_wm_state);
+  wm_icon_unref(wm, client->icon);
+  wm_res_freed(wm, WM_RES_CLIENT, client);
+  free(client);
 }
 
 Display *wm_x_get_display(wm_t *wm) {
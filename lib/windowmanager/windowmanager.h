@@ -17,11 +17,62 @@ enum log_values {
 };
 
 struct wm;
+struct wm_shm;
+struct wm_eventlog;
+struct wm_worker;
+struct wm_titles;
+struct wm_errors;
+struct wm_stacks;
+struct wm_occlusion;
+struct wm_resources;
+struct wm_idle;
+struct wm_timers;
+struct wm_timer;
+struct wm_multi;
+struct wm_indexes;
+struct wm_client_index;
+struct wm_pointer;
+struct wm_roundtrips;
+struct wm_mock;
+struct wm_icons;
+struct wm_ewmh;
+struct wm_places;
+struct wm_txn;
 typedef struct wm wm_t;
+typedef struct wm_multi wm_multi_t;
 typedef struct wm_event wm_event_t;
+typedef struct wm_res_snapshot wm_res_snapshot_t;
+typedef void (*wm_idle_func)(wm_t *wm, gpointer data);
 
 typedef void (*x_event_handler_func)(wm_t *wm, XEvent *ev);
 typedef Bool (*wm_event_handler_func)(wm_t *wm, wm_event_t *event, gpointer data);
+typedef void (*wm_error_func)(wm_t *wm, XErrorEvent *error, Window window,
+                              const char *op, gpointer data);
+typedef Bool (*wm_setup_func)(wm_t *wm, gpointer data);
+
+/* Colors are anything XParseColor understands. A NULL field gets the
+ * default. */
+typedef struct wm_theme {
+  const char *title_font;
+  const char *title_bg[2]; /* indexed by focus state */
+  const char *title_fg[2];
+  const char *title_border;
+  const char *frame_border;
+} wm_theme_t;
+
+typedef struct wm_keybinding {
+  KeySym keysym;
+  unsigned int modifiers;
+  const char *action;
+} wm_keybinding_t;
+
+/* Read-only resources any number of wm_t's may point at, from any number of
+ * threads; see multi.c. Not to be changed while they're in use. */
+typedef struct wm_shared {
+  const wm_theme_t *theme; /* NULL for the default */
+  const wm_keybinding_t *keys;
+  unsigned int num_keys;
+} wm_shared_t;
 
 struct wm {
   Display *dpy;
@@ -31,10 +82,79 @@ struct wm {
   int num_screens;
 
   int log_level;
+  char *log_prefix; /* e.g. the display name, when running several */
+
+  /* Theme and key bindings, possibly shared with other displays */
+  const wm_shared_t *shared;
+  wm_theme_t *theme; /* shared->theme with the defaults filled in */
 
   x_event_handler_func *x_event_handlers;
   GPtrArray **listeners;
-  XContext context;
+
+  /* Client table, Window -> client_t */
+  GHashTable *clients;
+  struct wm_indexes *indexes; /* the same clients by other keys, see index.c */
+  Window focus;
+
+  /* Shared-memory export of the client table, see wmshm.h */
+  struct wm_shm *shm;
+
+  /* Event recording or replay, see eventlog.c */
+  struct wm_eventlog *eventlog;
+
+  /* Background property fetches, see worker.c */
+  struct wm_worker *worker;
+
+  /* Rendered title cache, see title.c */
+  struct wm_titles *titles;
+
+  /* _NET_WM_SYNC_REQUEST pacing, see sync.c */
+  int sync_event_base; /* -1 without the XSync extension */
+  GPtrArray *sync_pending; /* clients we're waiting on */
+
+  /* Requests awaiting possible errors, see errors.c */
+  struct wm_errors *errors;
+
+  /* Stacking order per parent window, see stack.c */
+  struct wm_stacks *stacks;
+
+  /* Fully covered clients, see occlusion.c */
+  struct wm_occlusion *occlusion;
+
+  /* Live resources by type and creation site, NULL unless enabled; see
+   * resources.c */
+  struct wm_resources *resources;
+
+  /* Work deferred until there's no input, see idle.c */
+  struct wm_idle *idle;
+
+  /* Pending timers, see timer.c */
+  struct wm_timers *timers;
+
+  /* Where the pointer was last seen, see pointer.c */
+  struct wm_pointer *pointer;
+
+  /* Blocking requests by who made them, see roundtrip.c */
+  struct wm_roundtrips *roundtrips;
+
+  /* In-memory display standing in for dpy, NULL normally; see mock.c */
+  struct wm_mock *mock;
+
+  /* Icons shared between clients, see icon.c */
+  struct wm_icons *icons;
+
+  /* _NET_CLIENT_LIST and friends as published, see ewmh.c */
+  struct wm_ewmh *ewmh;
+
+  /* Where applications were last put, see placement.c */
+  struct wm_places *places;
+
+  /* Requests held back until wm_txn_commit, see txn.c */
+  struct wm_txn *txn;
+
+  /* Border of the frames wm_map_window makes, allocated on first use */
+  unsigned long frame_border_pixel;
+  Bool frame_border_allocated;
 };
 
 typedef struct wm_event_handler {
@@ -42,13 +162,104 @@ typedef struct wm_event_handler {
   gpointer data; /* aka 'void *' */
 } wm_event_handler_t;
 
+/* Per-client _NET_WM_SYNC_REQUEST state */
+typedef struct client_sync {
+  XID counter; /* None if the client doesn't support sync requests */
+  XID alarm;
+  gint64 value; /* last value we asked for */
+  gint64 sent; /* monotonic time of the outstanding request, 0 if none */
+  guint timeout; /* timer for giving up on the outstanding request */
+  Bool queued; /* allotted changed while a request was outstanding */
+} client_sync_t;
+
+/* An application icon, shared by every client showing it; see icon.c */
+#define WM_ICON_MAX_SIZE 64U /* largest size kept, on either side */
+typedef struct wm_icon {
+  unsigned int width;
+  unsigned int height;
+  guint32 *pixels; /* premultiplied ARGB, row by row */
+
+  /* Bookkeeping for icon.c */
+  guint64 hash;
+  unsigned int refs;
+  Bool interned;
+  GSList *scaled; /* the same icon at smaller sizes */
+} wm_icon_t;
+
 typedef struct client {
   Window window;
   XWindowAttributes attr;
   Screen *screen;
   unsigned int flags;
+  char *name;
+  Window container; /* current parent, None if a child of the root */
+
+  /* Filled in by wm_client_fetch */
+  char *res_name;
+  char *res_class;
+  char *role; /* WM_WINDOW_ROLE, NULL if none */
+  Atom *net_wm_state; /* _NET_WM_STATE as last read, including ours */
+  unsigned long net_wm_state_len;
+  XWMHints hints; /* hints.flags is 0 if the client has none */
+  Window transient_for; /* None if not transient */
+  struct wm_icon *icon; /* shared, see icon.c; NULL until asked for */
+  Bool icon_wanted; /* someone asked, so keep it up to date */
+  unsigned int fetch_pending;
+  unsigned int fetch_dirty; /* changed again while pending; fetch once more */
+  unsigned int fetched; /* WM_FETCH_* that have come in at least once */
+  guint map_held; /* timer of a MapRequest waiting on them, see placement.c */
+
+  /* Geometry the layout gave this client, relative to its container. Only
+   * meaningful for CLIENT_TILED clients. */
+  XRectangle allotted;
+
+  client_sync_t sync;
+
+  /* Map and unmap notifies we caused (occlusion.c, wm_client_reparent,
+   * wm_client_unmap), to be ignored */
+  unsigned int ignore_maps;
+  unsigned int ignore_unmaps;
+
+  struct wm_timer *timers; /* cancelled when the client is removed */
+  struct wm_client_index *index; /* position in the secondary indexes */
 } client_t;
 
+/* A remembered place, see placement.c. The rectangle is in root
+ * coordinates. */
+typedef struct wm_place {
+  Screen *screen;
+  int x, y;
+  unsigned int width, height;
+} wm_place_t;
+
+typedef void (*wm_timer_func)(wm_t *wm, client_t *client, gpointer data);
+
+/* wm_client_fetch flags */
+#define WM_FETCH_NAME 1U
+#define WM_FETCH_CLASS 2U
+#define WM_FETCH_HINTS 4U
+#define WM_FETCH_ICON 8U
+#define WM_FETCH_SYNC 16U /* WM_PROTOCOLS and _NET_WM_SYNC_REQUEST_COUNTER */
+#define WM_FETCH_TRANSIENT 32U
+#define WM_FETCH_ROLE 64U
+#define WM_FETCH_STATE 128U /* _NET_WM_STATE */
+
+typedef struct wm_fetch_result {
+  Window window;
+  unsigned int what;
+  char *name;
+  char *res_name;
+  char *res_class;
+  char *role;
+  Atom *net_wm_state;
+  unsigned long net_wm_state_len;
+  XWMHints hints;
+  unsigned long *icon; /* one image, as wm_icon_prepare leaves it */
+  unsigned long icon_len;
+  XID sync_counter; /* None unless the client supports sync requests */
+  Window transient_for;
+} wm_fetch_result_t;
+
 typedef unsigned int wm_event_id;
 struct wm_event {
   wm_t *wm;
@@ -60,7 +271,8 @@ struct wm_event {
 #define ButtonEventMask ButtonPressMask | ButtonReleaseMask
 #define MouseEventMask ButtonPressMask | ButtonReleaseMask | PointerMotionMask
 #define ClientWindowMask \
-  (EnterWindowMask | LeaveWindowMask | PropertyChangeMask | StructureNotifyMask)
+  (EnterWindowMask | LeaveWindowMask | PropertyChangeMask | StructureNotifyMask \
+   | FocusChangeMask)
 
 /* 
  * Mapping of X11 events to libwindowmanager events:
@@ -70,9 +282,12 @@ struct wm_event {
  * WM_EVENT_WINDOW_LEAVE => LeaveNotify
  * WM_EVENT_WINDOW_MAP => MapNotify
  * WM_EVENT_WINDOW_UNMAP => UnmapNotify
- * WM_EVENT_WINDOW_MAP_REQUEST => MapRequest
+ * WM_EVENT_WINDOW_MAP_REQUEST => MapRequest; xevent is NULL if it was held
+ *   for placement (wm_place_hold)
+ * WM_EVENT_WINDOW_NAME => client name (re)fetched; xevent is NULL
  * WM_EVENT_WINDOW_PROPERTY_CHANGE => PropertyNotify with state PropertyNewValue
  * WM_EVENT_WINDOW_PROPERTY_DELETE => PropertyNotify with state PropertyDelete
+ * WM_EVENT_WINDOW_ICON => client icon (re)fetched; xevent is NULL
  */
 
 // :!sort | awk '{print $1, $2, NR"U"}; END { print "\#define WM_EVENT_MAX "NR"U" }'
@@ -85,21 +300,76 @@ struct wm_event {
 #define WM_EVENT_WINDOW_LEAVE 6U
 #define WM_EVENT_WINDOW_MAP 7U
 #define WM_EVENT_WINDOW_MAP_REQUEST 8U
-#define WM_EVENT_WINDOW_PROPERTY_CHANGE 9U
-#define WM_EVENT_WINDOW_PROPERTY_DELETE 10U
-#define WM_EVENT_WINDOW_UNMAP 11U
-#define WM_EVENT_MAX 11U
+#define WM_EVENT_WINDOW_NAME 9U
+#define WM_EVENT_WINDOW_PROPERTY_CHANGE 10U
+#define WM_EVENT_WINDOW_PROPERTY_DELETE 11U
+#define WM_EVENT_WINDOW_UNMAP 12U
+/* Appended rather than sorted in, so the numbers above stay put */
+#define WM_EVENT_WINDOW_ICON 13U
+#define WM_EVENT_MAX 13U
 
 /* Client flags */
 #define CLIENT_VISIBLE 1U
+#define CLIENT_TILED 2U /* geometry is owned by the layout, not the client */
+#define CLIENT_OCCLUDED 4U /* fully covered by windows above it */
+#define CLIENT_MANAGED 8U /* in _NET_CLIENT_LIST, see ewmh.c */
+#define CLIENT_MAPPED 16U /* mapped on the server, see wm_client_mapped */
+
+/* Secondary indexes over the client table, see index.c */
+#define WM_INDEX_SCREEN 0U
+#define WM_INDEX_CONTAINER 1U
+#define WM_INDEX_CLASS 2U /* res_class */
+#define WM_INDEX_VISIBLE 3U /* CLIENT_VISIBLE */
+#define WM_INDEX_TRANSIENT_FOR 4U
+#define WM_INDEX_MAX 4U
+
+/* Iterator over the result of a wm_query_* call */
+typedef struct wm_query {
+  GList *next;
+  unsigned int count; /* number of results, known up front */
+} wm_query_t;
+
+/* wm_occlusion_set_mode modes */
+#define WM_OCCLUSION_OFF 0U
+#define WM_OCCLUSION_HIDDEN 1U /* set _NET_WM_STATE_HIDDEN */
+#define WM_OCCLUSION_UNMAP 2U /* also unmap the window */
+
+/* wm_txn_begin flags */
+#define WM_TXN_GRAB 1U /* grab the server while the commit is sent */
+
+/* wm_idle_add priorities, most urgent first */
+#define WM_IDLE_HIGH 0U
+#define WM_IDLE_DEFAULT 1U
+#define WM_IDLE_LOW 2U
+#define WM_IDLE_PRIORITIES 3U
+
+/* Resource types for wm_res_created and wm_res_freed */
+#define WM_RES_CLIENT 0U /* client_t */
+#define WM_RES_HEAP 1U /* any other heap object */
+#define WM_RES_WINDOW 2U
+#define WM_RES_PIXMAP 3U
+#define WM_RES_GC 4U
+#define WM_RES_COLOR 5U /* key is the pixel */
+#define WM_RES_ALARM 6U /* XSync alarm */
+#define WM_RES_ICON 7U /* wm_icon_t, interned or scaled */
+#define WM_RES_FETCH 8U /* fetch handed to the worker; key is the window */
+#define WM_RES_MAX 8U
+
+/* Record the caller's file:line as the creation site. XIDs are passed as
+ * GUINT_TO_POINTER(id), heap objects as themselves. */
+#define wm_res_created(wm, type, key) \
+  wm_res_created_at((wm), (type), (key), __FILE__ ":" G_STRINGIFY(__LINE__))
 
 /* TODO(sissel): Check if we have __FUNCTION__, this requires GCC, I think. */
 #define __func__ __FUNCTION__
 
 wm_t *wm_new();
 wm_t *wm_new2(char *display_name);
+void wm_init(wm_t *wm);
 
 void wm_main(wm_t *wm);
+void wm_dispatch(wm_t *wm, XEvent *ev);
+void wm_wait(wm_t *wm);
 
 Display *wm_x_get_display(wm_t *wm);
 void wm_log(wm_t *wm, int log_level, char *format, ...);
@@ -129,6 +399,8 @@ void wm_event_leavenotify(wm_t *wm, XEvent *ev);
 void wm_event_propertynotify(wm_t *wm, XEvent *ev);
 void wm_event_unmapnotify(wm_t *wm, XEvent *ev);
 void wm_event_destroynotify(wm_t *wm, XEvent *ev);
+void wm_event_reparentnotify(wm_t *wm, XEvent *ev);
+void wm_event_focusin(wm_t *wm, XEvent *ev);
 void wm_event_expose(wm_t *wm, XEvent *ev);
 void wm_event_createnotify(wm_t *wm, XEvent *ev);
 void wm_event_unknown(wm_t *wm, XEvent *ev);
@@ -142,5 +414,323 @@ void wm_get_mouse_position(wm_t *wm, int *x, int *y, Window window);
 Bool wm_grab_button(wm_t *wm, Window window, unsigned int mask, unsigned int button);
 client_t *wm_get_client(wm_t *wm, Window window, Bool create_if_necessary);
 void wm_remove_client(wm_t *wm, client_t *client);
+void wm_client_set_tiled(wm_t *wm, client_t *client, Bool tiled);
+void wm_client_moveresize(wm_t *wm, client_t *client, int x, int y,
+                          unsigned int width, unsigned int height);
+void wm_client_send_configure(wm_t *wm, client_t *client);
+Bool wm_client_mapped(wm_t *wm, client_t *client);
+void wm_client_map_requested(wm_t *wm, Window window, Bool mapped);
+void wm_client_reparent(wm_t *wm, client_t *client, Window parent, int x, int y);
+void wm_client_unmap(wm_t *wm, client_t *client);
+
+/* shm.c */
+Bool wm_shm_open(wm_t *wm, const char *name, unsigned int max_clients);
+void wm_shm_close(wm_t *wm);
+void wm_shm_mark_dirty(wm_t *wm);
+void wm_shm_publish(wm_t *wm);
+
+/* eventlog.c */
+Bool wm_eventlog_record(wm_t *wm, const char *path);
+wm_t *wm_new_replay(const char *path);
+Bool wm_eventlog_replaying(wm_t *wm);
+void wm_eventlog_close(wm_t *wm);
+void wm_eventlog_flush(wm_t *wm);
+void wm_eventlog_event(wm_t *wm, XEvent *ev);
+Bool wm_eventlog_next_event(wm_t *wm, XEvent *ev);
+void wm_eventlog_fetch_result(wm_t *wm, wm_fetch_result_t *result);
+void wm_eventlog_replay_fetch(wm_t *wm);
+void wm_eventlog_stats(wm_t *wm, unsigned long *events, unsigned long *replies,
+                       unsigned long *divergences);
+
+/* X requests made by the dispatch layer; recorded and replayed by eventlog.c.
+ * Those that wait for a reply are charged to their caller (roundtrip.c). */
+Status wm_x_get_window_attributes_at(wm_t *wm, Window w,
+                                     XWindowAttributes *attr,
+                                     const char *caller);
+#define wm_x_get_window_attributes(wm, w, attr) \
+  wm_x_get_window_attributes_at(wm, w, attr, __func__)
+Atom wm_x_intern_atom_at(wm_t *wm, const char *name, Bool only_if_exists,
+                         const char *caller);
+#define wm_x_intern_atom(wm, name, only_if_exists) \
+  wm_x_intern_atom_at(wm, name, only_if_exists, __func__)
+char *wm_x_get_atom_name_at(wm_t *wm, Atom atom, const char *caller);
+#define wm_x_get_atom_name(wm, atom) wm_x_get_atom_name_at(wm, atom, __func__)
+Bool wm_x_query_pointer_at(wm_t *wm, Window w, Window *root, Window *child,
+                           int *root_x, int *root_y, int *x, int *y,
+                           unsigned int *mask, const char *caller);
+#define wm_x_query_pointer(wm, w, root, child, root_x, root_y, x, y, mask) \
+  wm_x_query_pointer_at(wm, w, root, child, root_x, root_y, x, y, mask, \
+                        __func__)
+Status wm_x_query_tree_at(wm_t *wm, Window w, Window *root, Window *parent,
+                          Window **children, unsigned int *nchildren,
+                          const char *caller);
+#define wm_x_query_tree(wm, w, root, parent, children, nchildren) \
+  wm_x_query_tree_at(wm, w, root, parent, children, nchildren, __func__)
+void wm_x_mask_event(wm_t *wm, long event_mask, XEvent *ev);
+void wm_x_grab_server(wm_t *wm);
+void wm_x_ungrab_server(wm_t *wm);
+void wm_x_sync_at(wm_t *wm, const char *caller);
+#define wm_x_sync(wm) wm_x_sync_at(wm, __func__)
+void wm_x_select_input(wm_t *wm, Window w, long event_mask);
+void wm_x_map_window(wm_t *wm, Window w);
+void wm_x_unmap_window(wm_t *wm, Window w);
+void wm_x_reparent_window(wm_t *wm, Window w, Window parent, int x, int y);
+void wm_x_move_window(wm_t *wm, Window w, int x, int y);
+void wm_x_move_resize_window(wm_t *wm, Window w, int x, int y,
+                             unsigned int width, unsigned int height);
+void wm_x_send_event(wm_t *wm, Window w, long event_mask, XEvent *ev);
+void wm_x_configure_window(wm_t *wm, Window w, unsigned int value_mask,
+                           XWindowChanges *changes);
+void wm_x_grab_pointer(wm_t *wm, Window w, unsigned int event_mask);
+void wm_x_raise_window(wm_t *wm, Window w);
+void wm_x_restack_windows(wm_t *wm, Window *windows, int nwindows);
+void wm_x_change_property(wm_t *wm, Window w, Atom property, Atom type,
+                          int format, int mode, const unsigned char *data,
+                          int nelements);
+void wm_x_delete_property(wm_t *wm, Window w, Atom property);
+void wm_x_ungrab_pointer(wm_t *wm);
+void wm_x_set_input_focus(wm_t *wm, Window w, int revert_to);
+void wm_x_flush(wm_t *wm);
+
+/* worker.c */
+Bool wm_worker_start(wm_t *wm);
+void wm_worker_stop(wm_t *wm);
+int wm_worker_fd(wm_t *wm);
+void wm_worker_collect(wm_t *wm);
+void wm_client_fetch(wm_t *wm, client_t *client, unsigned int what);
+void wm_client_fetch_now(wm_t *wm, client_t *client, unsigned int what);
+void wm_fetch_apply(wm_t *wm, wm_fetch_result_t *result);
+
+/* title.c */
+Bool wm_title_init(wm_t *wm, const char *font_name, unsigned int max_entries);
+unsigned int wm_title_height(wm_t *wm);
+void wm_title_draw_icon(wm_t *wm, Drawable dest, Screen *screen, int x, int y,
+                        unsigned int width, unsigned int height,
+                        const char *text, Bool focused, const wm_icon_t *icon);
+void wm_title_draw(wm_t *wm, Drawable dest, Screen *screen, int x, int y,
+                   unsigned int width, unsigned int height,
+                   const char *text, Bool focused);
+void wm_title_stats(wm_t *wm, unsigned long *hits, unsigned long *misses,
+                    unsigned int *entries);
+
+/* errors.c */
+void wm_error_init(wm_t *wm);
+void wm_error_track(wm_t *wm, Window window, const char *op,
+                    wm_error_func on_error, gpointer data);
+void wm_error_process(wm_t *wm);
+void wm_error_stats(wm_t *wm, unsigned long *errors, unsigned long *matched,
+                    unsigned int *tracked);
+
+/* stack.c */
+void wm_stack_init(wm_t *wm);
+void wm_stack_place(wm_t *wm, Window window, Window parent, Window sibling);
+void wm_stack_add(wm_t *wm, Window window, Window parent);
+void wm_stack_reparented(wm_t *wm, Window window, Window parent);
+void wm_stack_remove(wm_t *wm, Window window);
+void wm_stack_raise(wm_t *wm, Window window);
+void wm_stack_lower(wm_t *wm, Window window);
+Window wm_stack_top(wm_t *wm, Window parent);
+const GQueue *wm_stack_order(wm_t *wm, Window parent);
+client_t *wm_stack_top_client(wm_t *wm, Window parent, unsigned int flags);
+void wm_stack_flush(wm_t *wm);
+
+/* occlusion.c */
+void wm_occlusion_init(wm_t *wm);
+void wm_occlusion_set_mode(wm_t *wm, unsigned int mode);
+void wm_occlusion_mark(wm_t *wm, Window parent);
+void wm_occlusion_mark_client(wm_t *wm, client_t *client);
+void wm_occlusion_reveal(wm_t *wm, client_t *client);
+void wm_occlusion_mapped(wm_t *wm, client_t *client);
+void wm_occlusion_update(wm_t *wm);
+
+/* resources.c */
+void wm_res_init(wm_t *wm);
+void wm_res_enable(wm_t *wm);
+Bool wm_res_enabled(wm_t *wm);
+void wm_res_created_at(wm_t *wm, unsigned int type, gconstpointer key,
+                       const char *site);
+void wm_res_freed(wm_t *wm, unsigned int type, gconstpointer key);
+unsigned int wm_res_count(wm_t *wm, unsigned int type);
+wm_res_snapshot_t *wm_res_snapshot(wm_t *wm);
+void wm_res_snapshot_free(wm_res_snapshot_t *snapshot);
+unsigned int wm_res_diff(wm_t *wm, wm_res_snapshot_t *before,
+                         wm_res_snapshot_t *after);
+void wm_res_poll(wm_t *wm);
+
+/* idle.c */
+void wm_idle_init(wm_t *wm);
+void wm_idle_set_budget(wm_t *wm, gint64 usec);
+void wm_idle_add(wm_t *wm, unsigned int priority, wm_idle_func func,
+                 gpointer data);
+void wm_idle_remove(wm_t *wm, wm_idle_func func, gpointer data);
+Bool wm_idle_pending(wm_t *wm);
+Bool wm_idle_run(wm_t *wm);
+void wm_idle_stats(wm_t *wm, unsigned long *ran, unsigned long *coalesced,
+                   unsigned int *pending);
+
+/* timer.c */
+void wm_timer_init(wm_t *wm);
+guint wm_timer_add(wm_t *wm, unsigned int msec, client_t *client,
+                   wm_timer_func func, gpointer data);
+void wm_timer_cancel(wm_t *wm, guint id);
+void wm_timer_cancel_client(wm_t *wm, client_t *client);
+int wm_timer_timeout(wm_t *wm);
+void wm_timer_run(wm_t *wm);
+unsigned int wm_timer_count(wm_t *wm);
+
+/* index.c */
+void wm_index_init(wm_t *wm);
+void wm_index_update(wm_t *wm, client_t *client);
+void wm_index_remove(wm_t *wm, client_t *client);
+client_t *wm_query_next(wm_query_t *query);
+void wm_query_screen(wm_t *wm, wm_query_t *query, int screen);
+void wm_query_container(wm_t *wm, wm_query_t *query, Window container);
+void wm_query_class(wm_t *wm, wm_query_t *query, const char *res_class);
+void wm_query_visible(wm_t *wm, wm_query_t *query, Bool visible);
+void wm_query_transients(wm_t *wm, wm_query_t *query, Window parent);
+
+/* pointer.c */
+void wm_pointer_init(wm_t *wm);
+void wm_pointer_event(wm_t *wm, XEvent *ev);
+void wm_pointer_forget(wm_t *wm);
+Bool wm_pointer_get(wm_t *wm, Window window, Window *root, int *x, int *y);
+void wm_pointer_stats(wm_t *wm, unsigned long *updates,
+                      unsigned long *queries);
+
+/* roundtrip.c */
+typedef struct wm_roundtrip {
+  unsigned long serial;
+  gint64 start;
+} wm_roundtrip_t;
+
+void wm_roundtrip_init(wm_t *wm);
+void wm_roundtrip_set_budget(wm_t *wm, unsigned int max);
+int wm_roundtrip_event_begin(wm_t *wm, int event_type);
+void wm_roundtrip_event_end(wm_t *wm, int previous);
+unsigned int wm_roundtrip_listener(wm_t *wm, unsigned int event_id);
+void wm_roundtrip_begin(wm_t *wm, wm_roundtrip_t *mark);
+void wm_roundtrip_end(wm_t *wm, wm_roundtrip_t *mark, const char *caller);
+void wm_roundtrip_report(wm_t *wm);
+void wm_roundtrip_reset(wm_t *wm);
+void wm_roundtrip_stats(wm_t *wm, unsigned long *requests, gint64 *usec,
+                        unsigned long *over_budget);
+
+/* mock.c */
+wm_t *wm_new_mock(int num_screens, unsigned int width, unsigned int height);
+unsigned long wm_mock_run(wm_t *wm);
+void wm_mock_queue_event(wm_t *wm, XEvent *ev);
+unsigned int wm_mock_pending(wm_t *wm);
+Window wm_mock_create_window(wm_t *wm, Window parent, int x, int y,
+                             unsigned int width, unsigned int height,
+                             long event_mask);
+void wm_mock_set_override_redirect(wm_t *wm, Window w, Bool override_redirect);
+void wm_mock_client_map(wm_t *wm, Window w);
+void wm_mock_client_unmap(wm_t *wm, Window w);
+void wm_mock_client_configure(wm_t *wm, Window w, int x, int y,
+                              unsigned int width, unsigned int height);
+void wm_mock_destroy_window(wm_t *wm, Window w);
+void wm_mock_set_name(wm_t *wm, Window w, const char *name);
+void wm_mock_set_class(wm_t *wm, Window w, const char *res_name,
+                       const char *res_class);
+void wm_mock_set_role(wm_t *wm, Window w, const char *role);
+void wm_mock_set_transient_for(wm_t *wm, Window w, Window parent);
+void wm_mock_set_icon(wm_t *wm, Window w, const unsigned long *data,
+                      unsigned long len);
+const unsigned long *wm_mock_get_property(wm_t *wm, Window w, Atom property,
+                                          unsigned long *nitems);
+void wm_mock_move_pointer(wm_t *wm, int screen, int x, int y);
+void wm_mock_stats(wm_t *wm, unsigned long *round_trips,
+                   unsigned long *one_way, unsigned long *dispatched);
+void wm_mock_reset_stats(wm_t *wm);
+void wm_mock_report(wm_t *wm);
+/* For the wm_x_* wrappers and wm_client_fetch */
+void wm_mock_request(wm_t *wm, const char *name);
+Status wm_mock_get_window_attributes(wm_t *wm, Window w,
+                                     XWindowAttributes *attr);
+Atom wm_mock_intern_atom(wm_t *wm, const char *name, Bool only_if_exists);
+char *wm_mock_get_atom_name(wm_t *wm, Atom atom);
+Bool wm_mock_query_pointer(wm_t *wm, Window w, Window *root, Window *child,
+                           int *root_x, int *root_y, int *x, int *y,
+                           unsigned int *mask);
+Status wm_mock_query_tree(wm_t *wm, Window w, Window *root, Window *parent,
+                          Window **children, unsigned int *nchildren);
+void wm_mock_mask_event(wm_t *wm, long event_mask, XEvent *ev);
+void wm_mock_select_input(wm_t *wm, Window w, long event_mask);
+void wm_mock_map_window(wm_t *wm, Window w);
+void wm_mock_unmap_window(wm_t *wm, Window w);
+void wm_mock_reparent_window(wm_t *wm, Window w, Window parent, int x, int y);
+void wm_mock_configure_window(wm_t *wm, Window w, unsigned int value_mask,
+                              XWindowChanges *changes);
+void wm_mock_change_property(wm_t *wm, Window w, Atom property, int format,
+                             int mode, const unsigned char *data,
+                             int nelements);
+void wm_mock_delete_property(wm_t *wm, Window w, Atom property);
+void wm_mock_fetch(wm_t *wm, Window w, unsigned int what,
+                   wm_fetch_result_t *result);
+
+/* ewmh.c */
+void wm_ewmh_init(wm_t *wm);
+void wm_ewmh_manage(wm_t *wm, client_t *client);
+void wm_ewmh_forget(wm_t *wm, client_t *client);
+void wm_ewmh_mark_stacking(wm_t *wm);
+void wm_ewmh_flush(wm_t *wm);
+void wm_ewmh_stats(wm_t *wm, unsigned long *writes, unsigned long *appends,
+                   unsigned long *skipped);
+
+/* placement.c */
+void wm_place_init(wm_t *wm);
+Bool wm_place_open(wm_t *wm, const char *path);
+Bool wm_place_lookup(wm_t *wm, client_t *client, wm_place_t *place);
+Bool wm_place_hold(wm_t *wm, client_t *client);
+void wm_place_fetched(wm_t *wm, client_t *client);
+void wm_place_record(wm_t *wm, client_t *client, const wm_place_t *place);
+void wm_place_stats(wm_t *wm, unsigned long *hits, unsigned long *misses,
+                    unsigned long *writes);
+
+/* txn.c */
+void wm_txn_init(wm_t *wm);
+void wm_txn_begin(wm_t *wm, unsigned int flags);
+void wm_txn_commit(wm_t *wm);
+Bool wm_txn_active(wm_t *wm);
+void wm_txn_stats(wm_t *wm, unsigned long *commits, unsigned long *recorded,
+                  unsigned long *sent);
+/* For the wm_x_* wrappers */
+Bool wm_txn_map(wm_t *wm, Window w, Bool map);
+unsigned int wm_txn_configure(wm_t *wm, Window w, unsigned int value_mask,
+                              XWindowChanges *changes);
+Bool wm_txn_focus(wm_t *wm, Window w, int revert_to);
+void wm_txn_barrier(wm_t *wm, Window w);
+void wm_txn_overlay(wm_t *wm, Window w, XWindowAttributes *attr);
+
+/* icon.c */
+void wm_icon_init(wm_t *wm);
+Bool wm_icon_prepare(const unsigned long *data, unsigned long len,
+                     unsigned long **out, unsigned long *out_len);
+wm_icon_t *wm_icon_intern(wm_t *wm, const unsigned long *data,
+                          unsigned long len);
+void wm_icon_unref(wm_t *wm, wm_icon_t *icon);
+const wm_icon_t *wm_icon_get(wm_t *wm, client_t *client, unsigned int size);
+void wm_icon_draw(wm_t *wm, const wm_icon_t *icon, Drawable dest, GC gc,
+                  Screen *screen, int x, int y, const XColor *bg);
+void wm_icon_stats(wm_t *wm, unsigned long *hits, unsigned long *misses,
+                   unsigned long *scaled, unsigned int *shared);
+
+/* multi.c */
+void wm_set_shared(wm_t *wm, const wm_shared_t *shared);
+const wm_theme_t *wm_get_theme(wm_t *wm);
+void wm_keys_grab(wm_t *wm);
+const wm_keybinding_t *wm_keys_lookup(wm_t *wm, XKeyEvent *ev);
+wm_multi_t *wm_multi_new(const wm_shared_t *shared);
+wm_t *wm_multi_add(wm_multi_t *multi, const char *display_name,
+                   wm_setup_func setup, gpointer data);
+unsigned int wm_multi_count(wm_multi_t *multi);
+unsigned int wm_multi_run(wm_multi_t *multi);
+
+/* sync.c */
+void wm_sync_init(wm_t *wm);
+Bool wm_sync_resize(wm_t *wm, client_t *client);
+void wm_sync_alarm_notify(wm_t *wm, XEvent *ev);
+void wm_sync_set_counter(wm_t *wm, client_t *client, XID counter);
+void wm_sync_forget(wm_t *wm, client_t *client);
 
 #endif /* _WINDOWMANAGER_H_ */
@@ -0,0 +1,362 @@
+/*
+ * Microbenchmarks for the dispatch and layout paths.
+ *
+ * By default these run against the in-memory display in mock.c, so they
+ * need no X server, take milliseconds, and the request counts they print
+ * are exact. Given a display name, the same steps run against a real server
+ * instead, with a second connection playing the clients; there only round
+ * trips are counted (roundtrip.c).
+ *
+ *   manage:   clients map themselves; a listener reparents each into a
+ *             container frame and sizes it
+ *   events:   clients rename themselves while the pointer moves between
+ *             containers; events dispatched per second
+ *   relayout: retile every container and resize every client in it, found
+ *             through the container index
+ *   withdraw: clients unmap themselves
+ *
+ * Every client has to reach the map and unmap listeners exactly once, even
+ * though it was reparented before it was mapped; wmbench exits with 1 if
+ * one doesn't.
+ *
+ * usage: wmbench [-n clients] [-c containers] [-i iterations] [display]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "windowmanager.h"
+
+#define BENCH_WIDTH 1920
+#define BENCH_HEIGHT 1080
+#define BENCH_BATCH 64 /* events per drain in the events benchmark */
+
+typedef struct bench_container {
+  Window frame;
+  int x, y;
+  unsigned int width, height;
+} bench_container_t;
+
+typedef struct bench {
+  wm_t *wm;
+  Display *clients; /* the clients' connection; NULL on the mock */
+  Window root;
+
+  bench_container_t *containers;
+  unsigned int num_containers;
+  Window *windows;
+  unsigned int num_windows;
+  unsigned int next_container; /* for the next client managed */
+
+  unsigned long listener_calls;
+  unsigned long maps; /* WM_EVENT_WINDOW_MAP */
+  unsigned long unmaps; /* WM_EVENT_WINDOW_UNMAP */
+} bench_t;
+
+static Window bench_create_window(bench_t *b, Window parent, int x, int y,
+                                  unsigned int width, unsigned int height,
+                                  long event_mask) {
+  XSetWindowAttributes attr;
+  Window w;
+
+  if (b->wm->mock != NULL)
+    return wm_mock_create_window(b->wm, parent, x, y, width, height,
+                                 event_mask);
+  /* Frames belong to the window manager, everything else to the clients */
+  if (event_mask != 0) {
+    attr.event_mask = event_mask;
+    return XCreateWindow(b->wm->dpy, parent, x, y, width, height, 0,
+                         CopyFromParent, InputOutput, CopyFromParent,
+                         CWEventMask, &attr);
+  }
+  w = XCreateSimpleWindow(b->clients, parent, x, y, width, height, 0, 0, 0);
+  XFlush(b->clients);
+  return w;
+} /* static Window bench_create_window */
+
+static void bench_client_map(bench_t *b, Window w) {
+  if (b->wm->mock != NULL)
+    wm_mock_client_map(b->wm, w);
+  else
+    XMapWindow(b->clients, w);
+} /* static void bench_client_map */
+
+static void bench_client_unmap(bench_t *b, Window w) {
+  if (b->wm->mock != NULL)
+    wm_mock_client_unmap(b->wm, w);
+  else
+    XUnmapWindow(b->clients, w);
+} /* static void bench_client_unmap */
+
+static void bench_set_name(bench_t *b, Window w, const char *name) {
+  if (b->wm->mock != NULL)
+    wm_mock_set_name(b->wm, w, name);
+  else
+    XStoreName(b->clients, w, name);
+} /* static void bench_set_name */
+
+static void bench_move_pointer(bench_t *b, int x, int y) {
+  if (b->wm->mock != NULL)
+    wm_mock_move_pointer(b->wm, 0, x, y);
+  else
+    XWarpPointer(b->clients, None, b->root, 0, 0, 0, 0, x, y);
+} /* static void bench_move_pointer */
+
+/* Handle everything the requests so far caused. Returns the number of
+ * events dispatched. */
+static unsigned long bench_drain(bench_t *b) {
+  unsigned long dispatched = 0;
+  XEvent ev;
+
+  if (b->wm->mock != NULL)
+    return wm_mock_run(b->wm);
+
+  XSync(b->clients, False);
+  wm_x_sync(b->wm);
+  while (XPending(b->wm->dpy)) {
+    XNextEvent(b->wm->dpy, &ev);
+    wm_dispatch(b->wm, &ev);
+    dispatched++;
+  }
+  wm_timer_run(b->wm);
+  wm_occlusion_update(b->wm);
+  wm_stack_flush(b->wm);
+  wm_ewmh_flush(b->wm);
+  wm_idle_run(b->wm);
+  return dispatched;
+} /* static unsigned long bench_drain */
+
+/* Round trips and one-way requests since the last call. The real server's
+ * one-way requests aren't counted. */
+static void bench_requests(bench_t *b, unsigned long *round_trips,
+                           unsigned long *one_way) {
+  if (b->wm->mock != NULL) {
+    unsigned long dispatched;
+    wm_mock_stats(b->wm, round_trips, one_way, &dispatched);
+    wm_mock_reset_stats(b->wm);
+  } else {
+    gint64 usec;
+    unsigned long over_budget;
+    wm_roundtrip_stats(b->wm, round_trips, &usec, &over_budget);
+    wm_roundtrip_reset(b->wm);
+    *one_way = 0;
+  }
+} /* static void bench_requests */
+
+static Bool bench_count(wm_t *wm, wm_event_t *event, gpointer data) {
+  bench_t *b = data;
+  b->listener_calls++;
+  return True;
+} /* static Bool bench_count */
+
+/* Only the clients bench_map_request tiled are counted, not the frames */
+static Bool bench_map(wm_t *wm, wm_event_t *event, gpointer data) {
+  bench_t *b = data;
+  b->listener_calls++;
+  if (event->client != NULL && (event->client->flags & CLIENT_TILED))
+    b->maps++;
+  return True;
+} /* static Bool bench_map */
+
+static Bool bench_unmap(wm_t *wm, wm_event_t *event, gpointer data) {
+  bench_t *b = data;
+  b->listener_calls++;
+  if (event->client != NULL && (event->client->flags & CLIENT_TILED))
+    b->unmaps++;
+  return True;
+} /* static Bool bench_unmap */
+
+/* What a tiling window manager does with a new client */
+static Bool bench_map_request(wm_t *wm, wm_event_t *event, gpointer data) {
+  bench_t *b = data;
+  bench_container_t *container;
+
+  b->listener_calls++;
+  if (event->client == NULL)
+    return False;
+  container = &b->containers[b->next_container++ % b->num_containers];
+  wm_client_set_tiled(wm, event->client, True);
+  wm_client_reparent(wm, event->client, container->frame, 0, 0);
+  wm_client_moveresize(wm, event->client, 0, 0, container->width,
+                       container->height);
+  wm_x_map_window(wm, event->client->window);
+  return True;
+} /* static Bool bench_map_request */
+
+/* Tile the containers in 'columns' columns, and fit each one's clients to
+ * it. */
+static void bench_layout(bench_t *b, unsigned int columns) {
+  unsigned int rows = (b->num_containers + columns - 1) / columns;
+  unsigned int i;
+
+  for (i = 0; i < b->num_containers; i++) {
+    bench_container_t *container = &b->containers[i];
+    wm_query_t query;
+    client_t *client;
+
+    container->width = BENCH_WIDTH / columns;
+    container->height = BENCH_HEIGHT / rows;
+    container->x = (i % columns) * container->width;
+    container->y = (i / columns) * container->height;
+    wm_x_move_resize_window(b->wm, container->frame, container->x,
+                            container->y, container->width, container->height);
+
+    wm_query_container(b->wm, &query, container->frame);
+    while ((client = wm_query_next(&query)) != NULL)
+      wm_client_moveresize(b->wm, client, 0, 0, container->width,
+                           container->height);
+  }
+} /* static void bench_layout */
+
+static void bench_print(const char *name, unsigned long count,
+                        const char *unit, gint64 usec, unsigned long events,
+                        unsigned long round_trips, unsigned long one_way) {
+  double sec = usec / 1000000.0;
+
+  printf("%-9s %8lu %-10s %10.3f ms %10.2f usec/%s", name, count, unit,
+         usec / 1000.0, count > 0 ? (double)usec / count : 0, unit);
+  if (events > 0)
+    printf(" %10.0f events/sec", sec > 0 ? events / sec : 0);
+  printf("\n%9s %8.2f round trips/%s, %.2f one-way/%s\n", "",
+         count > 0 ? (double)round_trips / count : 0, unit,
+         count > 0 ? (double)one_way / count : 0, unit);
+} /* static void bench_print */
+
+static void usage(const char *prog) {
+  fprintf(stderr, "usage: %s [-n clients] [-c containers] [-i iterations] "
+          "[display]\n", prog);
+  exit(1);
+} /* static void usage */
+
+int main(int argc, char **argv) {
+  unsigned int num_clients = 200, num_containers = 16, iterations = 1000;
+  const char *display_name = NULL;
+  unsigned long round_trips, one_way, events;
+  gint64 start, usec;
+  bench_t b;
+  char name[64];
+  unsigned int i, columns;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:c:i:")) != -1) {
+    switch (opt) {
+      case 'n': num_clients = strtoul(optarg, NULL, 10); break;
+      case 'c': num_containers = strtoul(optarg, NULL, 10); break;
+      case 'i': iterations = strtoul(optarg, NULL, 10); break;
+      default: usage(argv[0]);
+    }
+  }
+  if (optind < argc)
+    display_name = argv[optind];
+  if (num_containers == 0)
+    usage(argv[0]);
+
+  memset(&b, 0, sizeof(b));
+  if (display_name == NULL) {
+    b.wm = wm_new_mock(1, BENCH_WIDTH, BENCH_HEIGHT);
+  } else {
+    b.wm = wm_new2((char *)display_name);
+    b.clients = XOpenDisplay(display_name);
+    if (b.clients == NULL) {
+      fprintf(stderr, "can't open a second connection to '%s'\n",
+              display_name);
+      return 1;
+    }
+  }
+  wm_set_log_level(b.wm, LOG_ERROR);
+  b.root = b.wm->screens[0]->root;
+  wm_listener_add(b.wm, WM_EVENT_WINDOW_MAP_REQUEST, bench_map_request, &b);
+  wm_listener_add(b.wm, WM_EVENT_WINDOW_NAME, bench_count, &b);
+  wm_listener_add(b.wm, WM_EVENT_WINDOW_ENTER, bench_count, &b);
+  wm_listener_add(b.wm, WM_EVENT_WINDOW_MAP, bench_map, &b);
+  wm_listener_add(b.wm, WM_EVENT_WINDOW_UNMAP, bench_unmap, &b);
+
+  /* The containers, tiled in a square-ish grid */
+  for (columns = 1; columns * columns < num_containers; columns++)
+    ;
+  b.num_containers = num_containers;
+  b.containers = calloc(num_containers, sizeof(bench_container_t));
+  for (i = 0; i < num_containers; i++)
+    b.containers[i].frame = bench_create_window(&b, b.root, 0, 0, 1, 1,
+                                                SubstructureNotifyMask
+                                                | EnterWindowMask);
+  if (b.wm->mock != NULL) {
+    wm_main(b.wm);
+  } else {
+    wm_x_init_handlers(b.wm);
+    wm_x_init_windows(b.wm);
+  }
+  bench_layout(&b, columns);
+  for (i = 0; i < num_containers; i++)
+    wm_x_map_window(b.wm, b.containers[i].frame);
+  bench_drain(&b);
+  bench_requests(&b, &round_trips, &one_way);
+
+  printf("%s: %u clients in %u containers, %u iterations\n",
+         display_name != NULL ? display_name : "mock", num_clients,
+         num_containers, iterations);
+
+  /* manage */
+  b.num_windows = num_clients;
+  b.windows = calloc(num_clients, sizeof(Window));
+  start = g_get_monotonic_time();
+  for (i = 0; i < num_clients; i++) {
+    b.windows[i] = bench_create_window(&b, b.root, 0, 0, 100, 100, 0);
+    bench_client_map(&b, b.windows[i]);
+  }
+  events = bench_drain(&b);
+  usec = g_get_monotonic_time() - start;
+  bench_requests(&b, &round_trips, &one_way);
+  bench_print("manage", num_clients, "client", usec, events, round_trips,
+              one_way);
+
+  /* events */
+  events = 0;
+  start = g_get_monotonic_time();
+  for (i = 0; i < iterations; i++) {
+    bench_container_t *container = &b.containers[i % num_containers];
+    snprintf(name, sizeof(name), "client %u", i);
+    bench_set_name(&b, b.windows[i % num_clients], name);
+    bench_move_pointer(&b, container->x + container->width / 2,
+                       container->y + container->height / 2);
+    if (i % BENCH_BATCH == BENCH_BATCH - 1)
+      events += bench_drain(&b);
+  }
+  events += bench_drain(&b);
+  usec = g_get_monotonic_time() - start;
+  bench_requests(&b, &round_trips, &one_way);
+  bench_print("events", events, "event", usec, events, round_trips, one_way);
+
+  /* relayout */
+  events = 0;
+  start = g_get_monotonic_time();
+  for (i = 0; i < iterations; i++) {
+    /* Alternate so every pass changes every geometry */
+    bench_layout(&b, (i % 2) ? columns : (columns > 1 ? columns - 1 : 2));
+    events += bench_drain(&b);
+  }
+  usec = g_get_monotonic_time() - start;
+  bench_requests(&b, &round_trips, &one_way);
+  bench_print("relayout", iterations, "relayout", usec, events, round_trips,
+              one_way);
+
+  /* withdraw */
+  start = g_get_monotonic_time();
+  for (i = 0; i < num_clients; i++)
+    bench_client_unmap(&b, b.windows[i]);
+  events = bench_drain(&b);
+  usec = g_get_monotonic_time() - start;
+  bench_requests(&b, &round_trips, &one_way);
+  bench_print("withdraw", num_clients, "client", usec, events, round_trips,
+              one_way);
+
+  printf("%lu listener calls\n", b.listener_calls);
+  if (b.maps != num_clients || b.unmaps != num_clients) {
+    fprintf(stderr, "%u clients, but %lu maps and %lu unmaps reached the "
+            "listeners\n", num_clients, b.maps, b.unmaps);
+    return 1;
+  }
+  return 0;
+}
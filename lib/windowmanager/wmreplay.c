@@ -0,0 +1,71 @@
+/*
+ * Replay an event log recorded by wm_main (see eventlog.c) through the
+ * dispatch layer without a display, and report throughput.
+ *
+ * Every listener slot gets a counting listener so the per-event listener
+ * counts can be compared between runs; a change in those counts for the same
+ * log means the dispatch behavior changed.
+ *
+ * usage: wmreplay logfile [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include "windowmanager.h"
+
+static unsigned long listener_calls[WM_EVENT_MAX + 1];
+
+static Bool count_event(wm_t *wm, wm_event_t *event, gpointer data) {
+  listener_calls[event->event_id]++;
+  return True;
+} /* static Bool count_event */
+
+static double now(void) {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+int main(int argc, char **argv) {
+  unsigned long events = 0, replies = 0, divergences = 0;
+  int iterations = 1;
+  double start, elapsed = 0;
+  int i;
+  wm_event_id id;
+
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s logfile [iterations]\n", argv[0]);
+    return 1;
+  }
+  if (argc > 2)
+    iterations = atoi(argv[2]);
+
+  for (i = 0; i < iterations; i++) {
+    wm_t *wm = wm_new_replay(argv[1]);
+    if (wm == NULL)
+      return 1;
+    wm_set_log_level(wm, LOG_ERROR);
+    for (id = WM_EVENT_MIN; id <= WM_EVENT_MAX; id++)
+      wm_listener_add(wm, id, count_event, NULL);
+
+    start = now();
+    wm_main(wm);
+    elapsed += now() - start;
+
+    wm_eventlog_stats(wm, &events, &replies, &divergences);
+    wm_eventlog_close(wm);
+  }
+
+  printf("%lu events, %lu replies, %lu divergences per run\n",
+         events, replies, divergences);
+  printf("%d runs in %.3f sec: %.0f events/sec\n", iterations, elapsed,
+         (elapsed > 0) ? (events * iterations) / elapsed : 0);
+  for (id = WM_EVENT_MIN; id <= WM_EVENT_MAX; id++) {
+    if (listener_calls[id] > 0)
+      printf("  event %2u: %lu listener calls\n", id,
+             listener_calls[id] / iterations);
+  }
+  return 0;
+}
@@ -0,0 +1,106 @@
+#ifndef _WMSHM_H_
+#define _WMSHM_H_
+
+/*
+ * Shared-memory layout of the exported client table.
+ *
+ * The window manager owns the segment and is the only writer. Panels, pagers
+ * and switchers map it read-only and take snapshots with
+ * wm_shm_reader_snapshot(), which costs no syscalls and never talks to the X
+ * server.
+ *
+ * Consistency is provided by a sequence lock: the writer makes 'seq' odd
+ * before touching the table and even again when it is done. A reader copies
+ * the table and retries if 'seq' was odd or changed while it was copying.
+ *
+ * Each display has its own segment, named by wm_shm_default_name(). The
+ * writer keeps an exclusive flock() on it, so a second window manager
+ * can't take over a segment that is still being written.
+ *
+ * This header is deliberately free of Xlib and glib so readers don't need
+ * either to use it.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Followed by the display name, see wm_shm_default_name */
+#define WM_SHM_DEFAULT_NAME "/windowmanager-clients"
+#define WM_SHM_NAME_MAX 256
+#define WM_SHM_MAGIC 0x574d434cU /* 'WMCL' */
+#define WM_SHM_VERSION 1U
+#define WM_SHM_TITLE_LEN 128
+
+/* wm_shm_client_t flags */
+#define WM_SHM_CLIENT_VISIBLE 1U
+#define WM_SHM_CLIENT_FOCUSED 2U
+#define WM_SHM_CLIENT_OCCLUDED 4U
+
+typedef struct wm_shm_client {
+  uint32_t window;
+  uint32_t container; /* parent frame window, 0 if a child of the root */
+  int32_t x;
+  int32_t y;
+  uint32_t width;
+  uint32_t height;
+  uint32_t screen;
+  uint32_t flags;
+  char title[WM_SHM_TITLE_LEN]; /* always NUL terminated, may be truncated */
+} wm_shm_client_t;
+
+typedef struct wm_shm_header {
+  /* Written once at creation */
+  uint32_t magic;
+  uint32_t version;
+  uint32_t max_clients;
+  uint32_t record_size;
+
+  /* Protected by seq */
+  uint32_t seq;
+  uint32_t num_clients;
+  uint32_t focus;
+  uint32_t truncated; /* nonzero if there were more clients than max_clients */
+
+  wm_shm_client_t clients[];
+} wm_shm_header_t;
+
+#define WM_SHM_SIZE(max_clients) \
+  (sizeof(wm_shm_header_t) + (max_clients) * sizeof(wm_shm_client_t))
+
+/* The segment name for 'display' (as DisplayString gives it; NULL means
+ * $DISPLAY): WM_SHM_DEFAULT_NAME, a dash, and the display without its
+ * screen number, with any '/' made a '_'. ":0", ":0.0" and ":0.1" all
+ * share one segment. */
+static inline void wm_shm_default_name(char *name, size_t size,
+                                       const char *display) {
+  const char *colon, *dot;
+  size_t i, len;
+
+  if (display == NULL)
+    display = getenv("DISPLAY");
+  if (display == NULL)
+    display = "";
+  len = strlen(display);
+  colon = strrchr(display, ':');
+  dot = (colon != NULL) ? strchr(colon, '.') : NULL;
+  if (dot != NULL)
+    len = dot - display;
+
+  snprintf(name, size, "%s-%.*s", WM_SHM_DEFAULT_NAME, (int)len, display);
+  for (i = 1; name[i] != '\0'; i++)
+    if (name[i] == '/')
+      name[i] = '_';
+} /* static inline void wm_shm_default_name */
+
+/* shmreader.c */
+typedef struct wm_shm_reader wm_shm_reader_t;
+
+wm_shm_reader_t *wm_shm_reader_open(const char *name);
+void wm_shm_reader_close(wm_shm_reader_t *reader);
+unsigned int wm_shm_reader_max_clients(wm_shm_reader_t *reader);
+int wm_shm_reader_snapshot(wm_shm_reader_t *reader, wm_shm_client_t *clients,
+                           unsigned int max_clients, uint32_t *focus);
+
+#endif /* _WMSHM_H_ */
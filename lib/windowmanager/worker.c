@@ -0,0 +1,585 @@
+/*
+ * Background fetching of client properties.
+ *
+ * Titles, class, hints and icons can be arbitrarily large and a client that
+ * stuffs megabytes into a property would otherwise stall every other window
+ * while the main thread waits on the reply. With a worker started, these
+ * fetches run on a separate thread with its own Display connection. Requests
+ * go to the worker and results come back through single-producer,
+ * single-consumer rings; pipes are only used to wake the other side up.
+ * Results are applied to the client table on the main thread by
+ * wm_worker_collect(), which wm_main calls after each batch of events.
+ *
+ * Without a worker, wm_client_fetch() does the same work inline.
+ */
+
+#include "windowmanager.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <X11/Xatom.h>
+
+#define WM_WORKER_RING_SIZE 1024U /* must be a power of two */
+#define WM_WORKER_RING_MASK (WM_WORKER_RING_SIZE - 1)
+
+/* Refuse to pull more than this many 32-bit units of any one property. */
+#define WM_FETCH_MAX_LONGS (4U * 1024U * 1024U)
+
+typedef struct ring {
+  unsigned int head; /* next slot to read, written by the consumer */
+  unsigned int tail; /* next slot to write, written by the producer */
+  void *slots[WM_WORKER_RING_SIZE];
+} ring_t;
+
+/* Atoms wm_fetch needs, interned once per connection */
+typedef struct fetch_atoms {
+  Atom net_wm_name;
+  Atom net_wm_icon;
+  Atom utf8_string;
+  Atom wm_protocols;
+  Atom net_wm_sync_request;
+  Atom net_wm_sync_request_counter;
+  Atom wm_window_role;
+  Atom net_wm_state;
+} fetch_atoms_t;
+
+typedef struct fetch_request {
+  Window window;
+  unsigned int what;
+} fetch_request_t;
+
+struct wm_worker {
+  pthread_t thread;
+  Display *dpy;
+  Bool running;
+
+  ring_t requests; /* main -> worker */
+  ring_t results;  /* worker -> main */
+
+  int wake_worker[2];
+  int wake_main[2];
+
+  /* Windows with fetches that didn't fit in 'requests'; what they wanted
+   * is in their fetch_dirty. Resubmitted by wm_worker_collect. */
+  GHashTable *deferred;
+
+  fetch_atoms_t atoms;
+};
+
+/* Set on the worker thread so the error handler can tell its errors apart */
+static __thread Bool on_worker_thread = False;
+static XErrorHandler previous_error_handler = NULL;
+static pthread_mutex_t previous_error_handler_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static Bool ring_push(ring_t *ring, void *item) {
+  unsigned int tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+  unsigned int head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+  if (tail - head == WM_WORKER_RING_SIZE)
+    return False;
+  ring->slots[tail & WM_WORKER_RING_MASK] = item;
+  __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+  return True;
+} /* static Bool ring_push */
+
+static void *ring_pop(ring_t *ring) {
+  unsigned int head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+  unsigned int tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+  void *item;
+
+  if (head == tail)
+    return NULL;
+  item = ring->slots[head & WM_WORKER_RING_MASK];
+  __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+  return item;
+} /* static void *ring_pop */
+
+static void wake(int fd) {
+  char c = 0;
+  /* The pipe is nonblocking; if it's full the other side is awake anyway. */
+  if (write(fd, &c, 1) < 0 && errno != EAGAIN)
+    perror("wm worker wake");
+}
+
+static void drain(int fd) {
+  char buf[64];
+  while (read(fd, buf, sizeof(buf)) > 0)
+    ;
+}
+
+static int wm_worker_x_error(Display *dpy, XErrorEvent *ev) {
+  /* Windows disappearing under us are expected; the fetch just fails. */
+  if (on_worker_thread)
+    return 0;
+  if (previous_error_handler != NULL)
+    return previous_error_handler(dpy, ev);
+  return 0;
+} /* static int wm_worker_x_error */
+
+static unsigned char *wm_fetch_property(Display *dpy, Window w, Atom property,
+                                        Atom type, unsigned long *nitems) {
+  Atom actual_type;
+  int actual_format;
+  unsigned long bytes_after;
+  unsigned char *data = NULL;
+
+  *nitems = 0;
+  if (XGetWindowProperty(dpy, w, property, 0, WM_FETCH_MAX_LONGS, False, type,
+                         &actual_type, &actual_format, nitems, &bytes_after,
+                         &data) != Success || actual_type != type) {
+    if (data != NULL)
+      XFree(data);
+    *nitems = 0;
+    return NULL;
+  }
+  return data;
+} /* static unsigned char *wm_fetch_property */
+
+static void wm_fetch_atoms(Display *dpy, fetch_atoms_t *atoms) {
+  atoms->net_wm_name = XInternAtom(dpy, "_NET_WM_NAME", False);
+  atoms->net_wm_icon = XInternAtom(dpy, "_NET_WM_ICON", False);
+  atoms->utf8_string = XInternAtom(dpy, "UTF8_STRING", False);
+  atoms->wm_protocols = XInternAtom(dpy, "WM_PROTOCOLS", False);
+  atoms->net_wm_sync_request = XInternAtom(dpy, "_NET_WM_SYNC_REQUEST", False);
+  atoms->net_wm_sync_request_counter =
+    XInternAtom(dpy, "_NET_WM_SYNC_REQUEST_COUNTER", False);
+  atoms->wm_window_role = XInternAtom(dpy, "WM_WINDOW_ROLE", False);
+  atoms->net_wm_state = XInternAtom(dpy, "_NET_WM_STATE", False);
+} /* static void wm_fetch_atoms */
+
+/* Fetch the requested properties of 'w' into 'result'. All strings and the
+ * icon in 'result' are malloc'd. */
+static void wm_fetch(Display *dpy, fetch_atoms_t *atoms, Window w,
+                     unsigned int what, wm_fetch_result_t *result) {
+  memset(result, 0, sizeof(wm_fetch_result_t));
+  result->window = w;
+  result->what = what;
+
+  if (what & WM_FETCH_NAME) {
+    unsigned long nitems;
+    unsigned char *data;
+    char *name = NULL;
+
+    /* Prefer the UTF-8 EWMH name, fall back to ICCCM WM_NAME */
+    data = wm_fetch_property(dpy, w, atoms->net_wm_name, atoms->utf8_string,
+                             &nitems);
+    if (data != NULL) {
+      result->name = strndup((char *)data, nitems);
+      XFree(data);
+    } else if (XFetchName(dpy, w, &name) && name != NULL) {
+      result->name = strdup(name);
+      XFree(name);
+    }
+  }
+
+  if (what & WM_FETCH_CLASS) {
+    XClassHint class_hint;
+    if (XGetClassHint(dpy, w, &class_hint)) {
+      result->res_name = strdup(class_hint.res_name ? class_hint.res_name : "");
+      result->res_class = strdup(class_hint.res_class ? class_hint.res_class : "");
+      if (class_hint.res_name != NULL)
+        XFree(class_hint.res_name);
+      if (class_hint.res_class != NULL)
+        XFree(class_hint.res_class);
+    }
+  }
+
+  if (what & WM_FETCH_ROLE) {
+    unsigned long nitems;
+    unsigned char *data;
+
+    data = wm_fetch_property(dpy, w, atoms->wm_window_role, XA_STRING,
+                             &nitems);
+    if (data != NULL) {
+      result->role = strndup((char *)data, nitems);
+      XFree(data);
+    }
+  }
+
+  if (what & WM_FETCH_STATE) {
+    unsigned long nitems;
+    unsigned char *data;
+
+    data = wm_fetch_property(dpy, w, atoms->net_wm_state, XA_ATOM, &nitems);
+    if (data != NULL) {
+      if (nitems > 0) {
+        result->net_wm_state = malloc(nitems * sizeof(Atom));
+        memcpy(result->net_wm_state, data, nitems * sizeof(Atom));
+        result->net_wm_state_len = nitems;
+      }
+      XFree(data);
+    }
+  }
+
+  if (what & WM_FETCH_HINTS) {
+    XWMHints *hints = XGetWMHints(dpy, w);
+    if (hints != NULL) {
+      memcpy(&result->hints, hints, sizeof(XWMHints));
+      XFree(hints);
+    }
+  }
+
+  if (what & WM_FETCH_ICON) {
+    unsigned long nitems;
+    unsigned char *data;
+
+    /* Format 32 properties come back as an array of longs. Only the
+     * image wm_icon_prepare picks goes back, premultiplied and scaled. */
+    data = wm_fetch_property(dpy, w, atoms->net_wm_icon, XA_CARDINAL, &nitems);
+    if (data != NULL) {
+      wm_icon_prepare((unsigned long *)data, nitems, &result->icon,
+                      &result->icon_len);
+      XFree(data);
+    }
+  }
+
+  if (what & WM_FETCH_TRANSIENT) {
+    Window transient_for;
+    if (XGetTransientForHint(dpy, w, &transient_for))
+      result->transient_for = transient_for;
+  }
+
+  if (what & WM_FETCH_SYNC) {
+    Atom *protocols;
+    int i, nprotocols;
+    Bool supported = False;
+    unsigned long nitems;
+    unsigned char *data;
+
+    /* The counter only counts if the client also lists the protocol */
+    if (XGetWMProtocols(dpy, w, &protocols, &nprotocols)) {
+      for (i = 0; i < nprotocols; i++)
+        if (protocols[i] == atoms->net_wm_sync_request)
+          supported = True;
+      XFree(protocols);
+    }
+    if (supported) {
+      data = wm_fetch_property(dpy, w, atoms->net_wm_sync_request_counter,
+                               XA_CARDINAL, &nitems);
+      if (data != NULL) {
+        if (nitems > 0)
+          result->sync_counter = ((unsigned long *)data)[0];
+        XFree(data);
+      }
+    }
+  }
+} /* static void wm_fetch */
+
+static void *wm_worker_run(void *data) {
+  struct wm_worker *worker = data;
+  fetch_request_t *request;
+
+  on_worker_thread = True;
+
+  for (;;) {
+    struct pollfd pfd;
+
+    while ((request = ring_pop(&worker->requests)) != NULL) {
+      wm_fetch_result_t *result = malloc(sizeof(wm_fetch_result_t));
+      wm_fetch(worker->dpy, &worker->atoms, request->window, request->what,
+               result);
+      free(request);
+
+      while (!ring_push(&worker->results, result)) {
+        /* Main thread is behind; let it catch up. */
+        wake(worker->wake_main[1]);
+        usleep(1000);
+      }
+      wake(worker->wake_main[1]);
+    }
+
+    if (!__atomic_load_n(&worker->running, __ATOMIC_ACQUIRE))
+      break;
+
+    pfd.fd = worker->wake_worker[0];
+    pfd.events = POLLIN;
+    poll(&pfd, 1, -1);
+    drain(worker->wake_worker[0]);
+  }
+  return NULL;
+} /* static void *wm_worker_run */
+
+static Bool wm_worker_pipe(int fds[2]) {
+  if (pipe(fds) < 0)
+    return False;
+  fcntl(fds[0], F_SETFL, O_NONBLOCK);
+  fcntl(fds[1], F_SETFL, O_NONBLOCK);
+  return True;
+}
+
+/* Start the fetch worker on its own connection to the same display. */
+Bool wm_worker_start(wm_t *wm) {
+  struct wm_worker *worker;
+
+  if (wm->worker != NULL || wm->dpy == NULL)
+    return False;
+
+  worker = calloc(1, sizeof(struct wm_worker));
+  worker->dpy = XOpenDisplay(DisplayString(wm->dpy));
+  if (worker->dpy == NULL) {
+    wm_log(wm, LOG_ERROR, "%s: failed opening worker display", __func__);
+    free(worker);
+    return False;
+  }
+  wm_fetch_atoms(worker->dpy, &worker->atoms);
+
+  if (!wm_worker_pipe(worker->wake_worker) || !wm_worker_pipe(worker->wake_main)) {
+    wm_log(wm, LOG_ERROR, "%s: pipe failed: %s", __func__, strerror(errno));
+    XCloseDisplay(worker->dpy);
+    free(worker);
+    return False;
+  }
+
+  /* Displays started on several threads (multi.c) all get here */
+  pthread_mutex_lock(&previous_error_handler_lock);
+  if (previous_error_handler == NULL)
+    previous_error_handler = XSetErrorHandler(wm_worker_x_error);
+  pthread_mutex_unlock(&previous_error_handler_lock);
+
+  worker->running = True;
+  if (pthread_create(&worker->thread, NULL, wm_worker_run, worker) != 0) {
+    wm_log(wm, LOG_ERROR, "%s: pthread_create failed", __func__);
+    XCloseDisplay(worker->dpy);
+    free(worker);
+    return False;
+  }
+
+  worker->deferred = g_hash_table_new(g_direct_hash, g_direct_equal);
+  wm->worker = worker;
+  wm_log(wm, LOG_INFO, "%s: property fetch worker started", __func__);
+  return True;
+} /* Bool wm_worker_start */
+
+/* Fetch what 'deferred' holds: through the worker again if it's running,
+ * else inline. */
+static void wm_worker_resubmit(wm_t *wm, GHashTable *deferred) {
+  GHashTableIter iter;
+  gpointer key;
+
+  g_hash_table_iter_init(&iter, deferred);
+  while (g_hash_table_iter_next(&iter, &key, NULL)) {
+    client_t *client = wm_get_client(wm, GPOINTER_TO_UINT(key), False);
+    unsigned int what;
+
+    if (client == NULL)
+      continue;
+    /* Bits with a fetch pending are refetched when it comes back */
+    what = client->fetch_dirty & ~client->fetch_pending;
+    client->fetch_dirty &= ~what;
+    if (what != 0)
+      wm_client_fetch(wm, client, what);
+  }
+} /* static void wm_worker_resubmit */
+
+void wm_worker_stop(wm_t *wm) {
+  struct wm_worker *worker = wm->worker;
+  void *item;
+
+  if (worker == NULL)
+    return;
+
+  __atomic_store_n(&worker->running, False, __ATOMIC_RELEASE);
+  wake(worker->wake_worker[1]);
+  pthread_join(worker->thread, NULL);
+
+  wm_worker_collect(wm);
+  while ((item = ring_pop(&worker->requests)) != NULL) {
+    wm_res_freed(wm, WM_RES_FETCH,
+                 GUINT_TO_POINTER(((fetch_request_t *)item)->window));
+    free(item);
+  }
+
+  XCloseDisplay(worker->dpy);
+  close(worker->wake_worker[0]);
+  close(worker->wake_worker[1]);
+  close(worker->wake_main[0]);
+  close(worker->wake_main[1]);
+  wm->worker = NULL;
+  wm_worker_resubmit(wm, worker->deferred);
+  g_hash_table_destroy(worker->deferred);
+  free(worker);
+} /* void wm_worker_stop */
+
+/* File descriptor the main loop should poll for results, or -1. */
+int wm_worker_fd(wm_t *wm) {
+  return (wm->worker != NULL) ? wm->worker->wake_main[0] : -1;
+} /* int wm_worker_fd */
+
+/* Apply any results the worker has finished, then queue the fetches that
+ * didn't fit before, now that the worker has taken some off. Called on the
+ * main thread. */
+void wm_worker_collect(wm_t *wm) {
+  struct wm_worker *worker = wm->worker;
+  wm_fetch_result_t *result;
+  GHashTable *deferred;
+
+  if (worker == NULL)
+    return;
+
+  drain(worker->wake_main[0]);
+  while ((result = ring_pop(&worker->results)) != NULL) {
+    wm_res_freed(wm, WM_RES_FETCH, GUINT_TO_POINTER(result->window));
+    wm_fetch_apply(wm, result);
+    free(result);
+  }
+
+  if (g_hash_table_size(worker->deferred) == 0
+      || !__atomic_load_n(&worker->running, __ATOMIC_ACQUIRE))
+    return;
+  /* Any that still don't fit go into a fresh table */
+  deferred = worker->deferred;
+  worker->deferred = g_hash_table_new(g_direct_hash, g_direct_equal);
+  wm_worker_resubmit(wm, deferred);
+  g_hash_table_destroy(deferred);
+} /* void wm_worker_collect */
+
+/* Ask for some of a client's properties to be (re)fetched. The client is
+ * updated, and listeners told, once the result is in. */
+void wm_client_fetch(wm_t *wm, client_t *client, unsigned int what) {
+  struct wm_worker *worker = wm->worker;
+  fetch_request_t *request;
+
+  /* During replay the results are in the log. */
+  if (wm->mock == NULL && wm->dpy == NULL)
+    return;
+
+  if (wm->mock != NULL || worker == NULL) {
+    wm_client_fetch_now(wm, client, what);
+    return;
+  }
+
+  /* Don't queue the same fetch twice. The pending one may already have read
+   * the old value, though, so it's fetched again once that one is in. */
+  client->fetch_dirty |= what & client->fetch_pending;
+  what &= ~client->fetch_pending;
+  if (what == 0)
+    return;
+
+  request = malloc(sizeof(fetch_request_t));
+  request->window = client->window;
+  request->what = what;
+  if (!ring_push(&worker->requests, request)) {
+    /* wm_worker_collect tries again once the worker has caught up */
+    wm_log(wm, LOG_INFO, "%s: fetch queue full, deferring window %ld",
+           __func__, client->window);
+    free(request);
+    client->fetch_dirty |= what;
+    g_hash_table_insert(worker->deferred, GUINT_TO_POINTER(client->window),
+                        GUINT_TO_POINTER(client->window));
+    wake(worker->wake_worker[1]);
+    return;
+  }
+  client->fetch_pending |= what;
+  wm_res_created(wm, WM_RES_FETCH, GUINT_TO_POINTER(client->window));
+  wake(worker->wake_worker[1]);
+} /* void wm_client_fetch */
+
+/* Fetch right away on the main connection, worker or not, for a caller
+ * that can't wait for the result. Costs a round trip per property. */
+void wm_client_fetch_now(wm_t *wm, client_t *client, unsigned int what) {
+  wm_fetch_result_t result;
+  fetch_atoms_t atoms;
+  wm_roundtrip_t mark;
+
+  if (wm->mock != NULL) {
+    wm_mock_fetch(wm, client->window, what, &result);
+    wm_fetch_apply(wm, &result);
+    return;
+  }
+
+  /* The original session applied this result right here */
+  if (wm->dpy == NULL) {
+    wm_eventlog_replay_fetch(wm);
+    return;
+  }
+
+  /* Not through wm_x_intern_atom: the result is what gets recorded, not
+   * the requests that produced it. */
+  wm_roundtrip_begin(wm, &mark);
+  wm_fetch_atoms(wm->dpy, &atoms);
+  wm_fetch(wm->dpy, &atoms, client->window, what, &result);
+  wm_roundtrip_end(wm, &mark, __func__);
+  wm_fetch_apply(wm, &result);
+} /* void wm_client_fetch_now */
+
+static void replace_string(char **dest, char *value) {
+  free(*dest);
+  *dest = value;
+}
+
+/* Copy a fetch result into the client table. Takes ownership of the
+ * strings and icon in 'result'; the icon is interned (icon.c) and freed. */
+void wm_fetch_apply(wm_t *wm, wm_fetch_result_t *result) {
+  client_t *client;
+  unsigned int refetch;
+
+  wm_eventlog_fetch_result(wm, result);
+
+  client = wm_get_client(wm, result->window, False);
+  if (client == NULL) {
+    /* Window went away while we were fetching */
+    free(result->name);
+    free(result->res_name);
+    free(result->res_class);
+    free(result->role);
+    free(result->net_wm_state);
+    free(result->icon);
+    return;
+  }
+
+  client->fetch_pending &= ~result->what;
+  client->fetched |= result->what;
+  refetch = client->fetch_dirty & result->what;
+  client->fetch_dirty &= ~refetch;
+  if (refetch != 0)
+    wm_client_fetch(wm, client, refetch);
+
+  if (result->what & WM_FETCH_CLASS) {
+    replace_string(&client->res_name, result->res_name);
+    replace_string(&client->res_class, result->res_class);
+    wm_index_update(wm, client);
+  }
+
+  if (result->what & WM_FETCH_ROLE)
+    replace_string(&client->role, result->role);
+
+  if (result->what & WM_FETCH_STATE) {
+    free(client->net_wm_state);
+    client->net_wm_state = result->net_wm_state;
+    client->net_wm_state_len = result->net_wm_state_len;
+  }
+
+  if (result->what & WM_FETCH_TRANSIENT) {
+    client->transient_for = result->transient_for;
+    wm_index_update(wm, client);
+  }
+
+  if (result->what & WM_FETCH_HINTS)
+    memcpy(&client->hints, &result->hints, sizeof(XWMHints));
+
+  if (result->what & WM_FETCH_ICON) {
+    wm_icon_unref(wm, client->icon);
+    client->icon = wm_icon_intern(wm, result->icon, result->icon_len);
+    free(result->icon);
+  }
+
+  if (result->what & WM_FETCH_SYNC)
+    wm_sync_set_counter(wm, client, result->sync_counter);
+
+  if (result->what & WM_FETCH_NAME) {
+    replace_string(&client->name, result->name);
+    wm_shm_mark_dirty(wm);
+    wm_listener_call(wm, WM_EVENT_WINDOW_NAME, client, NULL);
+  }
+
+  if (result->what & WM_FETCH_ICON)
+    wm_listener_call(wm, WM_EVENT_WINDOW_ICON, client, NULL);
+
+  wm_place_fetched(wm, client);
+} /* void wm_fetch_apply */
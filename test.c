@@ -8,6 +8,11 @@
 
 #define BORDER 0
 #define TITLE_HEIGHT 15
+#define TITLE_ICON_SIZE (TITLE_HEIGHT - 3)
+#define FRAME_POOL_PRELOAD 4
+/* Focus follows the pointer only once it stops in a container for this long,
+ * so sweeping across the screen doesn't focus everything on the way. */
+#define FOCUS_DELAY_MS 40
 
 static void *xmalloc(size_t size) {
   void *ptr;
@@ -21,104 +26,227 @@ static void *xmalloc(size_t size) {
 }
 
 container_t *current_container;
+GPtrArray *containers;
 XContext container_context;
 XContext client_container_context;
+XContext client_mru_context; /* window -> its link in container->clients */
+
+static frame_pool_t *frame_pools; /* indexed by screen number */
+static guint focus_timer;
+static container_t *focus_pending;
 
 int main(int argc, char **argv) {
   wm_t *wm = NULL;
   int i;
-  wm = wm_create(NULL);
+  wm = wm_new2(NULL);
   wm_set_log_level(wm, LOG_INFO);
+  /* Clients stacked under others in a container stop drawing */
+  wm_occlusion_set_mode(wm, WM_OCCLUSION_UNMAP);
+  wm_title_init(wm, "fixed", 256);
+  /* Remember which container each application was in */
+  wm_place_open(wm, NULL);
+  frame_pool_init(wm, FRAME_POOL_PRELOAD);
+  containers = g_ptr_array_new();
 
   container_context = XUniqueContext();
   client_container_context = XUniqueContext();
+  client_mru_context = XUniqueContext();
 
   wm_log(wm, LOG_INFO, "== num screens: %d", wm->num_screens);
   for (i = 0; i < wm->num_screens; i++) {
     XWindowAttributes attr;
     Window root = wm->screens[i]->root;;
     container_t *root_container;
-    XGetWindowAttributes(wm->dpy, root, &attr);
-    root_container = container_new(wm, root, attr.x, attr.y, attr.width, attr.height);
+    wm_x_get_window_attributes(wm, root, &attr);
+    root_container = container_new(wm, wm->screens[i], attr.x, attr.y,
+                                   attr.width, attr.height);
     container_show(root_container);
+    container_paint(root_container);
     wm_log(wm, LOG_INFO, "Setting current container to %tx", root_container);
     current_container = root_container;
 
     /* Grab keys */
     XGrabKey(wm->dpy, XKeysymToKeycode(wm->dpy, XK_j), Mod1Mask, root, False, GrabModeAsync, GrabModeAsync);
     XGrabKey(wm->dpy, XKeysymToKeycode(wm->dpy, XK_h), Mod1Mask, root, False, GrabModeAsync, GrabModeAsync);
+    XGrabKey(wm->dpy, XKeysymToKeycode(wm->dpy, XK_x), Mod1Mask, root, False, GrabModeAsync, GrabModeAsync);
+    XGrabKey(wm->dpy, XKeysymToKeycode(wm->dpy, XK_n), Mod1Mask, root, False, GrabModeAsync, GrabModeAsync);
+    XGrabKey(wm->dpy, XKeysymToKeycode(wm->dpy, XK_p), Mod1Mask, root, False, GrabModeAsync, GrabModeAsync);
+    XGrabKey(wm->dpy, XKeysymToKeycode(wm->dpy, XK_Tab), Mod1Mask, root, False, GrabModeAsync, GrabModeAsync);
   }
 
   container_focus(current_container);
-  wm_listener_add(wm, WM_EVENT_MAPREQUEST, addwin);
-  wm_listener_add(wm, WM_EVENT_MAPNOTIFY, addwin);
-  wm_listener_add(wm, WM_EVENT_UNMAPNOTIFY, unmap);
-  wm_listener_add(wm, WM_EVENT_ENTERNOTIFY, focus_container);
-  wm_listener_add(wm, WM_EVENT_EXPOSE, expose_container);
-  wm_listener_add(wm, WM_EVENT_KEYDOWN, keydown);
-  wm_listener_add(wm, WM_EVENT_KEYUP, keyup);
+  wm_listener_add(wm, WM_EVENT_WINDOW_MAP_REQUEST, addwin, NULL);
+  wm_listener_add(wm, WM_EVENT_WINDOW_MAP, addwin, NULL);
+  wm_listener_add(wm, WM_EVENT_WINDOW_UNMAP, unmap, NULL);
+  wm_listener_add(wm, WM_EVENT_WINDOW_ENTER, focus_container, NULL);
+  wm_listener_add(wm, WM_EVENT_WINDOW_NAME, title_change, NULL);
+  wm_listener_add(wm, WM_EVENT_WINDOW_ICON, title_change, NULL);
+  wm_listener_add(wm, WM_EVENT_EXPOSE, expose_container, NULL);
+  wm_listener_add(wm, WM_EVENT_KEY_DOWN, keydown, NULL);
 
   /* Start main loop. At this point, our code will only execute when events
    * happen */
-  XSync(wm->dpy, False);
+  wm_x_sync(wm);
   wm_main(wm);
 
   return 0;
 }
 
-container_t *container_new(wm_t *wm, Window parent, int x, int y,
+container_t *container_new(wm_t *wm, Screen *screen, int x, int y,
                            int width, int height) {
-  XWindowAttributes attr;
   container_t *container;
   container = xmalloc(sizeof(container_t));
-  container->context = XUniqueContext();
-  container->frame = mkframe(wm, parent, x, y, width, height);
-  //container->title = mktitle(wm, parent, x, y, width, height);
+  wm_res_created(wm, WM_RES_HEAP, container);
   container->wm = wm;
+  container->screen = screen;
   container->focused = False;
+  g_queue_init(&container->clients);
+  container->frame = frame_get(wm, screen, x, y, width, height, &container->gc);
+  //container->title = mktitle(wm, parent, x, y, width, height);
 
-  XGetWindowAttributes(wm->dpy, parent, &attr);
-  container->screen = attr.screen;
-
-  container_create_gc(container);
   XSaveContext(wm->dpy, container->frame, container_context, (XPointer)container);
+  g_ptr_array_add(containers, container);
   return container;
 }
 
-Bool container_create_gc(container_t *container) {
-  unsigned long valuemask;
-  XGCValues gcv;
-  XColor bg_color, fg_color;
+/* container->clients is kept most recently shown first. Each client's link
+ * is saved under client_mru_context, so moving a client to the front or
+ * taking it out doesn't search the list. */
+static void container_mru_touch(container_t *container, Window window) {
+  GList *link = NULL;
+
+  if (XFindContext(container->wm->dpy, window, client_mru_context,
+                   (XPointer*)&link) == XCNOENT) {
+    g_queue_push_head(&container->clients, GUINT_TO_POINTER(window));
+    XSaveContext(container->wm->dpy, window, client_mru_context,
+                 (XPointer)container->clients.head);
+    return;
+  }
+  g_queue_unlink(&container->clients, link);
+  g_queue_push_head_link(&container->clients, link);
+}
 
-  XParseColor(container->wm->dpy, container->screen->cmap, "#000000", &bg_color);
-  XAllocColor(container->wm->dpy, container->screen->cmap, &bg_color);
+static void container_mru_remove(container_t *container, Window window) {
+  GList *link = NULL;
 
-  XParseColor(container->wm->dpy, container->screen->cmap, "#FFFFFF", &fg_color);
-  XAllocColor(container->wm->dpy, container->screen->cmap, &fg_color);
-  gcv.line_style = LineSolid;
-  gcv.line_width = 1;
-  gcv.fill_style = FillSolid;
-  gcv.background = bg_color.pixel;
-  //gcv.foreground = fg_color.pixel;
-  gcv.foreground = bg_color.pixel;
-  valuemask = (GCLineStyle | GCLineWidth | GCFillStyle \
-               | GCForeground | GCBackground);
-  container->gc = XCreateGC(container->wm->dpy, container->frame, valuemask, &gcv);
+  if (XFindContext(container->wm->dpy, window, client_mru_context,
+                   (XPointer*)&link) == XCNOENT)
+    return;
+  g_queue_delete_link(&container->clients, link);
+  XDeleteContext(container->wm->dpy, window, client_mru_context);
+  if (container->current == window)
+    container->current = None;
+}
+
+/* The client at 'link' in container->clients. Windows the library has
+ * forgotten (destroyed without an unmap we saw) are dropped on the way. */
+static client_t *container_mru_client(container_t *container, GList *link) {
+  client_t *client;
+  Window window;
+
+  if (link == NULL)
+    return NULL;
+  window = GPOINTER_TO_UINT(link->data);
+  client = wm_get_client(container->wm, window, False);
+  if (client == NULL)
+    container_mru_remove(container, window);
+  return client;
+}
+
+/* Take a client out of the container it's in, without touching the window */
+static void container_client_forget(container_t *container, client_t *client) {
+  XDeleteContext(container->wm->dpy, client->window, client_container_context);
+  if (container != NULL)
+    container_mru_remove(container, client->window);
+}
+
+/* Close a container, moving its clients into 'into' and giving it the
+ * space. The frame goes back to the pool. */
+Bool container_close(container_t *container, container_t *into) {
+  wm_t *wm = container->wm;
+  XWindowAttributes attr, into_attr;
+  wm_query_t query;
+  client_t *client;
+  GPtrArray *clients;
+  int x, y, x2, y2;
+  unsigned int i;
+
+  if (into == NULL || into == container)
+    return False;
+
+  if (focus_pending == container) {
+    wm_timer_cancel(wm, focus_timer);
+    focus_timer = 0;
+    focus_pending = NULL;
+  }
+
+  /* Round trips first, so the grab only covers the requests */
+  wm_x_get_window_attributes(wm, container->frame, &attr);
+  wm_x_get_window_attributes(wm, into->frame, &into_attr);
+  x = MIN(attr.x, into_attr.x);
+  y = MIN(attr.y, into_attr.y);
+  x2 = MAX(attr.x + attr.width, into_attr.x + into_attr.width);
+  y2 = MAX(attr.y + attr.height, into_attr.y + into_attr.height);
+  into_attr.x = x;
+  into_attr.y = y;
+  into_attr.width = x2 - x;
+  into_attr.height = y2 - y;
+
+  wm_txn_begin(wm, WM_TXN_GRAB);
+  container_moveresize(into, x, y, x2 - x, y2 - y);
+
+  /* Reparent the clients out before the frame is unmapped. Moving them
+   * changes the index we're reading, so collect them first. */
+  clients = g_ptr_array_new();
+  wm_query_container(wm, &query, container->frame);
+  while ((client = wm_query_next(&query)) != NULL)
+    g_ptr_array_add(clients, client);
+  for (i = 0; i < clients->len; i++) {
+    client = g_ptr_array_index(clients, i);
+    container_client_forget(container, client);
+    container_client_add(into, client, &into_attr);
+  }
+  g_ptr_array_free(clients, TRUE);
+
+  for (i = 0; i < containers->len; i++) {
+    container_t *other = g_ptr_array_index(containers, i);
+    if (other->split_from == container)
+      other->split_from = into;
+  }
+  g_ptr_array_remove(containers, container);
+  if (current_container == container)
+    current_container = into;
+
+  /* Any left are clients the library already forgot */
+  while (!g_queue_is_empty(&container->clients))
+    container_mru_remove(container,
+                         GPOINTER_TO_UINT(g_queue_peek_head(&container->clients)));
+  XDeleteContext(wm->dpy, container->frame, container_context);
+  wm_idle_remove(wm, container_paint_titles_idle, container);
+  frame_put(wm, container->screen, container->frame, container->gc);
+  wm_res_freed(wm, WM_RES_HEAP, container);
+  free(container);
+  wm_txn_commit(wm);
+
+  container_paint(into);
   return True;
 }
 
+/* Map the frame. In a transaction that's only recorded, so the caller
+ * paints it (container_paint) after the commit. */
 Bool container_show(container_t *container) {
-  XEvent ev;
-  XMapWindow(container->wm->dpy, container->frame);
-  XCheckTypedWindowEvent(container->wm->dpy, container->frame, MapNotify, &ev);
-  container_paint(container);
-  wm_log(container->wm, LOG_INFO, "%s: finished waiting for map event", __func__);
-  XFlush(container->wm->dpy);
+  wm_x_map_window(container->wm, container->frame);
   return True;
 }
 
-Bool container_client_add(container_t *container, client_t *client) {
+/* Put 'client' in 'container'. 'frame_attr' is where the frame is, or will
+ * be once the transaction commits; NULL reads it from the server, which
+ * callers in a transaction should do before wm_txn_begin. */
+Bool container_client_add(container_t *container, client_t *client,
+                          const XWindowAttributes *frame_attr) {
   XWindowAttributes attr;
+  XWindowChanges changes;
+  wm_place_t place;
   int ret;
   container_t *tmp = NULL;
 
@@ -139,14 +267,31 @@ Bool container_client_add(container_t *container, client_t *client) {
 
   wm_log(container->wm, LOG_INFO, "%s: client add window %d", __func__, client->window);
   XAddToSaveSet(container->wm->dpy, client->window);
-  XGetWindowAttributes(container->wm->dpy, container->frame, &attr);
-  XSetWindowBorderWidth(container->wm->dpy, client->window, 0);
-  XSelectInput(container->wm->dpy, client->window, CLIENT_EVENT_MASK);
-  XReparentWindow(container->wm->dpy, client->window, container->frame, 0, TITLE_HEIGHT);
-  XResizeWindow(container->wm->dpy, client->window, attr.width, attr.height - TITLE_HEIGHT);
+  if (frame_attr != NULL)
+    attr = *frame_attr;
+  else
+    wm_x_get_window_attributes(container->wm, container->frame, &attr);
+  changes.border_width = 0;
+  wm_x_configure_window(container->wm, client->window, CWBorderWidth,
+                        &changes);
+  wm_x_select_input(container->wm, client->window, CLIENT_EVENT_MASK);
+  /* The unmap and map this causes are ours; they don't reach unmap() */
+  wm_client_reparent(container->wm, client, container->frame, 0, TITLE_HEIGHT);
+  wm_client_set_tiled(container->wm, client, True);
+  wm_client_moveresize(container->wm, client, 0, TITLE_HEIGHT,
+                       attr.width, attr.height - TITLE_HEIGHT);
   XSaveContext(container->wm->dpy, client->window, client_container_context, (XPointer)container);
+  /* ReparentNotify will say the same thing, but we want the tab now */
+  client->container = container->frame;
+  wm_index_update(container->wm, client);
+
+  place.screen = container->screen;
+  place.x = attr.x;
+  place.y = attr.y;
+  place.width = attr.width;
+  place.height = attr.height;
+  wm_place_record(container->wm, client, &place);
 
-  //container_paint(container);
   container_client_show(container, client);
   return True;
 }
@@ -156,27 +301,104 @@ Bool container_paint(container_t *container) {
 
   //wm_log(container->wm, LOG_INFO, "%s: Painting container window %d", __func__, container->frame);
 
-  XGetWindowAttributes(container->wm->dpy, container->frame, &frame_attr);
+  wm_x_get_window_attributes(container->wm, container->frame, &frame_attr);
   XFillRectangle(container->wm->dpy, container->frame, container->gc,
                  0, 0, frame_attr.width, frame_attr.height);
+  container_paint_titles(container);
   XFlush(container->wm->dpy);
   return True;
 }
 
+static int compare_client_windows(const void *a, const void *b) {
+  const client_t *ca = *(client_t **)a, *cb = *(client_t **)b;
+  return (ca->window > cb->window) - (ca->window < cb->window);
+}
+
+/* Draw one title tab per client across the top of the frame, each with its
+ * client's icon. Titles come from the library's title cache, so this is only
+ * copies unless a title, an icon or the tab width changed. */
+Bool container_paint_titles(container_t *container) {
+  wm_t *wm = container->wm;
+  XWindowAttributes frame_attr;
+  wm_query_t query;
+  client_t *client;
+  client_t **clients;
+  unsigned int nclients = 0;
+  unsigned int i, tab_width;
+
+  wm_query_container(wm, &query, container->frame);
+  clients = xmalloc((query.count + 1) * sizeof(client_t *));
+  while ((client = wm_query_next(&query)) != NULL)
+    clients[nclients++] = client;
+
+  if (nclients > 0) {
+    qsort(clients, nclients, sizeof(client_t *), compare_client_windows);
+    wm_x_get_window_attributes(wm, container->frame, &frame_attr);
+    tab_width = frame_attr.width / nclients;
+    for (i = 0; i < nclients; i++) {
+      wm_title_draw_icon(wm, container->frame, container->screen,
+                         i * tab_width, 0, tab_width, TITLE_HEIGHT,
+                         clients[i]->name,
+                         clients[i]->window == container->current,
+                         wm_icon_get(wm, clients[i], TITLE_ICON_SIZE));
+    }
+  }
+  free(clients);
+  return True;
+}
+
+void container_paint_titles_idle(wm_t *wm, gpointer data) {
+  container_paint_titles(data);
+}
+
 Bool container_client_show(container_t *container, client_t *client) {
-  XMapRaised(container->wm->dpy, client->window);
-  XSetInputFocus(container->wm->dpy, client->window, RevertToParent, CurrentTime);
+  container->current = client->window;
+  container_mru_touch(container, client->window);
+  wm_x_map_window(container->wm, client->window);
+  wm_stack_raise(container->wm, client->window);
+  wm_x_set_input_focus(container->wm, client->window, RevertToParent);
   XFlush(container->wm->dpy);
   return True;
 }
 
-Bool addwin(wm_t *wm, wm_event_t *event) {
-  container_client_add(current_container, event->client);
-  XMapWindow(wm->dpy, event->client->window);
+/* The container over the middle of 'place'. Frames are in the client
+ * table, so this doesn't ask the server where they are. */
+static container_t *container_at(wm_t *wm, wm_place_t *place) {
+  int x = place->x + place->width / 2;
+  int y = place->y + place->height / 2;
+  guint i;
+
+  for (i = 0; i < containers->len; i++) {
+    container_t *container = g_ptr_array_index(containers, i);
+    client_t *frame = wm_get_client(wm, container->frame, False);
+
+    if (frame == NULL || container->screen != place->screen)
+      continue;
+    if (x >= frame->attr.x && x < frame->attr.x + frame->attr.width
+        && y >= frame->attr.y && y < frame->attr.y + frame->attr.height)
+      return container;
+  }
+  return NULL;
+}
+
+Bool addwin(wm_t *wm, wm_event_t *event, gpointer data) {
+  container_t *container = NULL;
+  wm_place_t place;
+
+  /* Back where this application was last time, so it isn't moved after.
+   * Only on MapRequest: MapNotify is for windows already placed, or that
+   * nobody places, like frames and popups. */
+  if (event->event_id == WM_EVENT_WINDOW_MAP_REQUEST
+      && wm_place_lookup(wm, event->client, &place))
+    container = container_at(wm, &place);
+  if (container == NULL)
+    container = current_container;
+  container_client_add(container, event->client, NULL);
+  wm_x_map_window(wm, event->client->window);
   return True;
 }
 
-Bool focus_container(wm_t *wm, wm_event_t *event) {
+Bool focus_container(wm_t *wm, wm_event_t *event, gpointer data) {
   container_t *container;
   int ret;
 
@@ -194,6 +416,19 @@ Bool focus_container(wm_t *wm, wm_event_t *event) {
     }
   }
 
+  /* Keyed to the window entered, so it goes away if that window does */
+  wm_timer_cancel(wm, focus_timer);
+  focus_pending = container;
+  focus_timer = wm_timer_add(wm, FOCUS_DELAY_MS, event->client,
+                             focus_container_timer, container);
+  return True;
+}
+
+void focus_container_timer(wm_t *wm, client_t *client, gpointer data) {
+  container_t *container = data;
+
+  focus_timer = 0;
+  focus_pending = NULL;
   if (current_container == container) {
     //wm_log(wm, LOG_INFO, "%s: ignoring attempt to focus and blur the same container at the same time.", __func__);
     //return True;
@@ -201,11 +436,9 @@ Bool focus_container(wm_t *wm, wm_event_t *event) {
   container_blur(current_container);
   current_container = container;
   container_focus(container);
-
-  return True;
 }
 
-Bool expose_container(wm_t *wm, wm_event_t *event) {
+Bool expose_container(wm_t *wm, wm_event_t *event, gpointer data) {
   container_t *container;
   int ret;
 
@@ -223,7 +456,7 @@ Bool expose_container(wm_t *wm, wm_event_t *event) {
   return True;
 }
 
-Bool keydown(wm_t *wm, wm_event_t *event) {
+Bool keydown(wm_t *wm, wm_event_t *event, gpointer data) {
   XKeyEvent kev = event->xevent->xkey;
   KeySym sym;
 
@@ -238,6 +471,19 @@ Bool keydown(wm_t *wm, wm_event_t *event) {
       case XK_h:
         container_split(current_container, SPLIT_HORIZONTAL);
         break;
+      case XK_x:
+        if (container_close(current_container, current_container->split_from))
+          container_focus(current_container);
+        break;
+      case XK_n:
+        container_cycle_next(current_container);
+        break;
+      case XK_p:
+        container_cycle_prev(current_container);
+        break;
+      case XK_Tab:
+        container_cycle_last(current_container);
+        break;
       default:
         wm_log(wm, LOG_WARN, "%s: unexpected keysym %d", __func__, sym);
     }
@@ -247,21 +493,30 @@ Bool keydown(wm_t *wm, wm_event_t *event) {
       run("xterm -bg black -fg white");
       break;
   }
-  XUngrabServer(wm->dpy);
   return True;
 }
 
-Bool keyup(wm_t *wm, wm_event_t *event) {
-  XUngrabServer(wm->dpy);
+Bool title_change(wm_t *wm, wm_event_t *event, gpointer data) {
+  container_t *container = NULL;
+  int ret;
+
+  ret = XFindContext(wm->dpy, event->client->window, client_container_context,
+                     (XPointer*)&container);
+  if (ret == XCNOENT)
+    return False;
+  /* Titles change constantly (shells, browsers); repaint when idle, and
+   * the ones nobody is looking at last. */
+  wm_idle_add(wm, container->focused ? WM_IDLE_DEFAULT : WM_IDLE_LOW,
+              container_paint_titles_idle, container);
   return True;
 }
 
-Bool unmap(wm_t *wm, wm_event_t *event) {
+Bool unmap(wm_t *wm, wm_event_t *event, gpointer data) {
   client_t *client = event->client;
   container_t *container = NULL;
   wm_log(wm, LOG_INFO, "%s; unmap on %d", __func__, client->window);
   XFindContext(wm->dpy, client->window, client_container_context, (XPointer *)&container);
-  XDeleteContext(wm->dpy, client->window, client_container_context);
+  container_client_forget(container, client);
   if (container != NULL) {
     wm_log(wm, LOG_INFO, "%s; unmap window", __func__);
   }
@@ -272,62 +527,148 @@ Bool unmap(wm_t *wm, wm_event_t *event) {
   return True;
 }
 
-Window mkframe(wm_t *wm, Window parent, int x, int y, int width, int height) {
+/* Allocate the pool colors and pre-create 'preload' frames per screen. */
+void frame_pool_init(wm_t *wm, unsigned int preload) {
+  XColor color;
+  unsigned int j;
+  int i;
+
+  frame_pools = xmalloc(wm->num_screens * sizeof(frame_pool_t));
+  for (i = 0; i < wm->num_screens; i++) {
+    frame_pool_t *pool = &frame_pools[i];
+    pool->screen = wm->screens[i];
+    g_queue_init(&pool->free);
+
+    XParseColor(wm->dpy, pool->screen->cmap, "#999933", &color);
+    XAllocColor(wm->dpy, pool->screen->cmap, &color);
+    wm_res_created(wm, WM_RES_COLOR, GUINT_TO_POINTER(color.pixel));
+    pool->border_pixel = color.pixel;
+    XParseColor(wm->dpy, pool->screen->cmap, "#000000", &color);
+    XAllocColor(wm->dpy, pool->screen->cmap, &color);
+    wm_res_created(wm, WM_RES_COLOR, GUINT_TO_POINTER(color.pixel));
+    pool->bg_pixel = color.pixel;
+
+    for (j = 0; j < preload; j++) {
+      frame_t *frame = xmalloc(sizeof(frame_t));
+      wm_res_created(wm, WM_RES_HEAP, frame);
+      frame->window = mkframe(wm, pool);
+      frame->gc = mkframe_gc(wm, pool, frame->window);
+      g_queue_push_tail(&pool->free, frame);
+    }
+  }
+}
+
+/* Take an unmapped frame from the screen's pool, creating one if the pool
+ * is empty, and place it. The caller maps it. */
+Window frame_get(wm_t *wm, Screen *screen, int x, int y,
+                 unsigned int width, unsigned int height, GC *gc) {
+  frame_pool_t *pool = &frame_pools[XScreenNumberOfScreen(screen)];
+  frame_t *frame;
+  Window window;
+
+  frame = g_queue_pop_head(&pool->free);
+  if (frame == NULL) {
+    window = mkframe(wm, pool);
+    *gc = mkframe_gc(wm, pool, window);
+  } else {
+    window = frame->window;
+    *gc = frame->gc;
+    wm_res_freed(wm, WM_RES_HEAP, frame);
+    free(frame);
+  }
+
+  wm_x_move_resize_window(wm, window, x, y, width, height);
+  return window;
+}
+
+/* Give a frame back to its screen's pool. It must have no clients left. */
+void frame_put(wm_t *wm, Screen *screen, Window window, GC gc) {
+  frame_pool_t *pool = &frame_pools[XScreenNumberOfScreen(screen)];
+  frame_t *frame = xmalloc(sizeof(frame_t));
+  client_t *client;
+
+  wm_res_created(wm, WM_RES_HEAP, frame);
+  /* Keep the frame in the client table while it waits in the pool, rather
+   * than having it dropped on unmap and looked up again when reused */
+  client = wm_get_client(wm, window, False);
+  if (client != NULL)
+    wm_client_unmap(wm, client);
+  else
+    wm_x_unmap_window(wm, window);
+  frame->window = window;
+  frame->gc = gc;
+  g_queue_push_head(&pool->free, frame);
+}
+
+Window mkframe(wm_t *wm, frame_pool_t *pool) {
   Window frame;
   XSetWindowAttributes frame_attr;
-  XWindowAttributes parent_attr;
   unsigned long valuemask;
-  XColor border_color;
-  Visual *visual;
-
-  XGetWindowAttributes(wm->dpy, parent, &parent_attr);
-  visual = parent_attr.screen->root_visual;
 
-  XParseColor(wm->dpy, parent_attr.screen->cmap, "#999933", &border_color);
-  XAllocColor(wm->dpy, parent_attr.screen->cmap, &border_color);
-  frame_attr.border_pixel = border_color.pixel;
+  frame_attr.border_pixel = pool->border_pixel;
   frame_attr.event_mask = (ButtonPressMask | ButtonReleaseMask \
                            | EnterWindowMask | LeaveWindowMask);
 
   valuemask = CWEventMask | CWBorderPixel;
 
-  frame = XCreateWindow(wm->dpy, parent,
-                        x, y, width, height,
+  /* frame_get places it */
+  frame = XCreateWindow(wm->dpy, RootWindowOfScreen(pool->screen),
+                        0, 0, 1, 1,
                         BORDER, CopyFromParent, CopyFromParent,
-                        visual, valuemask, &frame_attr);
-  wm_log(wm, LOG_INFO, "%s; Created window %d", __func__, frame);
+                        pool->screen->root_visual, valuemask, &frame_attr);
+  wm_res_created(wm, WM_RES_WINDOW, GUINT_TO_POINTER(frame));
+  pool->created++;
+  wm_log(wm, LOG_INFO, "%s; Created window %d (%u on screen)", __func__, frame,
+         pool->created);
 
   XSelectInput(wm->dpy, frame, FRAME_EVENT_MASK);
   return frame;
 }
 
+GC mkframe_gc(wm_t *wm, frame_pool_t *pool, Window frame) {
+  unsigned long valuemask;
+  XGCValues gcv;
+  GC gc;
+
+  gcv.line_style = LineSolid;
+  gcv.line_width = 1;
+  gcv.fill_style = FillSolid;
+  gcv.background = pool->bg_pixel;
+  gcv.foreground = pool->bg_pixel;
+  valuemask = (GCLineStyle | GCLineWidth | GCFillStyle \
+               | GCForeground | GCBackground);
+  gc = XCreateGC(wm->dpy, frame, valuemask, &gcv);
+  wm_res_created(wm, WM_RES_GC, gc);
+  return gc;
+}
+
 Window mktitle(wm_t *wm, Window parent, int x, int y, int width, int height) {
   Window title;
   XSetWindowAttributes title_attr;
   XWindowAttributes parent_attr;
   unsigned long valuemask;
-  XColor border_color;
   Visual *visual;
 
-  XGetWindowAttributes(wm->dpy, parent, &parent_attr);
+  wm_x_get_window_attributes(wm, parent, &parent_attr);
   visual = parent_attr.screen->root_visual;
 
-  XParseColor(wm->dpy, parent_attr.screen->cmap, "#999933", &border_color);
-  XAllocColor(wm->dpy, parent_attr.screen->cmap, &border_color);
-  frame_attr.border_pixel = border_color.pixel;
-  frame_attr.event_mask = (ButtonPressMask | ButtonReleaseMask \
+  /* Same color as the frames; don't allocate another cell per title */
+  title_attr.border_pixel =
+    frame_pools[XScreenNumberOfScreen(parent_attr.screen)].border_pixel;
+  title_attr.event_mask = (ButtonPressMask | ButtonReleaseMask \
                            | EnterWindowMask | LeaveWindowMask);
 
   valuemask = CWEventMask | CWBorderPixel;
 
-  frame = XCreateWindow(wm->dpy, parent,
+  title = XCreateWindow(wm->dpy, parent,
                         x, y, width, height,
                         BORDER, CopyFromParent, CopyFromParent,
-                        visual, valuemask, &frame_attr);
-  wm_log(wm, LOG_INFO, "%s; Created window %d", __func__, frame);
+                        visual, valuemask, &title_attr);
+  wm_res_created(wm, WM_RES_WINDOW, GUINT_TO_POINTER(title));
+  wm_log(wm, LOG_INFO, "%s; Created window %d", __func__, title);
 
-  XSelectInput(wm->dpy, frame, FRAME_EVENT_MASK);
-  return frame;
+  XSelectInput(wm->dpy, title, FRAME_EVENT_MASK);
+  return title;
 }
 
 
@@ -337,42 +678,30 @@ Bool container_blur(container_t *container) {
 }
 
 Bool container_focus(container_t *container) {
-  Window dummy;
-  Window *children;
-  unsigned int nchildren;
-  //int ret;
+  client_t *client;
 
   container->focused = True;
 
-  XQueryTree(container->wm->dpy, container->frame, &dummy, &dummy, &children, &nchildren);
-  wm_log(container->wm, LOG_INFO, "%s: num children of container: %ud", __func__, nchildren);
-  XSetInputFocus(container->wm->dpy, container->frame, RevertToParent, CurrentTime);
-  if (nchildren > 0) {
-    client_t *client = NULL;
-    int i = 1;
-    for (i = nchildren - 1; i >= 0; i--) {
-      client = wm_get_client(container->wm, children[i], False);
-      wm_log(container->wm, LOG_INFO, "%s: child[%d] = %d", __func__, i, client->window);
-      if (client != NULL && client->flags & CLIENT_VISIBLE)
-        break;
-    }
-    if (client != NULL) {
-      XMapRaised(container->wm->dpy, client->window);
-      XSetInputFocus(container->wm->dpy, client->window, RevertToParent, CurrentTime);
-    }
+  wm_x_set_input_focus(container->wm, container->frame, RevertToParent);
+  client = container_mru_client(container, container->clients.head);
+  if (client != NULL) {
+    wm_log(container->wm, LOG_INFO, "%s: top client is %d", __func__, client->window);
+    /* Already on top if nothing else raised anything; then this is free */
+    wm_stack_raise(container->wm, client->window);
+    wm_x_set_input_focus(container->wm, client->window, RevertToParent);
   }
   return True;
 }
 
 Bool container_split(container_t *container, unsigned int split_type) {
-  XWindowAttributes attr;
+  XWindowAttributes attr, new_attr;
   int new_x, new_y;
   unsigned int width, height;
   container_t *new_container;
 
   wm_log(container->wm, LOG_INFO, "%s: horizontal split", __func__);
 
-  XGetWindowAttributes(container->wm->dpy, container->frame, &attr);
+  wm_x_get_window_attributes(container->wm, container->frame, &attr);
   if (split_type == SPLIT_VERTICAL) {
     width = attr.width / 2;
     height = attr.height;
@@ -384,55 +713,97 @@ Bool container_split(container_t *container, unsigned int split_type) {
     new_x = attr.x;
     new_y = attr.y + height;
   }
-
+  new_attr = attr;
+  new_attr.x = new_x;
+  new_attr.y = new_y;
+  new_attr.width = width;
+  new_attr.height = height;
+
+  /* Nothing shows until it's all done: the new frame doesn't appear at its
+   * old size, and the moved client is resized once, in its new container */
+  wm_txn_begin(container->wm, WM_TXN_GRAB);
   container_moveresize(container, attr.x, attr.y, width, height);
-  new_container = container_new(container->wm, attr.root,
+  new_container = container_new(container->wm, container->screen,
                                 new_x, new_y, width, height);
+  new_container->split_from = container;
   container_show(new_container);
-  XFlush(container->wm->dpy);
+  container_relocate_top_client(container, new_container, &new_attr);
+  wm_txn_commit(container->wm);
 
-  container_relocate_top_client(container, new_container);
   container_paint(container);
   container_paint(new_container);
   return True;
 }
 
-Bool container_relocate_top_client(container_t *src, container_t *dest) {
-  Window *children = NULL;
-  Window dummy;
-  unsigned int nchildren;
+Bool container_relocate_top_client(container_t *src, container_t *dest,
+                                   const XWindowAttributes *dest_attr) {
+  client_t *client;
 
   /* Move the top window on container to new_container */
-  XQueryTree(src->wm->dpy, src->frame, &dummy, &dummy, &children, &nchildren);
-  if (nchildren == 0)
+  client = container_mru_client(src, src->clients.head);
+  if (client == NULL)
     return True;
 
-  client_t *client = NULL;
-  client = wm_get_client(src->wm, children[nchildren - 1], False);
-  if (client == NULL) {
-    wm_log(src->wm, LOG_ERROR, "%s: XFindContext for top child window of container %d failed?", __func__, src->frame);
-    return False;
+  container_client_forget(src, client);
+  container_client_add(dest, client, dest_attr);
+  return True;
+}
+
+/* Show the client shown least recently. Repeating this goes through every
+ * client in the container, like a stack of cards moved top to bottom. */
+Bool container_cycle_next(container_t *container) {
+  client_t *client;
+
+  while (container->clients.length > 1) {
+    client = container_mru_client(container, container->clients.tail);
+    if (client != NULL)
+      return container_client_show(container, client);
   }
+  return False;
+}
 
-  container_client_add(dest, client);
-  XFree(children);
-  return True;
+/* Undo a container_cycle_next: the current client goes to the back and the
+ * one shown before it comes back. */
+Bool container_cycle_prev(container_t *container) {
+  client_t *client;
+  GList *link;
+
+  while (container->clients.length > 1) {
+    link = container->clients.head;
+    g_queue_unlink(&container->clients, link);
+    g_queue_push_tail_link(&container->clients, link);
+    client = container_mru_client(container, container->clients.head);
+    if (client != NULL)
+      return container_client_show(container, client);
+  }
+  return False;
 }
 
-Bool container_moveresize(container_t *container, int x, int y, unsigned int width, unsigned int height) {
-  Window *children = NULL;
-  Window dummy;
-  unsigned int nchildren;
-  unsigned int i;
-  XMoveResizeWindow(container->wm->dpy, container->frame, x, y, width, height);
+/* Flip between the current client and the one shown before it. */
+Bool container_cycle_last(container_t *container) {
+  client_t *client;
 
-  XQueryTree(container->wm->dpy, container->frame, &dummy, &dummy, &children, &nchildren);
+  while (container->clients.length > 1) {
+    client = container_mru_client(container, container->clients.head->next);
+    if (client != NULL)
+      return container_client_show(container, client);
+  }
+  return False;
+}
+
+/* The frame's children are all clients, so they're found through the
+ * container index: no XQueryTree round trip while a transaction has the
+ * server grabbed. */
+Bool container_moveresize(container_t *container, int x, int y, unsigned int width, unsigned int height) {
+  wm_query_t query;
+  client_t *client;
 
-  for (i = 0; i < nchildren; i++)
-    XResizeWindow(container->wm->dpy, children[i], width, height);
+  wm_x_move_resize_window(container->wm, container->frame, x, y, width, height);
 
-  if (children != NULL)
-    XFree(children);
+  wm_query_container(container->wm, &query, container->frame);
+  while ((client = wm_query_next(&query)) != NULL)
+    wm_client_moveresize(container->wm, client, 0, TITLE_HEIGHT,
+                         width, height - TITLE_HEIGHT);
   return True;
 }
 
@@ -5,7 +5,7 @@
 #include <X11/Xresource.h> 
 #include <X11/Xutil.h>
 
-#include "wmlib/wmlib.h"
+#include "lib/windowmanager/windowmanager.h"
 
 #define SPLIT_VERTICAL 0U
 #define SPLIT_HORIZONTAL 1U
@@ -22,40 +22,71 @@
   | ColormapChangeMask | FocusChangeMask | StructureNotifyMask \
   )
 
+/* Unmapped frames (and their GCs) kept around for reuse, one pool per
+ * screen, so splitting and closing containers doesn't create and destroy
+ * server resources each time. */
+typedef struct frame {
+  Window window;
+  GC gc;
+} frame_t;
+
+typedef struct frame_pool {
+  Screen *screen;
+  unsigned long border_pixel;
+  unsigned long bg_pixel;
+  GQueue free; /* frame_t */
+  unsigned int created;
+} frame_pool_t;
+
 typedef  struct container {
-  XContext context;
   Screen *screen;
   GC gc;
   Window frame;
   wm_t *wm;
-  client_t *clients;
-  int num_clients;
+  GQueue clients; /* Window, most recently shown first */
   int focused;
+  Window current; /* client last shown in this container */
+  struct container *split_from; /* container this one was split off of */
 } container_t;
 
 
-/* wmlib event handlers */
-Bool maprequest(wm_t *wm, wm_event_t *event);
-Bool addwin(wm_t *wm, wm_event_t *event);
-Bool focus_container(wm_t *wm, wm_event_t *event);
-Bool expose_container(wm_t *wm, wm_event_t *event);
-Bool keydown(wm_t *wm, wm_event_t *event);
-Bool keyup(wm_t *wm, wm_event_t *event);
-Bool unmap(wm_t *wm, wm_event_t *event);
+/* libwindowmanager event handlers */
+Bool maprequest(wm_t *wm, wm_event_t *event, gpointer data);
+Bool addwin(wm_t *wm, wm_event_t *event, gpointer data);
+Bool focus_container(wm_t *wm, wm_event_t *event, gpointer data);
+void focus_container_timer(wm_t *wm, client_t *client, gpointer data);
+Bool expose_container(wm_t *wm, wm_event_t *event, gpointer data);
+Bool keydown(wm_t *wm, wm_event_t *event, gpointer data);
+Bool unmap(wm_t *wm, wm_event_t *event, gpointer data);
+Bool title_change(wm_t *wm, wm_event_t *event, gpointer data);
 Bool run(const char *cmd);
 
-Window mkframe(wm_t *wm, Window parent, int x, int y, int width, int height);
+void frame_pool_init(wm_t *wm, unsigned int preload);
+Window frame_get(wm_t *wm, Screen *screen, int x, int y,
+                 unsigned int width, unsigned int height, GC *gc);
+void frame_put(wm_t *wm, Screen *screen, Window frame, GC gc);
+
+Window mkframe(wm_t *wm, frame_pool_t *pool);
+GC mkframe_gc(wm_t *wm, frame_pool_t *pool, Window frame);
+Window mktitle(wm_t *wm, Window parent, int x, int y, int width, int height);
 
-container_t *container_new(wm_t *wm, Window parent, int x, int y, int width, int height);
+container_t *container_new(wm_t *wm, Screen *screen, int x, int y, int width, int height);
+Bool container_close(container_t *container, container_t *into);
 
 Bool container_show(container_t *container);
-Bool container_client_add(container_t *container, client_t *client);
+Bool container_client_add(container_t *container, client_t *client,
+                          const XWindowAttributes *frame_attr);
 Bool container_client_show(container_t *container, client_t *client);
 Bool container_blur(container_t *container);
 Bool container_focus(container_t *container);
-Bool container_create_gc(container_t *container);
 Bool container_paint(container_t *container);
-Bool container_relocate_top_client(container_t *from, container_t *to);
+Bool container_paint_titles(container_t *container);
+void container_paint_titles_idle(wm_t *wm, gpointer data);
+Bool container_relocate_top_client(container_t *from, container_t *to,
+                                   const XWindowAttributes *to_attr);
+Bool container_cycle_next(container_t *container);
+Bool container_cycle_prev(container_t *container);
+Bool container_cycle_last(container_t *container);
 
 Bool container_split(container_t *container, unsigned int split_type);
 Bool container_moveresize(container_t *container, int x, int y, unsigned int width, unsigned int height);